@@ -11,6 +11,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
 
 #include "tt_buffer.h"
 #include "tt_socket.h"
@@ -22,9 +30,34 @@
 #include "tt_functions.h"
 #include "tt_mutex.h"
 #include "tt_hashtable.h"
+#include "tt_reactor.h"
+#include "tt_resolver.h"
+#include "tt_datagram_socket.h"
+#include "tt_framer.h"
+#include "tt_ref_buffer.h"
+#include "tt_slot_map.h"
 
 const int TT_TEST_ECHOSERVER = 11;
 const int TT_TEST_FT = 9;
+const int TT_TEST_ENGINES = 12;
+const int TT_TEST_SHARDS = 13;
+const int TT_TEST_ZCSEND = 14;
+const int TT_TEST_ACCEPT = 15;
+const int TT_TEST_CONNECT = 16;
+const int TT_TEST_RESOLVE = 17;
+const int TT_TEST_POOL = 18;
+const int TT_TEST_UDP = 19;
+const int TT_TEST_SENDV = 20;
+const int TT_TEST_SHAPE = 21;
+const int TT_TEST_WRITABLE = 22;
+const int TT_TEST_READLIMIT = 23;
+const int TT_TEST_SOCKOPTS = 24;
+const int TT_TEST_LOCAL = 25;
+const int TT_TEST_FRAMER = 26;
+const int TT_TEST_LINES = 27;
+const int TT_TEST_BROADCAST = 28;
+const int TT_TEST_LOOKUP = 29;
+const int TT_TEST_REAP = 30;
 
 using namespace std;
 
@@ -34,7 +67,20 @@ time_t starttime;
 time_t endtime;
 int test_type = 0;
 int total_bytes = 0;
+long int bench_bytes = 0;
+long int bench_callbacks = 0;
+unsigned long bench_hash = 0;
+long int accepted = 0;
+long int connected = 0;
+long int ended = 0;
 bool done = false;
+bool file_done = false;
+int buffers_out = 0;
+long int datagrams = 0;
+volatile long int writables = 0;
+int pong_port = 0;
+volatile bool pool_stall = false;
+volatile bool pool_stalled = false;
 
 class MyNotify : public TTNotify {
 public:
@@ -43,6 +89,48 @@ public:
 
 void MyNotify::DoNotify(long int channel, int type, void * data)
 {
+   if ( test_type == TT_TEST_CONNECT || test_type == TT_TEST_RESOLVE ) {
+      if ( type == TT_NOTIFY_CONNECTED ) __sync_fetch_and_add(&connected, 1);
+      else if ( type == TT_NOTIFY_END ) __sync_fetch_and_add(&ended, 1);
+      return;
+   }
+   
+   if ( test_type == TT_TEST_POOL && type == TT_NOTIFY_IN && pool_stall ) {
+      // hold the client's loop so it can't see its upstream go.
+      pool_stalled = true;
+      while ( pool_stall ) usleep(1000);
+   }
+   if ( test_type == TT_TEST_POOL && type != TT_NOTIFY_IN ) return;
+   
+   if ( (test_type == TT_TEST_SOCKOPTS || test_type == TT_TEST_LOCAL) && type == TT_NOTIFY_CONNECTED ) {
+      __sync_fetch_and_add(&connected, 1);
+      return;
+   }
+   if ( (test_type == TT_TEST_WRITABLE || test_type == TT_TEST_SOCKOPTS || test_type == TT_TEST_LOCAL ||
+        test_type == TT_TEST_FRAMER || test_type == TT_TEST_LINES) && type == TT_NOTIFY_WRITABLE ) {
+      __sync_fetch_and_add(&writables, 1);
+      return;
+   }
+   
+   if ( test_type == TT_TEST_UDP ) {
+      if ( type == TT_NOTIFY_DATAGRAM ) {
+         TTDatagram * dg = (TTDatagram*)data;
+         if ( dg->length == 4 && memcmp(dg->data, "ping", 4) == 0 ) {
+            ttnetwork->SendDatagram(channel, dg->ip, dg->port, (unsigned char*)"pong", 4);
+         }
+         else if ( dg->length == 4 && memcmp(dg->data, "pong", 4) == 0 ) pong_port = dg->port;
+         else __sync_fetch_and_add(&datagrams, 1);
+      }
+      else if ( type == TT_NOTIFY_END ) __sync_fetch_and_add(&ended, 1);
+      return;
+   }
+   
+   if ( test_type == TT_TEST_ACCEPT || test_type == TT_TEST_REAP ) {
+      if ( type == TT_NOTIFY_BEGIN ) __sync_fetch_and_add(&accepted, 1);
+      else if ( type == TT_NOTIFY_END ) __sync_fetch_and_add(&ended, 1);
+      return;
+   }
+   
    if ( type == TT_NOTIFY_CONNECTED) {
       cout << "TT_NOTIFY_CONNECTED on channel " << channel << endl;
    }
@@ -66,12 +154,56 @@ void MyNotify::DoNotify(long int channel, int type, void * data)
          total_bytes += ttb->Size();
          mutex->Unlock();
       }
+      else if ( test_type == TT_TEST_SENDV ) {
+         mutex->Lock();
+         unsigned char * b = ttb->Buffer();
+         for ( long int i = 0; i < ttb->Size(); i++ ) bench_hash = bench_hash * 31 + b[i];
+         bench_bytes += ttb->Size();
+         mutex->Unlock();
+      }
+      else if ( test_type == TT_TEST_ENGINES || test_type == TT_TEST_SHARDS || 
+                test_type == TT_TEST_POOL || test_type == TT_TEST_SHAPE || 
+                test_type == TT_TEST_WRITABLE || test_type == TT_TEST_SOCKOPTS ||
+                test_type == TT_TEST_LOCAL || test_type == TT_TEST_BROADCAST ) {
+         mutex->Lock();
+         bench_bytes += ttb->Size();
+         bench_callbacks++;
+         mutex->Unlock();
+      }
       
       ttb->Pop(ttb->Size());
    }
    else if ( type == TT_NOTIFY_ACCEPT) {
       cout << "TT_NOTIFY_ACCEPT from " << channel << endl;
    }
+   else if ( type == TT_NOTIFY_FILE_DONE ) {
+      file_done = true;
+   }
+   else if ( type == TT_NOTIFY_SEND_DONE ) {
+      mutex->Lock();
+      buffers_out--;
+      mutex->Unlock();
+   }
+}
+
+//
+// Echoes everything back on the network it is given, for the 
+// benchmarks that run a server and its clients in one process.
+
+class EchoNotify : public TTNotify {
+public:
+   TTNetwork * network;
+   void DoNotify(long int channel, int type, void * data);
+};
+
+void EchoNotify::DoNotify(long int channel, int type, void * data)
+{
+   if ( type == TT_NOTIFY_BEGIN ) __sync_fetch_and_add(&accepted, 1);
+   else if ( type == TT_NOTIFY_IN ) {
+      TTBuffer * ttb = (TTBuffer*)data;
+      network->Send(channel, ttb->Buffer(), ttb->Size());
+      ttb->Pop(ttb->Size());
+   }
 }
 
 void TestThreadedSocket()
@@ -351,11 +483,1666 @@ void SendFile(char * argv[])
    
    ttnetwork->Disconnect(c1);
    
+   // the sends are queued, wait for them to go out.
+   while ( !done ) usleep(1000);
+   
    cout << "File transfer " << totalBytes << " bytes in ";
    cout << (time(NULL) - starttime) << " seconds" << endl;
    
 }
 
+//
+// Same as SendFile() but hands the file to TTNetwork::SendFile(), 
+// between a header and a trailer sent the usual way.
+
+void SendFileZeroCopy(char * argv[])
+{
+   // testapp zerocopy host port filename
+   int port = atoi(argv[3]);
+   char * fileName = argv[4];
+   char * host = argv[2];
+   
+   TTNotify * notify = new MyNotify();
+   ttnetwork = new TTNetwork(notify);
+   mutex = new TTMutex();
+   
+   int fd = open(fileName, O_RDONLY);
+   if ( fd < 0 ) {
+      cout << "Couldn't open file" << endl;
+      exit(0);
+   }
+   struct stat st;
+   fstat(fd, &st);
+   
+   struct timeval start, end;
+   gettimeofday(&start, NULL);
+   clock_t cpu = clock();
+   
+   long int c1 = ttnetwork->Connect(host,port);
+   ttnetwork->Send(c1, (unsigned char*)"BEGIN\n", 6);
+   ttnetwork->SendFile(c1, fd, 0, st.st_size);
+   ttnetwork->Send(c1, (unsigned char*)"END\n", 4);
+   while ( !file_done ) usleep(1000);
+   ttnetwork->Disconnect(c1);
+   while ( !done ) usleep(1000);
+   close(fd);
+   
+   gettimeofday(&end, NULL);
+   double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+   cout << "File transfer " << st.st_size << " bytes in " << seconds << " seconds, ";
+   cout << (double)(clock() - cpu) / CLOCKS_PER_SEC << " seconds of cpu" << endl;
+}
+
+//
+// Send megabytes of data from a small pool of one megabyte buffers 
+// with TTNetwork::SendZeroCopy(), or with Send() when the last 
+// argument is "copy", and report the cpu time used.  A buffer is 
+// only refilled once TT_NOTIFY_SEND_DONE hands it back, block n 
+// holds the byte n so the receiver can check nothing was reused 
+// early.
+
+int Outstanding()
+{
+   mutex->Lock();
+   int out = buffers_out;
+   mutex->Unlock();
+   return out;
+}
+
+void ZeroCopySend(char * argv[])
+{
+   // testapp zcsend host port megabytes [copy]
+   char * host = argv[2];
+   int port = atoi(argv[3]);
+   int megabytes = atoi(argv[4]);
+   bool copy = ( argv[5] && strcmp(argv[5], "copy") == 0 );
+   const int pool = 8;
+   const int size = 1024 * 1024;
+   
+   mutex = new TTMutex();
+   ttnetwork = new TTNetwork(new MyNotify());
+   
+   unsigned char * buffers[pool];
+   for ( int i = 0; i < pool; i++ ) buffers[i] = new unsigned char[size];
+   buffers_out = 0;
+   
+   struct timeval start, end;
+   gettimeofday(&start, NULL);
+   clock_t cpu = clock();
+   
+   long int c1 = ttnetwork->Connect(host, port);
+   for ( int block = 0; block < megabytes; block++ ) {
+      // buffers come back in the order they went out, so the next 
+      // one is free once fewer than pool are outstanding.
+      while ( Outstanding() >= pool ) usleep(100);
+      unsigned char * buf = buffers[block % pool];
+      memset(buf, block & 0xFF, size);
+      if ( copy ) ttnetwork->Send(c1, buf, size);
+      else {
+         mutex->Lock();
+         buffers_out++;
+         mutex->Unlock();
+         if ( !ttnetwork->SendZeroCopy(c1, buf, size) ) {
+            cout << "SendZeroCopy failed" << endl;
+            exit(0);
+         }
+      }
+   }
+   
+   // the buffers have to come back before they are freed.
+   while ( Outstanding() > 0 ) usleep(1000);
+   ttnetwork->Disconnect(c1);
+   while ( !done ) usleep(1000);
+   
+   gettimeofday(&end, NULL);
+   double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+   cout << ( copy ? "Copied " : "Zero copy sent " ) << megabytes << " MB in " << seconds << " seconds, ";
+   cout << (double)(clock() - cpu) / CLOCKS_PER_SEC << " seconds of cpu" << endl;
+   for ( int i = 0; i < pool; i++ ) delete [] buffers[i];
+}
+
+//
+// Open and close count connections to a local listener as fast as 
+// possible and report the accept rate.  With more than one shard 
+// every shard listens on the port with SO_REUSEPORT.  Then check 
+// that stopping the port doesn't wait on a connection and leaves a 
+// second port listening.
+
+bool TryConnect(int port)
+{
+   struct sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(port);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   int sock = socket(AF_INET, SOCK_STREAM, 0);
+   bool ok = ( connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0 );
+   close(sock);
+   return ok;
+}
+
+void * AcceptClients(void * param)
+{
+   int port = ((int*)param)[0];
+   int count = ((int*)param)[1];
+   for ( int i = 0; i < count; i++ ) {
+      if ( !TryConnect(port) ) {
+         cout << "connect failed after " << i << endl;
+         break;
+      }
+   }
+   return 0;
+}
+
+void TestAccept(char * argv[])
+{
+   // args : prog accept port count [shards]
+   int params[2];
+   params[0] = atoi(argv[2]);
+   params[1] = atoi(argv[3]);
+   int count = argv[4] ? atoi(argv[4]) : 1;
+   
+   TTNetwork * server = new TTNetwork(new MyNotify(), TT_ENGINE_EPOLL, count);
+   if ( !server->Listen(NULL, params[0], TT_LISTEN_BACKLOG, count > 1) ||
+        !server->Listen(NULL, params[0] + 1) ) {
+      cout << "Couldn't listen on " << params[0] << endl;
+      exit(0);
+   }
+   
+   struct timeval start, end;
+   gettimeofday(&start, NULL);
+   pthread_t thread;
+   pthread_create(&thread, NULL, AcceptClients, (void*)params);
+   pthread_join(thread, NULL);
+   while ( __sync_fetch_and_add(&accepted, 0) < params[1] ) usleep(1000);
+   gettimeofday(&end, NULL);
+   double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+   
+   gettimeofday(&start, NULL);
+   server->ListenStop(params[0]);
+   gettimeofday(&end, NULL);
+   double stopped = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+   
+   cout << "Testing accept." << endl;
+   cout << "   Shards        : " << server->Shards() << endl;
+   cout << "   Accepted      : " << accepted << endl;
+   cout << "   Seconds       : " << seconds << endl;
+   cout << "   Accepts / sec : " << (long int)(accepted / seconds) << endl;
+   cout << "   Stop seconds  : " << stopped << endl;
+   cout << "   Stopped port  : " << ( TryConnect(params[0]) ? "still open" : "closed" ) << endl;
+   cout << "   Other port    : " << ( TryConnect(params[0] + 1) ? "open" : "closed" ) << endl;
+   cout << "Done Testing accept." << endl;
+   
+   server->ShutdownNetwork();
+}
+
+//
+// Start count connects to a local listener all at once and time how 
+// long they take to finish.  Then start some against a listener 
+// that never accepts, so most sit in SYN_SENT, and check they give 
+// up after timeout milliseconds.
+
+double Since(struct timeval * start)
+{
+   struct timeval end;
+   gettimeofday(&end, NULL);
+   return (end.tv_sec - start->tv_sec) + (end.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+void TestConnect(char * argv[])
+{
+   // args : prog connects port count timeout
+   int port = atoi(argv[2]);
+   int count = atoi(argv[3]);
+   int timeout = atoi(argv[4]);
+   
+   EchoNotify * echo = new EchoNotify();
+   TTNetwork * server = new TTNetwork(echo);
+   echo->network = server;
+   TTNetwork * client = new TTNetwork(new MyNotify());
+   if ( !server->Listen(NULL, port) ) {
+      cout << "Couldn't listen on " << port << endl;
+      exit(0);
+   }
+   
+   struct timeval start;
+   gettimeofday(&start, NULL);
+   for ( int i = 0; i < count; i++ ) client->Connect("127.0.0.1", port, timeout);
+   double issued = Since(&start);
+   while ( __sync_fetch_and_add(&connected, 0) + __sync_fetch_and_add(&ended, 0) < count ) usleep(1000);
+   double seconds = Since(&start);
+   
+   cout << "Testing connect." << endl;
+   cout << "   Connects      : " << count << endl;
+   cout << "   Connected     : " << connected << endl;
+   cout << "   Issue seconds : " << issued << endl;
+   cout << "   Seconds       : " << seconds << endl;
+   cout << "   Connects / sec: " << (long int)(connected / seconds) << endl;
+   
+   client->ShutdownNetwork();
+   while ( __sync_fetch_and_add(&ended, 0) < count ) usleep(1000);
+   
+   // a listener with no room that never accepts.
+   int hole = socket(AF_INET, SOCK_STREAM, 0);
+   struct sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(port + 1);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   if ( bind(hole, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(hole, 0) < 0 ) {
+      cout << "Couldn't listen on " << port + 1 << endl;
+      exit(0);
+   }
+   
+   const int stuck = 20;
+   connected = 0;
+   ended = 0;
+   gettimeofday(&start, NULL);
+   for ( int i = 0; i < stuck; i++ ) client->Connect("127.0.0.1", port + 1, timeout);
+   while ( __sync_fetch_and_add(&connected, 0) + __sync_fetch_and_add(&ended, 0) < stuck ) usleep(1000);
+   seconds = Since(&start);
+   
+   cout << "   Stuck connects: " << stuck << endl;
+   cout << "   Got through   : " << connected << endl;
+   cout << "   Timed out     : " << ended << endl;
+   cout << "   Seconds       : " << seconds << endl;
+   cout << "Done Testing connect." << endl;
+   
+   client->ShutdownNetwork();
+   server->ShutdownNetwork();
+   sleep(1);
+   close(hole);
+}
+
+//
+// A stub DNS server on loopback for the resolver test.  It answers 
+// every A query with 10.1.2.3 and the given TTL, except names that 
+// start with "nx" which don't exist, and counts the queries.
+
+long int dns_queries = 0;
+long int resolved = 0;
+unsigned long resolved_ip = 0;
+
+void * StubDNS(void * parm)
+{
+   int * params = (int*)parm;
+   int sock = params[0];
+   int ttl = params[1];
+   unsigned char msg[512];
+   struct sockaddr_in from;
+   socklen_t fromLen;
+   int len;
+   while ( true ) {
+      fromLen = sizeof(from);
+      len = recvfrom(sock, msg, sizeof(msg) - 16, 0, (struct sockaddr*)&from, &fromLen);
+      if ( len < 17 ) continue;
+      __sync_fetch_and_add(&dns_queries, 1);
+      bool nx = ( msg[12] >= 2 && msg[13] == 'n' && msg[14] == 'x' );
+      msg[2] = 0x81;
+      msg[3] = nx ? 0x83 : 0x80;
+      msg[7] = nx ? 0 : 1;
+      if ( !nx ) {
+         // name pointer to the question, A, IN, ttl, 4 bytes.
+         unsigned char answer[16] = { 0xC0, 12, 0, 1, 0, 1, 
+            (unsigned char)(ttl >> 24), (unsigned char)(ttl >> 16), 
+            (unsigned char)(ttl >> 8), (unsigned char)ttl, 0, 4, 10, 1, 2, 3 };
+         memcpy(msg + len, answer, 16);
+         len += 16;
+      }
+      sendto(sock, msg, len, 0, (struct sockaddr*)&from, fromLen);
+   }
+   return 0;
+}
+
+class ResolveWaiter : public TTReactorHandler {
+public:
+   void HandleEvent(int events) {}
+   void HandleResolved(long int request, unsigned long ip)
+   {
+      resolved_ip = ip;
+      __sync_fetch_and_add(&resolved, 1);
+   }
+};
+
+//
+// Resolve names through the stub server: many lookups of one name 
+// should share one query, a repeat should come from the cache, and 
+// a lookup after the TTL runs out should query again.  Then check 
+// the hosts only mode and a network connect by name.
+
+void TestResolve(char * argv[])
+{
+   // args : prog resolve port ttl
+   int port = atoi(argv[2]);
+   int ttl = atoi(argv[3]);
+   const int count = 1000;
+   
+   int params[2];
+   params[0] = socket(AF_INET, SOCK_DGRAM, 0);
+   params[1] = ttl;
+   struct sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(port);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   if ( bind(params[0], (struct sockaddr*)&addr, sizeof(addr)) < 0 ) {
+      cout << "Couldn't bind " << port << endl;
+      exit(0);
+   }
+   pthread_t thread;
+   pthread_create(&thread, NULL, StubDNS, (void*)params);
+   
+   TTReactor * reactor = TTReactor::Create(TT_ENGINE_EPOLL);
+   TTResolver * resolver = new TTResolver(reactor);
+   resolver->SetServer("127.0.0.1", port);
+   ResolveWaiter * waiter = new ResolveWaiter();
+   unsigned long ip;
+   
+   struct timeval start;
+   gettimeofday(&start, NULL);
+   int waiting = 0;
+   for ( int i = 0; i < count; i++ ) {
+      if ( resolver->Resolve("Stub.Test", waiter, &ip) ) waiting++;
+   }
+   while ( __sync_fetch_and_add(&resolved, 0) < waiting ) usleep(1000);
+   double seconds = Since(&start);
+   
+   cout << "Testing resolver." << endl;
+   cout << "   Lookups       : " << count << endl;
+   cout << "   Waited        : " << waiting << endl;
+   cout << "   Queries       : " << dns_queries << endl;
+   cout << "   Address       : " << ( resolved_ip == 0x0A010203 ? "10.1.2.3" : "wrong" ) << endl;
+   cout << "   Seconds       : " << seconds << endl;
+   
+   bool cached = ( resolver->Resolve("stub.test", waiter, &ip) == 0 && ip == 0x0A010203 );
+   cout << "   Cached        : " << ( cached ? "yes" : "no" ) << endl;
+   
+   sleep(ttl + 1);
+   resolved = 0;
+   if ( resolver->Resolve("stub.test", waiter, &ip) ) {
+      while ( __sync_fetch_and_add(&resolved, 0) < 1 ) usleep(1000);
+   }
+   cout << "   After TTL     : " << dns_queries << " queries" << endl;
+   
+   resolved = 0;
+   resolved_ip = 1;
+   if ( resolver->Resolve("nx.test", waiter, &ip) ) {
+      while ( __sync_fetch_and_add(&resolved, 0) < 1 ) usleep(1000);
+   }
+   long int before = dns_queries;
+   bool negative = ( resolved_ip == 0 && resolver->Resolve("nx.test", waiter, &ip) == 0 && ip == 0 );
+   cout << "   No such name  : " << ( negative && dns_queries == before ? "cached" : "wrong" ) << endl;
+   
+   TTResolver * local = new TTResolver(reactor, TT_RESOLVE_HOSTS);
+   bool found = ( local->Resolve("localhost", waiter, &ip) == 0 && ip == 0x7F000001 );
+   cout << "   Hosts only    : " << ( found ? "localhost found" : "localhost missing" ) << endl;
+   
+   EchoNotify * echo = new EchoNotify();
+   TTNetwork * server = new TTNetwork(echo);
+   echo->network = server;
+   TTNetwork * client = new TTNetwork(new MyNotify());
+   if ( !server->Listen(NULL, port + 1) ) {
+      cout << "Couldn't listen on " << port + 1 << endl;
+      exit(0);
+   }
+   client->Connect("localhost", port + 1);
+   while ( __sync_fetch_and_add(&connected, 0) + __sync_fetch_and_add(&ended, 0) < 1 ) usleep(1000);
+   cout << "   By name       : " << ( connected ? "connected" : "failed" ) << endl;
+   cout << "Done Testing resolver." << endl;
+   
+   client->ShutdownNetwork();
+   server->ShutdownNetwork();
+   sleep(1);
+   delete reactor;
+   delete resolver;
+   delete local;
+}
+
+//
+// Stream megabytes of data over loopback between two networks 
+// using the given engine and report the system calls made.
+
+long int BenchReceived()
+{
+   mutex->Lock();
+   long int received = bench_bytes;
+   mutex->Unlock();
+   return received;
+}
+
+void BenchEngine(int engine, int port, int megabytes)
+{
+   TTNotify * notify = new MyNotify();
+   TTNetwork * server = new TTNetwork(notify, engine);
+   TTNetwork * client = new TTNetwork(notify, engine);
+   server->Listen(NULL, port);
+   usleep(100000);
+   
+   unsigned char buffer[TT_MAX_WRITE];
+   memset(buffer, 0, TT_MAX_WRITE);
+   long int target = (long int)megabytes * 1024 * 1024;
+   long int sent = 0;
+   bench_bytes = 0;
+   bench_callbacks = 0;
+   
+   struct timeval start, end;
+   gettimeofday(&start, NULL);
+   long int calls = TT_SyscallCount();
+   
+   long int c1 = client->Connect("127.0.0.1", port);
+   while ( sent < target ) {
+      // stay a few megabytes ahead of the receiver.
+      if ( sent - BenchReceived() > 4 * 1024 * 1024 ) {
+         usleep(100);
+         continue;
+      }
+      client->Send(c1, buffer, TT_MAX_WRITE);
+      sent += TT_MAX_WRITE;
+   }
+   while ( BenchReceived() < target ) usleep(1000);
+   
+   calls = TT_SyscallCount() - calls;
+   gettimeofday(&end, NULL);
+   double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+   double gigabytes = target / (1024.0 * 1024.0 * 1024.0);
+   
+   cout << "   Engine        : ";
+   cout << ( client->Engine() == TT_ENGINE_URING ? "io_uring" : "epoll" ) << endl;
+   cout << "   Bytes         : " << target << endl;
+   cout << "   Seconds       : " << seconds << endl;
+   cout << "   Syscalls      : " << calls << endl;
+   cout << "   Syscalls / GB : " << (long int)(calls / gigabytes) << endl;
+   cout << "   Callbacks / MB: " << bench_callbacks / (gigabytes * 1024.0) << endl << endl;
+   
+   client->ShutdownNetwork();
+   server->ShutdownNetwork();
+   sleep(1);
+}
+
+//
+// Make count small request/response exchanges with an echo server, 
+// first connecting for each one and then through the connection 
+// pool, and compare.
+
+void PoolRequest(TTNetwork * client, long int channel, long int expect)
+{
+   unsigned char request[64];
+   memset(request, 'r', sizeof(request));
+   client->Send(channel, request, sizeof(request));
+   while ( BenchReceived() < expect ) usleep(50);
+}
+
+void TestPool(char * argv[])
+{
+   // args : prog pool port count
+   int port = atoi(argv[2]);
+   int count = atoi(argv[3]);
+   mutex = new TTMutex();
+   
+   EchoNotify * echo = new EchoNotify();
+   TTNetwork * server = new TTNetwork(echo);
+   echo->network = server;
+   TTNetwork * client = new TTNetwork(new MyNotify());
+   if ( !server->Listen(NULL, port) ) {
+      cout << "Couldn't listen on " << port << endl;
+      exit(0);
+   }
+   
+   struct timeval start;
+   gettimeofday(&start, NULL);
+   for ( int i = 0; i < count; i++ ) {
+      long int channel = client->Connect("127.0.0.1", port);
+      PoolRequest(client, channel, (i + 1) * 64L);
+      client->Disconnect(channel);
+   }
+   double fresh = Since(&start);
+   long int freshOpened = accepted;
+   
+   client->PoolLimits("127.0.0.1", port, 2, 4);
+   while ( __sync_fetch_and_add(&accepted, 0) < freshOpened + 2 ) usleep(1000);
+   bench_bytes = 0;
+   long int warmed = accepted;
+   
+   gettimeofday(&start, NULL);
+   long int last = 0;
+   for ( int i = 0; i < count; i++ ) {
+      long int channel = client->Checkout("127.0.0.1", port);
+      PoolRequest(client, channel, (i + 1) * 64L);
+      if ( client->Checkin(channel) ) last = channel;
+   }
+   double pooled = Since(&start);
+   
+   // close the server while the client's loop is held up, so only 
+   // checking the socket can tell the idle connections are dead.
+   long int staller = client->Connect("127.0.0.1", port);
+   pool_stall = true;
+   unsigned char poke = 'p';
+   client->Send(staller, &poke, 1);
+   while ( !pool_stalled ) usleep(1000);
+   server->ShutdownNetwork();
+   usleep(100000);
+   long int after = client->Checkout("127.0.0.1", port);
+   pool_stall = false;
+   
+   cout << "Testing pool." << endl;
+   cout << "   Requests      : " << count << endl;
+   cout << "   Connect each  : " << fresh << " seconds, " << freshOpened << " connections" << endl;
+   cout << "   Pooled        : " << pooled << " seconds, " << accepted - freshOpened << " connections" << endl;
+   cout << "   Warmed ahead  : " << warmed - freshOpened << endl;
+   cout << "   Speedup       : " << fresh / pooled << endl;
+   cout << "   Dead upstream : " << ( after != last ? "not handed out" : "handed out" ) << endl;
+   cout << "Done Testing pool." << endl;
+   
+   client->ShutdownNetwork();
+   sleep(1);
+}
+
+//
+// Blast count small datagrams over loopback from one UDP channel to 
+// another, first in sendmmsg() batches and then cut up by the 
+// kernel, and report the packet rate and system calls per packet.  
+// Then check a reply reaches the sender's address.
+
+void UdpRound(TTNetwork * network, long int from, int port, int count, bool segments)
+{
+   const int size = 200;
+   const int chunk = 64;
+   unsigned char buffer[size * chunk];
+   memset(buffer, 'd', sizeof(buffer));
+   datagrams = 0;
+   
+   struct timeval start;
+   gettimeofday(&start, NULL);
+   long int calls = TT_SyscallCount();
+   
+   int sent = 0;
+   while ( sent < count ) {
+      // don't outrun the receiver, loopback drops what won't fit.
+      if ( sent - __sync_fetch_and_add(&datagrams, 0) > 2048 ) {
+         usleep(50);
+         continue;
+      }
+      int n = ( count - sent < chunk ) ? count - sent : chunk;
+      if ( segments ) network->SendSegments(from, INADDR_LOOPBACK, port, buffer, n * size, size);
+      else {
+         for ( int i = 0; i < n; i++ ) {
+            network->SendDatagram(from, INADDR_LOOPBACK, port, buffer + i * size, size, i < n - 1);
+         }
+      }
+      sent += n;
+   }
+   
+   // give stragglers a moment, then count what made it.
+   long int last = -1;
+   while ( __sync_fetch_and_add(&datagrams, 0) < count && last != datagrams ) {
+      last = datagrams;
+      usleep(100000);
+   }
+   double seconds = Since(&start);
+   calls = TT_SyscallCount() - calls;
+   
+   cout << ( segments ? "   Segmented" : "   Batched" ) << endl;
+   cout << "      Received   : " << datagrams << " of " << count << endl;
+   cout << "      Packets/sec: " << (long int)(datagrams / seconds) << endl;
+   cout << "      Syscalls   : " << calls << " (" << (double)calls / count << " per packet)" << endl;
+}
+
+void TestUdp(char * argv[])
+{
+   // args : prog udp port count [offload]
+   int port = atoi(argv[2]);
+   int count = atoi(argv[3]);
+   bool offload = ( argv[4] && strcmp(argv[4], "offload") == 0 );
+   
+   TTNetwork * network = new TTNetwork(new MyNotify());
+   ttnetwork = network;
+   long int server = network->OpenDatagram("127.0.0.1", port, offload);
+   long int client = network->OpenDatagram("127.0.0.1", 0);
+   if ( !server || !client ) {
+      cout << "Couldn't open UDP port " << port << endl;
+      exit(0);
+   }
+   
+   cout << "Testing UDP." << endl;
+   cout << "   Offload       : " << ( offload ? "on" : "off" ) << endl;
+   UdpRound(network, client, port, count, false);
+   UdpRound(network, client, port, count, true);
+   
+   network->SendDatagram(client, INADDR_LOOPBACK, port, (unsigned char*)"ping", 4);
+   for ( int i = 0; i < 1000 && !pong_port; i++ ) usleep(1000);
+   cout << "   Reply from    : " << pong_port << ( pong_port == port ? " (ok)" : " (wrong)" ) << endl;
+   
+   network->Disconnect(server);
+   network->Disconnect(client);
+   for ( int i = 0; i < 1000 && __sync_fetch_and_add(&ended, 0) < 2; i++ ) usleep(1000);
+   cout << "   Closed        : " << ended << " channels" << endl;
+   cout << "Done Testing UDP." << endl;
+}
+
+//
+// A server that answers every byte it receives with a 16 byte 
+// header and a 64K payload, glued into one buffer or sent as two 
+// with SendV().  The replies go out from the loop, where SendV() 
+// doesn't copy.
+
+const int SENDV_HEADER = 16;
+const int SENDV_PAYLOAD = 65536;
+
+class ReplyNotify : public TTNotify {
+public:
+   TTNetwork * network;
+   bool gather;
+   long int replies;
+   unsigned char payload[SENDV_PAYLOAD];
+   void DoNotify(long int channel, int type, void * data);
+};
+
+void ReplyHeader(unsigned char * header, long int sequence)
+{
+   for ( int i = 0; i < SENDV_HEADER; i++ ) header[i] = (unsigned char)(sequence >> (i % 8));
+}
+
+void ReplyNotify::DoNotify(long int channel, int type, void * data)
+{
+   if ( type != TT_NOTIFY_IN ) return;
+   TTBuffer * ttb = (TTBuffer*)data;
+   unsigned char header[SENDV_HEADER];
+   for ( long int i = 0; i < ttb->Size(); i++ ) {
+      ReplyHeader(header, replies++);
+      if ( gather ) {
+         struct iovec iov[2];
+         iov[0].iov_base = header;
+         iov[0].iov_len = SENDV_HEADER;
+         iov[1].iov_base = payload;
+         iov[1].iov_len = SENDV_PAYLOAD;
+         network->SendV(channel, iov, 2);
+      }
+      else {
+         TTBuffer glued;
+         glued.Add(header, SENDV_HEADER);
+         glued.Add(payload, SENDV_PAYLOAD);
+         network->Send(channel, glued.Buffer(), glued.Size());
+      }
+   }
+   ttb->Pop(ttb->Size());
+}
+
+void SendVRound(int port, int megabytes, bool gather)
+{
+   ReplyNotify * reply = new ReplyNotify();
+   TTNetwork * server = new TTNetwork(reply);
+   reply->network = server;
+   reply->gather = gather;
+   reply->replies = 0;
+   for ( int i = 0; i < SENDV_PAYLOAD; i++ ) reply->payload[i] = (unsigned char)(i % 251);
+   TTNetwork * client = new TTNetwork(new MyNotify());
+   if ( !server->Listen(NULL, port) ) {
+      cout << "Couldn't listen on " << port << endl;
+      exit(0);
+   }
+   
+   // what the client should see, in order.
+   long int count = (long int)megabytes * 1024 * 1024 / SENDV_PAYLOAD;
+   long int each = SENDV_HEADER + SENDV_PAYLOAD;
+   unsigned long expect = 0;
+   unsigned char header[SENDV_HEADER];
+   for ( long int r = 0; r < count; r++ ) {
+      ReplyHeader(header, r);
+      for ( int i = 0; i < SENDV_HEADER; i++ ) expect = expect * 31 + header[i];
+      for ( int i = 0; i < SENDV_PAYLOAD; i++ ) expect = expect * 31 + reply->payload[i];
+   }
+   bench_bytes = 0;
+   bench_hash = 0;
+   
+   struct timeval start;
+   gettimeofday(&start, NULL);
+   long int calls = TT_SyscallCount();
+   clock_t cpu = clock();
+   
+   long int channel = client->Connect("127.0.0.1", port);
+   unsigned char ask = 'q';
+   for ( long int r = 0; r < count; r++ ) {
+      // keep a few replies in flight.
+      while ( r * each - BenchReceived() > 32 * each ) usleep(100);
+      client->Send(channel, &ask, 1);
+   }
+   while ( BenchReceived() < count * each ) usleep(1000);
+   double seconds = Since(&start);
+   calls = TT_SyscallCount() - calls;
+   double cpuSeconds = (double)(clock() - cpu) / CLOCKS_PER_SEC;
+   
+   cout << ( gather ? "   SendV" : "   Glued + Send" ) << endl;
+   cout << "      Bytes      : " << bench_bytes << endl;
+   cout << "      Seconds    : " << seconds << " (" << cpuSeconds << " CPU)" << endl;
+   cout << "      Syscalls   : " << calls << endl;
+   cout << "      Stream     : " << ( bench_hash == expect ? "intact" : "CORRUPT" ) << endl;
+   
+   client->ShutdownNetwork();
+   server->ShutdownNetwork();
+   sleep(1);
+}
+
+void TestSendV(char * argv[])
+{
+   // args : prog sendv port megabytes
+   int port = atoi(argv[2]);
+   int megabytes = atoi(argv[3]);
+   mutex = new TTMutex();
+   
+   cout << "Testing SendV, " << megabytes << " MB of header + payload replies." << endl;
+   SendVRound(port, megabytes, false);
+   SendVRound(port + 1, megabytes, true);
+   cout << "Done Testing SendV." << endl;
+}
+
+//
+// Push megabytes through clients channels, shaped one of three 
+// ways, and compare the rate reached with the limit.  With perChannel 
+// each channel is limited to rate on its own, otherwise the client 
+// network's sends or, with receive set, the server network's 
+// receives are limited to rate in total.
+
+void ShapeRound(int engine, int port, int clients, int megabytes, long int rate, bool perChannel, bool receive)
+{
+   TTNotify * notify = new MyNotify();
+   TTNetwork * server = new TTNetwork(notify, engine);
+   TTNetwork * client = new TTNetwork(notify, engine);
+   if ( receive ) server->ShapeAll(0, rate);
+   else if ( !perChannel ) client->ShapeAll(rate, 0);
+   server->Listen(NULL, port);
+   usleep(100000);
+   
+   long int * channels = new long int[clients];
+   for ( int i = 0; i < clients; i++ ) {
+      channels[i] = client->Connect("127.0.0.1", port);
+      if ( perChannel ) client->Shape(channels[i], rate, 0);
+   }
+   
+   unsigned char buffer[TT_MAX_WRITE];
+   memset(buffer, 0, TT_MAX_WRITE);
+   long int target = (long int)megabytes * 1024 * 1024;
+   long int sent = 0;
+   bench_bytes = 0;
+   
+   struct timeval start, end;
+   gettimeofday(&start, NULL);
+   int next = 0;
+   while ( sent < target ) {
+      if ( sent - BenchReceived() > 1024 * 1024 ) {
+         usleep(1000);
+         continue;
+      }
+      client->Send(channels[next], buffer, TT_MAX_WRITE);
+      next = (next + 1) % clients;
+      sent += TT_MAX_WRITE;
+   }
+   while ( BenchReceived() < target ) usleep(1000);
+   gettimeofday(&end, NULL);
+   double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+   long int limit = perChannel ? rate * clients : rate;
+   
+   cout << "   Engine        : ";
+   cout << ( client->Engine() == TT_ENGINE_URING ? "io_uring" : "epoll" ) << endl;
+   cout << "   Limit         : " << ( perChannel ? "per channel send" : receive ? "total receive" : "total send" ) << endl;
+   cout << "   Channels      : " << clients << endl;
+   cout << "   Bytes / second: " << (long int)(target / seconds) << " of " << limit << endl << endl;
+   
+   client->ShutdownNetwork();
+   server->ShutdownNetwork();
+   sleep(1);
+   delete [] channels;
+}
+
+void TestShape(char * argv[])
+{
+   // args : prog shape port megabytes rate
+   int port = atoi(argv[2]);
+   int megabytes = atoi(argv[3]);
+   long int rate = atol(argv[4]);
+   mutex = new TTMutex();
+   
+   cout << "Testing shaping, " << megabytes << " MB at " << rate << " bytes a second." << endl;
+   ShapeRound(TT_ENGINE_EPOLL, port, 1, megabytes, rate, true, false);
+   ShapeRound(TT_ENGINE_URING, port + 1, 1, megabytes, rate, true, false);
+   ShapeRound(TT_ENGINE_EPOLL, port + 2, 2, megabytes, rate, false, false);
+   ShapeRound(TT_ENGINE_EPOLL, port + 3, 2, megabytes, rate, false, true);
+   ShapeRound(TT_ENGINE_URING, port + 4, 2, megabytes, rate, false, true);
+   cout << "Done Testing shaping." << endl;
+}
+
+//
+// Push megabytes at a receiver limited to 32 MB a second as fast as 
+// Send() takes them, first holding off whenever the channel reports 
+// it is full until it is writable again, then not.  The peak 
+// resident size shows what the queue cost.
+
+long int PeakKB()
+{
+   struct rusage ru;
+   getrusage(RUSAGE_SELF, &ru);
+   return ru.ru_maxrss;
+}
+
+void WritableRound(int port, int megabytes, bool wait)
+{
+   TTNotify * notify = new MyNotify();
+   TTNetwork * server = new TTNetwork(notify);
+   TTNetwork * client = new TTNetwork(notify);
+   server->ShapeAll(0, 32L * 1024 * 1024);
+   server->Listen(NULL, port);
+   usleep(100000);
+   
+   long int c1 = client->Connect("127.0.0.1", port);
+   unsigned char buffer[65536];
+   memset(buffer, 0, sizeof(buffer));
+   long int target = (long int)megabytes * 1024 * 1024;
+   long int sent = 0;
+   long int full = 0;
+   bench_bytes = 0;
+   writables = 0;
+   long int before = PeakKB();
+   
+   struct timeval start, end;
+   gettimeofday(&start, NULL);
+   while ( sent < target ) {
+      long int seen = writables;
+      int state = client->Send(c1, buffer, sizeof(buffer));
+      sent += sizeof(buffer);
+      if ( state == TT_SEND_FULL ) {
+         full++;
+         while ( wait && writables == seen ) usleep(100);
+      }
+   }
+   while ( BenchReceived() < target ) usleep(1000);
+   gettimeofday(&end, NULL);
+   double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+   
+   cout << "   " << ( wait ? "Waiting on writable" : "Ignoring full" ) << endl;
+   cout << "      Seconds    : " << seconds << endl;
+   cout << "      Full       : " << full << endl;
+   cout << "      Writable   : " << writables << endl;
+   cout << "      Peak growth: " << PeakKB() - before << " KB" << endl;
+   
+   client->ShutdownNetwork();
+   server->ShutdownNetwork();
+   sleep(1);
+}
+
+void TestWritable(char * argv[])
+{
+   // args : prog writable port megabytes
+   int port = atoi(argv[2]);
+   int megabytes = atoi(argv[3]);
+   mutex = new TTMutex();
+   
+   cout << "Testing watermarks, " << megabytes << " MB." << endl;
+   WritableRound(port, megabytes, true);
+   WritableRound(port + 1, megabytes, false);
+   cout << "Done Testing watermarks." << endl;
+}
+
+//
+// A consumer that only takes rate bytes a second, leaving the rest 
+// in the channel's buffer, with and without a read limit.  With the 
+// limit the unread backlog stays near it, without it the backlog 
+// grows to whatever the sender got ahead by.
+
+class SlowNotify : public TTNotify {
+public:
+   TTNetwork * network;
+   long int limit;
+   volatile long int channel;
+   volatile long int budget;
+   long int peak;
+   void DoNotify(long int channel, int type, void * data);
+};
+
+void SlowNotify::DoNotify(long int chn, int type, void * data)
+{
+   if ( type == TT_NOTIFY_BEGIN ) {
+      if ( limit > 0 ) network->ReadLimit(chn, limit);
+      channel = chn;
+   }
+   if ( type != TT_NOTIFY_IN ) return;
+   TTBuffer * ttb = (TTBuffer*)data;
+   if ( ttb->Size() > peak ) peak = ttb->Size();
+   long int take = ttb->Size();
+   if ( take > budget ) take = budget;
+   ttb->Pop(take);
+   __sync_fetch_and_sub(&budget, take);
+   mutex->Lock();
+   bench_bytes += take;
+   mutex->Unlock();
+}
+
+void ReadLimitRound(int engine, int port, int megabytes, long int limit)
+{
+   long int rate = 64L * 1024 * 1024;
+   SlowNotify * slow = new SlowNotify();
+   TTNetwork * server = new TTNetwork(slow, engine);
+   TTNetwork * client = new TTNetwork(new MyNotify(), engine);
+   slow->network = server;
+   slow->limit = limit;
+   slow->channel = 0;
+   slow->budget = 0;
+   slow->peak = 0;
+   server->Listen(NULL, port);
+   usleep(100000);
+   
+   long int c1 = client->Connect("127.0.0.1", port);
+   unsigned char buffer[65536];
+   memset(buffer, 0, sizeof(buffer));
+   long int target = (long int)megabytes * 1024 * 1024;
+   for ( long int sent = 0; sent < target; sent += sizeof(buffer) ) client->Send(c1, buffer, sizeof(buffer));
+   bench_bytes = 0;
+   
+   // hand the consumer its allowance a millisecond at a time, and 
+   // have another look at what is waiting.
+   while ( BenchReceived() < target ) {
+      usleep(1000);
+      __sync_fetch_and_add(&slow->budget, rate / 1000);
+      if ( slow->channel ) server->ResumeRead(slow->channel);
+   }
+   
+   cout << "   Engine        : ";
+   cout << ( server->Engine() == TT_ENGINE_URING ? "io_uring" : "epoll" ) << endl;
+   cout << "   Read limit    : " << limit << endl;
+   cout << "   Peak unread   : " << slow->peak << endl << endl;
+   
+   client->ShutdownNetwork();
+   server->ShutdownNetwork();
+   sleep(1);
+}
+
+void TestReadLimit(char * argv[])
+{
+   // args : prog readlimit port megabytes
+   int port = atoi(argv[2]);
+   int megabytes = atoi(argv[3]);
+   mutex = new TTMutex();
+   
+   cout << "Testing read limits, " << megabytes << " MB to a slow reader." << endl;
+   ReadLimitRound(TT_ENGINE_EPOLL, port, megabytes, 1048576);
+   ReadLimitRound(TT_ENGINE_URING, port + 1, megabytes, 1048576);
+   ReadLimitRound(TT_ENGINE_EPOLL, port + 2, megabytes, 0);
+   cout << "Done Testing read limits." << endl;
+}
+
+//
+// Compare socket option profiles.  Latency is the round trip of a 
+// 64 byte request, written as a header and a body the way many 
+// protocols do, which the server answers once it has all of it.  
+// Throughput is a bulk one way transfer.  With a unix: address the 
+// rounds run over a Unix domain socket instead of loopback TCP.
+
+const int PROFILE_REQUEST = 64;
+const int PROFILE_HEADER = 16;
+
+class ProfileNotify : public TTNotify {
+public:
+   TTNetwork * network;
+   void DoNotify(long int channel, int type, void * data);
+};
+
+void ProfileNotify::DoNotify(long int channel, int type, void * data)
+{
+   if ( type != TT_NOTIFY_IN ) return;
+   TTBuffer * ttb = (TTBuffer*)data;
+   if ( done ) {
+      // bulk, just count it.
+      mutex->Lock();
+      total_bytes += ttb->Size();
+      mutex->Unlock();
+      ttb->Pop(ttb->Size());
+      return;
+   }
+   while ( ttb->Size() >= PROFILE_REQUEST ) {
+      network->Send(channel, ttb->Buffer(), PROFILE_REQUEST);
+      ttb->Pop(PROFILE_REQUEST);
+   }
+}
+
+void ProfileRound(char * name, char * address, int port, TTSocketOptions * options, int count, int megabytes)
+{
+   ProfileNotify * profile = new ProfileNotify();
+   TTNetwork * server = new TTNetwork(profile);
+   TTNetwork * client = new TTNetwork(new MyNotify());
+   profile->network = server;
+   server->Listen(address, port, TT_LISTEN_BACKLOG, false, options);
+   usleep(100000);
+   
+   connected = 0;
+   long int c1 = client->Connect(address ? address : (char*)"127.0.0.1", port, TT_CONNECT_TIMEOUT, options);
+   unsigned char request[PROFILE_REQUEST];
+   memset(request, 'q', sizeof(request));
+   done = false;
+   bench_bytes = 0;
+   
+   // time round trips only, not the connect or the first exchange 
+   // that finishes setting the channel up.  The wait below yields so 
+   // on a single core the loops get to run.
+   while ( __sync_fetch_and_add(&connected, 0) < 1 ) usleep(1000);
+   client->Send(c1, request, PROFILE_REQUEST);
+   while ( BenchReceived() < PROFILE_REQUEST ) usleep(100);
+   mutex->Lock();
+   bench_bytes = 0;
+   mutex->Unlock();
+   
+   struct timeval start, end;
+   gettimeofday(&start, NULL);
+   for ( int i = 0; i < count; i++ ) {
+      client->Send(c1, request, PROFILE_HEADER);
+      client->Send(c1, request + PROFILE_HEADER, PROFILE_REQUEST - PROFILE_HEADER);
+      while ( BenchReceived() < (long int)(i + 1) * PROFILE_REQUEST ) sched_yield();
+   }
+   gettimeofday(&end, NULL);
+   double rtt = ((end.tv_sec - start.tv_sec) * 1000000.0 + (end.tv_usec - start.tv_usec)) / count;
+   
+   done = true;
+   total_bytes = 0;
+   unsigned char buffer[65536];
+   memset(buffer, 0, sizeof(buffer));
+   long int target = (long int)megabytes * 1024 * 1024;
+   long int seen = writables;
+   long int calls = TT_SyscallCount();
+   gettimeofday(&start, NULL);
+   for ( long int sent = 0; sent < target; sent += sizeof(buffer) ) {
+      if ( client->Send(c1, buffer, sizeof(buffer)) == TT_SEND_FULL ) {
+         while ( writables == seen ) usleep(50);
+         seen = writables;
+      }
+   }
+   while ( true ) {
+      mutex->Lock();
+      long int got = total_bytes;
+      mutex->Unlock();
+      if ( got >= target ) break;
+      usleep(100);
+   }
+   gettimeofday(&end, NULL);
+   calls = TT_SyscallCount() - calls;
+   double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+   
+   cout << "   " << name << endl;
+   cout << "      Round trip : " << rtt << " us" << endl;
+   cout << "      MB / second: " << (target / (1024.0 * 1024.0)) / seconds << endl;
+   cout << "      Syscalls/GB: " << (long int)(calls / (target / (1024.0 * 1024.0 * 1024.0))) << endl;
+   
+   client->ShutdownNetwork();
+   server->ShutdownNetwork();
+   sleep(1);
+}
+
+void TestSocketOptions(char * argv[])
+{
+   // args : prog sockopts port count megabytes
+   int port = atoi(argv[2]);
+   int count = atoi(argv[3]);
+   int megabytes = atoi(argv[4]);
+   mutex = new TTMutex();
+   
+   cout << "Testing socket options, " << count << " round trips and " << megabytes << " MB." << endl;
+   ProfileRound("Defaults", NULL, port, NULL, count, megabytes);
+   
+   TTSocketOptions latency;
+   latency.no_delay = 1;
+   latency.busy_poll = 50;
+   ProfileRound("Low latency (no delay, busy poll)", NULL, port + 1, &latency, count, megabytes);
+   
+   TTSocketOptions bulk;
+   bulk.send_buffer = 4194304;
+   bulk.recv_buffer = 4194304;
+   bulk.keepalive_idle = 60;
+   bulk.keepalive_interval = 10;
+   bulk.keepalive_count = 5;
+   ProfileRound("Bulk (4 MB buffers, keepalive)", NULL, port + 2, &bulk, count, megabytes);
+   cout << "Done Testing socket options." << endl;
+}
+
+//
+// Same host peers, loopback TCP against a Unix domain socket and a 
+// shared memory link.
+
+void TestLocal(char * argv[])
+{
+   // args : prog local port path count megabytes
+   int port = atoi(argv[2]);
+   char address[256];
+   char shared[256];
+   snprintf(address, sizeof(address), "%s%s", TT_LOCAL_PREFIX, argv[3]);
+   snprintf(shared, sizeof(shared), "%s%s", TT_SHARED_PREFIX, argv[3]);
+   int count = atoi(argv[4]);
+   int megabytes = atoi(argv[5]);
+   mutex = new TTMutex();
+   
+   cout << "Testing local transport, " << count << " round trips and " << megabytes << " MB." << endl;
+   TTSocketOptions latency;
+   latency.no_delay = 1;
+   ProfileRound("Loopback TCP (no delay)", NULL, port, &latency, count, megabytes);
+   ProfileRound(address, address, port, NULL, count, megabytes);
+   ProfileRound(shared, shared, port, NULL, count, megabytes);
+   cout << "Done Testing local transport." << endl;
+}
+
+//
+// Framing under fragmentation.  The client writes a stream of 
+// length prefixed messages, cut at random points into pieces from a 
+// byte to several kilobytes, and the server checks every message it 
+// is handed against what was sent, in order.  Lines are printable 
+// text, every other one ended with \r\n.
+
+long int FrameLength(long int sequence)
+{
+   if ( sequence % 97 == 0 ) return 40000 + sequence % 1000;
+   return (sequence * 7919) % 1500;
+}
+
+unsigned char FrameByte(long int sequence, long int i)
+{
+   if ( test_type == TT_TEST_LINES ) return (unsigned char)(' ' + (sequence * 31 + i) % 95);
+   return (unsigned char)((sequence * 31 + i) & 0xff);
+}
+
+class FrameNotify : public TTNotify {
+public:
+   volatile long int messages;
+   volatile long int errors;
+   long int bytes;
+   void DoNotify(long int channel, int type, void * data);
+};
+
+void FrameNotify::DoNotify(long int channel, int type, void * data)
+{
+   if ( type == TT_NOTIFY_IN ) errors++;
+   if ( type != TT_NOTIFY_MESSAGE ) return;
+   TTMessage * message = (TTMessage*)data;
+   long int sequence = messages;
+   bool ok = message->length == FrameLength(sequence);
+   for ( long int i = 0; ok && i < message->length; i++ ) {
+      ok = message->data[i] == FrameByte(sequence, i);
+   }
+   if ( !ok ) errors++;
+   bytes += message->length;
+   messages = sequence + 1;
+}
+
+void FramerRound(int format, int port, int count)
+{
+   FrameNotify * frames = new FrameNotify();
+   frames->messages = 0;
+   frames->errors = 0;
+   frames->bytes = 0;
+   TTNetwork * server = new TTNetwork(frames);
+   TTNetwork * client = new TTNetwork(new MyNotify());
+   server->FrameAll(format);
+   server->Listen(NULL, port);
+   usleep(100000);
+   
+   TTSocketOptions options;
+   options.no_delay = 1;
+   long int c1 = client->Connect("127.0.0.1", port, TT_CONNECT_TIMEOUT, &options);
+   
+   // lay the whole stream out first so only the network is timed.
+   long int streamLen = 0;
+   for ( long int n = 0; n < count; n++ ) streamLen += TT_FRAME_HEADER_MAX + FrameLength(n);
+   unsigned char * stream = new unsigned char[streamLen];
+   long int at = 0;
+   for ( long int n = 0; n < count; n++ ) {
+      at += TTFramer::Header(format, FrameLength(n), stream + at);
+      for ( long int i = 0; i < FrameLength(n); i++ ) stream[at++] = FrameByte(n, i);
+      if ( format == TT_FRAME_LINE && n % 2 ) stream[at++] = '\r';
+      if ( format == TT_FRAME_LINE ) stream[at++] = '\n';
+   }
+   streamLen = at;
+   
+   srand(port);
+   long int pieces = 0;
+   long int seen = writables;
+   struct timeval start, end;
+   gettimeofday(&start, NULL);
+   for ( at = 0; at < streamLen; pieces++ ) {
+      int cut = rand() % 3;
+      long int len = 1 + rand() % ( cut == 0 ? 8 : cut == 1 ? 512 : 16384 );
+      if ( len > streamLen - at ) len = streamLen - at;
+      if ( client->Send(c1, stream + at, (int)len) == TT_SEND_FULL ) {
+         while ( writables == seen ) usleep(50);
+         seen = writables;
+      }
+      at += len;
+   }
+   while ( frames->messages < count && frames->errors == 0 ) usleep(100);
+   gettimeofday(&end, NULL);
+   double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+   
+   cout << "   " << ( format == TT_FRAME_16 ? "16 bit" : format == TT_FRAME_32 ? "32 bit" : 
+                       format == TT_FRAME_VARINT ? "varint" : "lines" ) << endl;
+   cout << "      Pieces     : " << pieces << endl;
+   cout << "      Messages   : " << frames->messages << endl;
+   cout << "      Errors     : " << frames->errors << endl;
+   cout << "      Messages/s : " << (long int)(frames->messages / seconds) << endl;
+   cout << "      MB / second: " << (frames->bytes / (1024.0 * 1024.0)) / seconds << endl;
+   
+   client->ShutdownNetwork();
+   server->ShutdownNetwork();
+   delete [] stream;
+   sleep(1);
+}
+
+void TestFramer(char * argv[])
+{
+   // args : prog framer port count
+   int port = atoi(argv[2]);
+   int count = atoi(argv[3]);
+   mutex = new TTMutex();
+   
+   cout << "Testing framing, " << count << " messages in random pieces." << endl;
+   FramerRound(TT_FRAME_16, port, count);
+   FramerRound(TT_FRAME_32, port + 1, count);
+   FramerRound(TT_FRAME_VARINT, port + 2, count);
+   cout << "Done Testing framing." << endl;
+}
+
+//
+// Split a batch of pipelined lines arriving a few kilobytes at a 
+// time, once looking for each line end a byte at a time and once 
+// with TT_FindByte(), both picking up where the last piece left off.
+
+long int ScanLines(const unsigned char * stream, long int len, bool simd)
+{
+   long int lines = 0;
+   long int start = 0;
+   long int scanned = 0;
+   for ( long int arrived = 4096; start < len; arrived += 4096 ) {
+      if ( arrived > len ) arrived = len;
+      while ( true ) {
+         long int end = -1;
+         if ( simd ) {
+            end = TT_FindByte(stream + scanned, arrived - scanned, '\n');
+            if ( end >= 0 ) end += scanned;
+         }
+         else {
+            for ( long int i = scanned; i < arrived; i++ ) {
+               if ( stream[i] == '\n' ) { end = i; break; }
+            }
+         }
+         if ( end < 0 ) {
+            scanned = arrived;
+            break;
+         }
+         lines++;
+         start = scanned = end + 1;
+      }
+   }
+   return lines;
+}
+
+void ScanRound(int megabytes)
+{
+   long int len = (long int)megabytes * 1024 * 1024;
+   unsigned char * stream = new unsigned char[len];
+   srand(1);
+   long int count = 0;
+   for ( long int at = 0; at < len; count++ ) {
+      long int line = rand() % 200;
+      for ( long int i = 0; i < line && at < len - 1; i++ ) stream[at++] = 'a' + i % 26;
+      stream[at++] = '\n';
+   }
+   for ( int simd = 0; simd < 2; simd++ ) {
+      struct timeval start, end;
+      gettimeofday(&start, NULL);
+      long int lines = ScanLines(stream, len, simd);
+      gettimeofday(&end, NULL);
+      double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+      cout << "   " << ( simd ? "TT_FindByte" : "Byte by byte" ) << endl;
+      cout << "      Lines      : " << lines << ( lines == count ? "" : " (wrong)" ) << endl;
+      cout << "      MB / second: " << megabytes / seconds << endl;
+   }
+   delete [] stream;
+}
+
+//
+// A line of exactly the framer's maximum is taken whole even when 
+// its \r arrives before its \n, and one byte longer is refused.
+
+bool SplitLine()
+{
+   const long int max = 64;
+   unsigned char line[max + 3];
+   memset(line, 'a', max + 1);
+   line[max] = '\r';
+   line[max + 1] = '\n';
+   long int offset, length;
+   TTFramer framer(TT_FRAME_LINE, max);
+   if ( framer.Next(line, max + 1, &offset, &length) != 0 ) return false;
+   if ( framer.Next(line, max + 2, &offset, &length) != max + 2 || length != max ) return false;
+   TTFramer longer(TT_FRAME_LINE, max);
+   memset(line, 'a', max + 1);
+   line[max + 1] = '\r';
+   return longer.Next(line, max + 2, &offset, &length) < 0;
+}
+
+void TestLines(char * argv[])
+{
+   // args : prog lines port count megabytes
+   int port = atoi(argv[2]);
+   int count = atoi(argv[3]);
+   int megabytes = atoi(argv[4]);
+   mutex = new TTMutex();
+   
+   cout << "Testing line framing, " << count << " lines in random pieces and " << megabytes << " MB scanned." << endl;
+   FramerRound(TT_FRAME_LINE, port, count);
+   cout << "   Split CRLF    : " << ( SplitLine() ? "ok" : "wrong" ) << endl;
+   ScanRound(megabytes);
+   cout << "Done Testing line framing." << endl;
+}
+
+//
+// Fan one stream of chunks out to a number of peers, once sending 
+// each chunk to every peer in turn and once broadcasting it as one 
+// shared buffer.  CPU is user plus system time for the whole 
+// process, peers included, so only the difference between the two 
+// is the server's.
+
+class FanNotify : public TTNotify {
+public:
+   long int * peers;
+   volatile int count;
+   void DoNotify(long int channel, int type, void * data);
+};
+
+void FanNotify::DoNotify(long int channel, int type, void * data)
+{
+   if ( type != TT_NOTIFY_BEGIN ) return;
+   mutex->Lock();
+   peers[count++] = channel;
+   mutex->Unlock();
+}
+
+double CpuSeconds()
+{
+   struct rusage ru;
+   getrusage(RUSAGE_SELF, &ru);
+   return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000000.0;
+}
+
+void BroadcastRound(int port, int peers, int megabytes, int chunk, bool shared)
+{
+   FanNotify * fan = new FanNotify();
+   fan->peers = new long int[peers];
+   fan->count = 0;
+   TTNetwork * server = new TTNetwork(fan);
+   TTNetwork * client = new TTNetwork(new MyNotify());
+   server->Listen(NULL, port);
+   usleep(100000);
+   for ( int i = 0; i < peers; i++ ) client->Connect("127.0.0.1", port);
+   while ( fan->count < peers ) usleep(1000);
+   
+   unsigned char * data = new unsigned char[chunk];
+   memset(data, 'b', chunk);
+   long int chunks = (long int)megabytes * 1024 * 1024 / chunk;
+   long int sent = 0;
+   bench_bytes = 0;
+   long int before = PeakKB();
+   double cpu = CpuSeconds();
+   
+   struct timeval start, end;
+   gettimeofday(&start, NULL);
+   for ( long int n = 0; n < chunks; n++ ) {
+      if ( shared ) {
+         TTRefBuffer * buffer = new TTRefBuffer(data, chunk);
+         server->Broadcast(fan->peers, peers, buffer);
+         buffer->Drop();
+      }
+      else {
+         for ( int i = 0; i < peers; i++ ) server->Send(fan->peers[i], data, chunk);
+      }
+      sent += (long int)chunk * peers;
+      while ( sent - BenchReceived() > (long int)peers * 1024 * 1024 ) usleep(100);
+   }
+   while ( BenchReceived() < sent ) usleep(1000);
+   gettimeofday(&end, NULL);
+   double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+   
+   cout << "   " << ( shared ? "Broadcast" : "Send to each" ) << ", " << peers << " peers" << endl;
+   cout << "      MB / second: " << (sent / (1024.0 * 1024.0)) / seconds << endl;
+   cout << "      CPU seconds: " << CpuSeconds() - cpu << endl;
+   cout << "      Peak growth: " << PeakKB() - before << " KB" << endl;
+   
+   client->ShutdownNetwork();
+   server->ShutdownNetwork();
+   delete [] data;
+   sleep(1);
+}
+
+void TestBroadcast(char * argv[])
+{
+   // args : prog broadcast port peers megabytes chunk
+   int port = atoi(argv[2]);
+   int peers = atoi(argv[3]);
+   int megabytes = atoi(argv[4]);
+   int chunk = atoi(argv[5]);
+   mutex = new TTMutex();
+   
+   cout << "Testing broadcast, " << megabytes << " MB in " << chunk << " byte chunks to " << peers << " peers." << endl;
+   BroadcastRound(port, peers, megabytes, chunk, true);
+   BroadcastRound(port + 1, peers, megabytes, chunk, false);
+   cout << "Done Testing broadcast." << endl;
+}
+
+//
+// Channel lookups, the way a sender off the loop makes them, in a 
+// 521 bucket hashtable behind a mutex against a slot map read inside 
+// an epoch.  Then half the channels are closed and reopened, and 
+// none of the old keys may find anything.
+
+void TestLookup(char * argv[])
+{
+   // args : prog lookup count
+   int count = atoi(argv[2]);
+   long int lookups = 10000000;
+   TTHashtable * table = new TTHashtable(521);
+   TTMutex * lock = new TTMutex();
+   TTSlotMap * map = new TTSlotMap();
+   long int * keys = new long int[count];
+   for ( int i = 0; i < count; i++ ) {
+      keys[i] = map->Reserve();
+      map->Put(keys[i], (void*)(keys + i));
+      table->Put(keys[i], (void*)(keys + i));
+   }
+   
+   cout << "Testing lookups, " << count << " channels." << endl;
+   unsigned long found = 0;
+   srand(1);
+   struct timeval start, end;
+   for ( int round = 0; round < 2; round++ ) {
+      gettimeofday(&start, NULL);
+      for ( long int n = 0; n < lookups; n++ ) {
+         long int key = keys[(n * 7919) % count];
+         if ( round == 0 ) {
+            lock->Lock();
+            found += ( table->Get(key) != NULL );
+            lock->Unlock();
+         }
+         else {
+            int token = map->Enter();
+            found += ( map->Get(key) != NULL );
+            map->Leave(token);
+         }
+      }
+      gettimeofday(&end, NULL);
+      double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+      cout << "   " << ( round == 0 ? "Hashtable" : "Slot map" ) << endl;
+      cout << "      Lookups / s: " << (long int)(lookups / seconds) << endl;
+      cout << "      ns / lookup: " << seconds * 1000000000.0 / lookups << endl;
+   }
+   
+   long int stale = 0;
+   for ( int i = 0; i < count; i += 2 ) map->Remove(keys[i]);
+   for ( int i = 0; i < count; i += 2 ) map->Put(map->Reserve(), (void*)table);
+   for ( int i = 0; i < count; i += 2 ) stale += ( map->Get(keys[i]) != NULL );
+   cout << "   Found         : " << found << " of " << 2 * lookups << endl;
+   cout << "   Stale found   : " << stale << endl;
+   cout << "Done Testing lookups." << endl;
+   delete [] keys;
+   delete map;
+   delete lock;
+   delete table;
+}
+
+//
+// Open and close count connections as fast as possible with only a 
+// few other channels open, then again with idle channels held open, 
+// and report both accept rates.  Reaping the closed channels 
+// shouldn't cost more with more channels open.  Needs idle file 
+// descriptors, twice over, see ulimit -n.
+
+double ReapRound(int port, int count)
+{
+   int params[2];
+   params[0] = port;
+   params[1] = count;
+   long int startAccepted = __sync_fetch_and_add(&accepted, 0);
+   long int startEnded = __sync_fetch_and_add(&ended, 0);
+   
+   struct timeval start, end;
+   gettimeofday(&start, NULL);
+   pthread_t thread;
+   pthread_create(&thread, NULL, AcceptClients, (void*)params);
+   pthread_join(thread, NULL);
+   while ( __sync_fetch_and_add(&accepted, 0) < startAccepted + count ) usleep(1000);
+   while ( __sync_fetch_and_add(&ended, 0) < startEnded + count ) usleep(1000);
+   gettimeofday(&end, NULL);
+   return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+int HoldOpen(int port, int * socks, int count)
+{
+   struct sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(port);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   long int startAccepted = __sync_fetch_and_add(&accepted, 0);
+   int held = 0;
+   for ( ; held < count; held++ ) {
+      socks[held] = socket(AF_INET, SOCK_STREAM, 0);
+      if ( socks[held] < 0 ) break;
+      if ( connect(socks[held], (struct sockaddr*)&addr, sizeof(addr)) != 0 ) {
+         close(socks[held]);
+         break;
+      }
+   }
+   while ( __sync_fetch_and_add(&accepted, 0) < startAccepted + held ) usleep(1000);
+   return held;
+}
+
+void TestReap(char * argv[])
+{
+   // args : prog reap port idle count
+   int port = atoi(argv[2]);
+   int idle = atoi(argv[3]);
+   int count = atoi(argv[4]);
+   int few = ( idle < 10 ) ? idle : 10;
+   int * socks = new int[idle];
+   
+   TTNetwork * server = new TTNetwork(new MyNotify(), TT_ENGINE_EPOLL);
+   if ( !server->Listen(NULL, port) ) {
+      cout << "Couldn't listen on " << port << endl;
+      exit(0);
+   }
+   
+   cout << "Testing reaping, " << count << " connections." << endl;
+   int held = HoldOpen(port, socks, few);
+   double seconds = ReapRound(port, count);
+   cout << "   " << held << " open" << endl;
+   cout << "      Accepts / sec: " << (long int)(count / seconds) << endl;
+   
+   held += HoldOpen(port, socks + held, idle - held);
+   long int before = PeakKB();
+   seconds = ReapRound(port, count);
+   cout << "   " << held << " open" << endl;
+   cout << "      Accepts / sec: " << (long int)(count / seconds) << endl;
+   cout << "      Peak growth: " << PeakKB() - before << " KB" << endl;
+   cout << "Done Testing reaping." << endl;
+   
+   for ( int i = 0; i < held; i++ ) close(socks[i]);
+   delete [] socks;
+   server->ShutdownNetwork();
+}
+
+void TestEngines(char * argv[])
+{
+   // args : prog engines port megabytes
+   int port = atoi(argv[2]);
+   int megabytes = atoi(argv[3]);
+   mutex = new TTMutex();
+   
+   cout << "Testing engines, " << megabytes << " MB each." << endl;
+   BenchEngine(TT_ENGINE_EPOLL, port, megabytes);
+   BenchEngine(TT_ENGINE_URING, port + 1, megabytes);
+   cout << "Done Testing engines." << endl;
+}
+
+//
+// Echo megabytes of data through a sharded server from a number 
+// of client channels and report the aggregate throughput.
+
+void TestShards(char * argv[])
+{
+   // args : prog shards port shards clients megabytes
+   int port = atoi(argv[2]);
+   int count = atoi(argv[3]);
+   int clients = atoi(argv[4]);
+   int megabytes = atoi(argv[5]);
+   mutex = new TTMutex();
+   
+   EchoNotify * echo = new EchoNotify();
+   TTNetwork * server = new TTNetwork(echo, TT_ENGINE_EPOLL, count);
+   echo->network = server;
+   TTNetwork * client = new TTNetwork(new MyNotify(), TT_ENGINE_EPOLL, count);
+   server->Listen(NULL, port);
+   usleep(100000);
+   
+   long int * channels = new long int[clients];
+   for ( int i = 0; i < clients; i++ ) channels[i] = client->Connect("127.0.0.1", port);
+   
+   unsigned char buffer[TT_MAX_WRITE];
+   memset(buffer, 0, TT_MAX_WRITE);
+   long int target = (long int)megabytes * 1024 * 1024;
+   long int sent = 0;
+   bench_bytes = 0;
+   
+   struct timeval start, end;
+   gettimeofday(&start, NULL);
+   
+   int next = 0;
+   while ( sent < target ) {
+      // keep a few megabytes in flight on each shard.
+      if ( sent - BenchReceived() > 4L * 1024 * 1024 * server->Shards() ) {
+         usleep(100);
+         continue;
+      }
+      client->Send(channels[next], buffer, TT_MAX_WRITE);
+      next = (next + 1) % clients;
+      sent += TT_MAX_WRITE;
+   }
+   while ( BenchReceived() < target ) usleep(1000);
+   
+   gettimeofday(&end, NULL);
+   double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+   
+   cout << "Testing shards." << endl;
+   cout << "   Shards        : " << server->Shards() << endl;
+   cout << "   Clients       : " << clients << endl;
+   cout << "   Bytes         : " << target << endl;
+   cout << "   Seconds       : " << seconds << endl;
+   cout << "   MB / second   : " << (target / (1024.0 * 1024.0)) / seconds << endl;
+   cout << "Done Testing shards." << endl;
+   
+   client->ShutdownNetwork();
+   sleep(1);
+}
+
 int main ( int argc, char * argv[] ) 
 {
    if ( strcmp(argv[1],"server") == 0 ) {
@@ -391,10 +2178,109 @@ int main ( int argc, char * argv[] )
       test_type = TT_TEST_FT;
       SendFile(argv);
    }
+   else if ( strcmp(argv[1], "zerocopy") == 0 ) {
+      test_type = TT_TEST_FT;
+      SendFileZeroCopy(argv);
+   }
+   else if ( strcmp(argv[1], "zcsend") == 0 ) {
+      // args : prog zcsend host port megabytes [copy]
+      test_type = TT_TEST_ZCSEND;
+      ZeroCopySend(argv);
+   }
+   else if ( strcmp(argv[1], "accept") == 0 ) {
+      // args : prog accept port count [shards]
+      test_type = TT_TEST_ACCEPT;
+      TestAccept(argv);
+   }
+   else if ( strcmp(argv[1], "connects") == 0 ) {
+      // args : prog connects port count timeout
+      test_type = TT_TEST_CONNECT;
+      TestConnect(argv);
+   }
+   else if ( strcmp(argv[1], "resolve") == 0 ) {
+      // args : prog resolve port ttl
+      test_type = TT_TEST_RESOLVE;
+      TestResolve(argv);
+   }
+   else if ( strcmp(argv[1], "pool") == 0 ) {
+      // args : prog pool port count
+      test_type = TT_TEST_POOL;
+      TestPool(argv);
+   }
+   else if ( strcmp(argv[1], "udp") == 0 ) {
+      // args : prog udp port count [offload]
+      test_type = TT_TEST_UDP;
+      TestUdp(argv);
+   }
+   else if ( strcmp(argv[1], "sendv") == 0 ) {
+      // args : prog sendv port megabytes
+      test_type = TT_TEST_SENDV;
+      TestSendV(argv);
+   }
+   else if ( strcmp(argv[1], "shape") == 0 ) {
+      // args : prog shape port megabytes rate
+      test_type = TT_TEST_SHAPE;
+      TestShape(argv);
+   }
+   else if ( strcmp(argv[1], "writable") == 0 ) {
+      // args : prog writable port megabytes
+      test_type = TT_TEST_WRITABLE;
+      TestWritable(argv);
+   }
+   else if ( strcmp(argv[1], "readlimit") == 0 ) {
+      // args : prog readlimit port megabytes
+      test_type = TT_TEST_READLIMIT;
+      TestReadLimit(argv);
+   }
+   else if ( strcmp(argv[1], "sockopts") == 0 ) {
+      // args : prog sockopts port count megabytes
+      test_type = TT_TEST_SOCKOPTS;
+      TestSocketOptions(argv);
+   }
+   else if ( strcmp(argv[1], "local") == 0 ) {
+      // args : prog local port path count megabytes
+      test_type = TT_TEST_LOCAL;
+      TestLocal(argv);
+   }
+   else if ( strcmp(argv[1], "framer") == 0 ) {
+      // args : prog framer port count
+      test_type = TT_TEST_FRAMER;
+      TestFramer(argv);
+   }
+   else if ( strcmp(argv[1], "lines") == 0 ) {
+      // args : prog lines port count megabytes
+      test_type = TT_TEST_LINES;
+      TestLines(argv);
+   }
+   else if ( strcmp(argv[1], "broadcast") == 0 ) {
+      // args : prog broadcast port peers megabytes chunk
+      test_type = TT_TEST_BROADCAST;
+      TestBroadcast(argv);
+   }
+   else if ( strcmp(argv[1], "lookup") == 0 ) {
+      // args : prog lookup count
+      test_type = TT_TEST_LOOKUP;
+      TestLookup(argv);
+   }
+   else if ( strcmp(argv[1], "reap") == 0 ) {
+      // args : prog reap port idle count
+      test_type = TT_TEST_REAP;
+      TestReap(argv);
+   }
    else if ( strcmp(argv[1], "echoserver") == 0 ) {
       test_type = TT_TEST_ECHOSERVER;
       TestServer(atoi(argv[2]));
    }
+   else if ( strcmp(argv[1], "engines") == 0 ) {
+      // args : prog engines port megabytes
+      test_type = TT_TEST_ENGINES;
+      TestEngines(argv);
+   }
+   else if ( strcmp(argv[1], "shards") == 0 ) {
+      // args : prog shards port shards clients megabytes
+      test_type = TT_TEST_SHARDS;
+      TestShards(argv);
+   }
 }
 
 
@@ -7,8 +7,60 @@
 // thread context.  Synchronizing is up to the caller, but the socket is 
 // reentrant and synchronized.
 //
-// The socket is implemented with a single worker thread doing the reads, 
-// writes are non-blocking and happen in the caller's context.
+// The socket does not own a thread.  I/O is driven by a TTReactor 
+// event loop which calls HandleEvent() when the socket is readable 
+// or writable.  A readable socket is drained straight into inbuf, 
+// with reads that grow while they come back full and shrink while 
+// they come back mostly empty, and the owner gets one TT_NOTIFY_IN 
+// for the lot.  Send() writes what the socket will take without 
+// blocking and queues the rest in outbuf, which is flushed as the 
+// socket becomes writable.  SendFile() queues part of a file in 
+// the same stream, it is sent with sendfile() without passing 
+// through user space.  SendZeroCopy() queues a caller owned buffer 
+// which, above TT_ZEROCOPY_MIN bytes, is sent with MSG_ZEROCOPY and 
+// handed back with TT_NOTIFY_SEND_DONE once the kernel has finished 
+// with it.  SendShared() queues a TTRefBuffer the same way, holding 
+// a reference instead of notifying, so many sockets can send one 
+// copy of the data.
+//
+// Outbound connects don't block either.  The connect is started on 
+// the reactor's thread and finishes there, when the socket turns 
+// writable or, with a completion reactor, through HandleConnect().  
+// A reactor timer gives up on it once the timeout passes.  A host 
+// name is looked up with the TTResolver given to Connect(), without 
+// one the lookup takes a short lived thread.
+//
+// With a completion reactor (io_uring) the reactor does the I/O: 
+// received data arrives through HandleRecv(), and sends are queued in 
+// outbuf and handed to the reactor one batch at a time, the batch in 
+// flight being held in sendbuf until HandleSendDone().
+//
+// The bytes accepted but not yet written are counted against the 
+// socket's high water mark, see Watermarks().  Over() tells a sender 
+// the socket has more queued than it should, and once the queue has 
+// drained to the low water mark the owner gets TT_NOTIFY_WRITABLE.
+//
+// ReadLimit() caps how much received data may wait in inbuf.  Once 
+// the owner leaves that much unread the socket stops reading, the 
+// kernel's receive window fills and TCP holds the sender back, until 
+// ResumeRead().
+//
+// Shape() limits the rate the socket sends and receives at, Share() 
+// puts it under limits shared with other sockets as well.  Writes 
+// and reads stop when a limit runs out and a reactor timer starts 
+// them again once it has refilled, so a shaped socket is paced 
+// rather than bursty.  A completion reactor's receives are counted 
+// as they arrive and stopped once past the limit.
+//
+// A channel to a shm:/path carries its data through a TTSharedLink, 
+// rings in memory shared with the peer process, instead of the 
+// socket.  The dialing side creates the rings and passes them over 
+// the Unix socket as soon as it connects, after that the socket 
+// only carries the link's doorbells and its close.  Such a socket is 
+// always driven by readiness events, with either engine.
+//
+// Frame() has the socket deliver length prefixed messages, or lines, 
+// one TT_NOTIFY_MESSAGE each, instead of TT_NOTIFY_IN, see TTFramer.
 //
 // The socket is a use-once then throw away model.
 //
@@ -20,6 +72,15 @@
 #include <string.h>
 #include <iostream>
 
+#ifdef WIN32
+#else
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
 #include "ttools/tt_socket.h"
 #include "ttools/tt_async_socket.h"
 #include "ttools/tt_semaphore.h"
@@ -27,28 +88,119 @@
 #include "ttools/tt_functions.h"
 #include "ttools/tt_notify.h"
 #include "ttools/tt_mutex.h"
+#include "ttools/tt_resolver.h"
+#include "ttools/tt_token_bucket.h"
+#include "ttools/tt_shared_link.h"
+#include "ttools/tt_framer.h"
+#include "ttools/tt_ref_buffer.h"
 
 using namespace std;
 
+//
+// A file queued by SendFile() or a buffer queued by SendZeroCopy() 
+// or SendShared().  at is the number of bytes that had been queued 
+// in outbuf before the segment, they go out first.
+
+class TTSendSegment {
+
+public:
+
+   TTSendSegment(long long mark)
+   {
+      fd = -1;
+      buf = NULL;
+      offset = 0;
+      remaining = 0;
+      at = mark;
+      last_seq = 0;
+      notifies = 0;
+      shared = NULL;
+      zerocopy = true;
+      next = NULL;
+   }
+
+   int fd;                       // file to send, or -1
+   const unsigned char * buf;    // buffer to send, or NULL
+   off_t offset;                 // progress through the file or buffer
+   long int remaining;
+   long long at;
+   unsigned int last_seq;        // last MSG_ZEROCOPY send, readiness
+   int notifies;                 // completions still owed, completion
+   TTRefBuffer * shared;         // reference held on buf, or NULL
+   bool zerocopy;                // buf goes out with MSG_ZEROCOPY
+   TTSendSegment * next;
+};
+
 //
 // Create an async socket.  
 //
-//    nt : object to receive network notifications.
-//    id : socket id.  The caller can assign a unique id 
-//         for each socket.  The id number will be referenced 
-//         in all network notifications.
+//    nt  : object to receive network notifications.
+//    id  : socket id.  The caller can assign a unique id 
+//          for each socket.  The id number will be referenced 
+//          in all network notifications.
+//    rct : event loop that will drive the socket once it is 
+//          connected.
 
-TTAsyncSocket::TTAsyncSocket(TTNotify * nt, long int pid)
+TTAsyncSocket::TTAsyncSocket(TTNotify * nt, long int pid, TTReactor * rct)
 {
    notify = nt;
    inbuf = new TTBuffer();
    outbuf = new TTBuffer();
+   sendbuf = new TTBuffer();
+   sending = false;
+   attached = false;
+   closing = false;
+   segments = NULL;
+   segments_tail = NULL;
+   waiting = NULL;
+   waiting_tail = NULL;
+   done = NULL;
+   done_tail = NULL;
+   zc_tried = false;
+   zc_enabled = false;
+   zc_seq = 0;
+   inflight = NULL;
+   file_inflight = NULL;
+   queued = 0;
+   high_water = TT_HIGH_WATER;
+   low_water = TT_LOW_WATER;
+   above = false;
+   out_added = 0;
+   out_written = 0;
    sock = NULL;
+   link = NULL;
+   shared = false;
+   completion = rct->Completion();
+   options = NULL;
    port = 0;
+   timeout = TT_CONNECT_TIMEOUT;
+   remote_ip = 0;
+   remote = NULL;
+   deadline = 0;
+   kick = 0;
+   linger = 0;
+   resolving = false;
+   resolver = NULL;
+   lookup = 0;
+   dialing = false;
+   read_size = TT_READ_MIN;
+   in_limit = 0;
+   paused = false;
+   framer = NULL;
+   delivering = false;
+   pooled = false;
+   send_limit = new TTTokenBucket();
+   recv_limit = new TTTokenBucket();
+   shared_send = NULL;
+   shared_recv = NULL;
+   send_pace = 0;
+   recv_pace = 0;
+   send_granted = 0;
    host = NULL;
    status = TTAS_STATUS_READY;
    id = pid;
    mutex = new TTMutex();
+   reactor = rct;
 }
 
 TTAsyncSocket::~TTAsyncSocket()
@@ -57,10 +209,21 @@ TTAsyncSocket::~TTAsyncSocket()
    cout << "TTAsyncSocket::~TTAsyncSocket" << endl;
 #endif
    Stop();
+   Release(segments);
+   Release(waiting);
+   Release(done);
    delete [] host;
+   delete remote;
+   delete link;
    delete sock;
+   delete options;
+   delete framer;
    delete inbuf;
    delete outbuf;
+   delete sendbuf;
+   delete send_limit;
+   delete recv_limit;
+   delete mutex;
 }
 
 //
@@ -68,8 +231,8 @@ TTAsyncSocket::~TTAsyncSocket()
 
 #ifdef WIN32
 #else
-void * TTSocketReadThread( void * parm ) {
-    ((TTAsyncSocket*)parm)->ReadThread();
+void * TTSocketConnectThread( void * parm ) {
+    ((TTAsyncSocket*)parm)->ConnectThread();
     return 0;
 }
 #endif
@@ -77,8 +240,9 @@ void * TTSocketReadThread( void * parm ) {
 //
 // Start
 //
-// Start the threaded socket using an already-connected 
-// TTSocket.
+// Start the socket using an already-connected TTSocket.  The 
+// socket is handed straight to the reactor, no thread is 
+// created.
 
 bool TTAsyncSocket::Connect(TTSocket * tsock)
 {
@@ -91,26 +255,31 @@ bool TTAsyncSocket::Connect(TTSocket * tsock)
    }
    else {
       status = TTAS_STATUS_CONNECTING;
+      sock = tsock;
+      if ( sock->Shared() ) ShareMemory();
       mutex->Unlock();
       TT_Debug("TTAsyncSocket::Start - called with existing socket");
-      sock = tsock;
-#ifdef WIN32  
-#else
-      pthread_create (&read_thread_id, NULL, TTSocketReadThread, (void*)this);
-#endif
-      return true;
+      notify->Notify(id, TT_NOTIFY_BEGIN, NULL);
+      return Attach();
    }
 }
 
 //
 // Start
 //
-// Start the socket, connect to phost/pport.  This call 
-// initiates a thread, and a handler needs to be setup 
-// prior to calling this.
+// Start the socket, connect to phost/pport.  Returns straight 
+// away, the connect is made from the reactor's thread and gives up 
+// after tmout milliseconds.  An address in dotted quad form goes 
+// straight to the reactor, as does a unix:/path one for a peer on 
+// the same machine, a host name is looked up first, by rsv 
+// when given or else on a detached thread.  opts, when given, tune 
+// the socket before it connects.  A handler needs to be setup prior 
+// to calling this.
 
-bool TTAsyncSocket::Connect(char * phost, int pport)
+bool TTAsyncSocket::Connect(char * phost, int pport, int tmout, TTResolver * rsv, const TTSocketOptions * opts)
 {
+   if ( opts ) SetOptions(opts);
+
    // we're doing a test and set on the status here, lock it 
    // with the mutex.
    mutex->Lock();
@@ -118,25 +287,59 @@ bool TTAsyncSocket::Connect(char * phost, int pport)
       mutex->Unlock();
       return false;
    }
+   status = TTAS_STATUS_CONNECTING;
+   TT_Debug("TTAsyncSocket::Start - called");
+   host = new char[strlen(phost)+1];
+   strcpy(host,phost);
+   if ( TTSocket::SharedAddress(host) ) ShareMemory();
+   port = pport;
+   timeout = tmout;
+   resolver = rsv;
+   mutex->Unlock();
+   
+   // notify our owner that we are connecting now.
+   notify->Notify(id, TT_NOTIFY_BEGIN, NULL);
+   
+   mutex->Lock();
+   deadline = reactor->Schedule(this, timeout);
+   if ( TTSocket::LocalPath(host) ) {
+      kick = reactor->Schedule(this, 0);
+   }
+   else if ( inet_addr(host) != INADDR_NONE ) {
+      remote_ip = ntohl(inet_addr(host));
+      kick = reactor->Schedule(this, 0);
+   }
+   else if ( resolver ) {
+      // the answer may already be known, else HandleResolved() 
+      // gets it.  It can't arrive before we let go of the mutex.
+      unsigned long ip;
+      lookup = resolver->Resolve(host, this, &ip);
+      if ( lookup == 0 ) {
+         remote_ip = ip;
+         kick = reactor->Schedule(this, 0);
+      }
+      else resolving = true;
+   }
    else {
-      status = TTAS_STATUS_CONNECTING;
-      mutex->Unlock();
-      TT_Debug("TTAsyncSocket::Start - called");
-      host = new char[strlen(phost)+1];
-      strcpy(host,phost);
-      port = pport;
+      resolving = true;
 #ifdef WIN32  
 #else
-      pthread_create (&read_thread_id, NULL, TTSocketReadThread, (void*)this);
+      pthread_t connect_thread_id;
+      pthread_attr_t attr;
+      pthread_attr_init(&attr);
+      pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+      pthread_create (&connect_thread_id, &attr, TTSocketConnectThread, (void*)this);
+      pthread_attr_destroy(&attr);
 #endif
-      return true;
    }
+   mutex->Unlock();
+   return true;
 }
 
 //
 // Gracefully disconnect the socket. This call is asynchronous, 
 // a notification will be sent when the socket is finished 
-// disconnecting.  Returns true if 
+// disconnecting.  Returns true if the socket was open.
 
 bool TTAsyncSocket::Disconnect()
 {
@@ -147,47 +350,102 @@ bool TTAsyncSocket::Disconnect()
       return false;
    }
    else {
+      // shutting the socket down wakes the reactor, which sees 
+      // the new status and finishes the close in its own thread.  
+      // If writes are still queued the shutdown waits until they 
+      // have gone out.
       status = TTAS_STATUS_STOPPED;
+      if ( sock && !(attached && Pending()) ) sock->Shutdown();
       mutex->Unlock();
       return true;
    }
 }
 
 //
-// Stop the socket thread and wait for it to finish. 
+// Release the descriptor.  Only called from the destructor, by 
+// which time the socket is closed or the reactor is stopped.
 
 void TTAsyncSocket::Stop()
 {
-   if ( Disconnect() ) pthread_join(read_thread_id, NULL);
+   mutex->Lock();
+   if ( sock ) sock->Disconnect();
+   mutex->Unlock();
 }
 
 //
-// Send data on the socket.  Mutexed.
+// Send data on the socket.  Mutexed.  Never blocks, whatever the 
+// socket won't take straight away is queued in outbuf and written 
+// as the socket drains.
 
 bool TTAsyncSocket::Send(unsigned char * buf, int len)
 {
+   struct iovec iov;
+   iov.iov_base = buf;
+   iov.iov_len = len;
+   return SendV(&iov, 1);
+}
+
+//
+// SendV
+//
+// Send a list of buffers as though they were one, without gluing 
+// them together first.  With nothing queued ahead they go out in a 
+// single gathering write, only what the socket won't take is 
+// copied into outbuf.
+
+bool TTAsyncSocket::SendV(const struct iovec * iov, int count)
+{
+   long int len = 0;
+   for ( int i = 0; i < count; i++ ) len += iov[i].iov_len;
+   
    mutex->Lock();   
    if ( status < 2 ) {
       // if we're not connected yet, we allow the data to be pipelined 
       // for a later send.  There is no guarantee that it will be sent, 
       // but a copy of the queued buffer will be sent on a failure notification 
       // so the caller can retrieve the data if they wish.
-      outbuf->Add(buf,len);
+      for ( int i = 0; i < count; i++ ) outbuf->Add((unsigned char*)iov[i].iov_base, iov[i].iov_len);
+      out_added += len;
+      Backlog(len);
       mutex->Unlock();
       return true;
    }
    else if ( status == 2 ) {
-      // call send directly.
-      int retVal = sock->Send(buf, len);
-      if ( retVal < 0 ) {
-         mutex->Unlock();
-         Disconnect();
-         return false;
+      int retVal = 0;
+      if ( !completion && !Pending() ) {
+         // nothing queued ahead of us, write directly and only 
+         // queue what's left over.  A shaped socket only does so 
+         // while its limits allow the lot.
+         long int grant = Allowance(send_limit, shared_send, len);
+         if ( grant == len ) {
+            retVal = ( count == 1 ) ? Write((unsigned char*)iov[0].iov_base, iov[0].iov_len) 
+                                    : WriteV(iov, count);
+         }
+         if ( retVal < grant ) Refund(send_limit, shared_send, grant - (retVal > 0 ? retVal : 0));
       }
-      else {
-         mutex->Unlock();
-         return true;
+      if ( retVal >= 0 ) {
+         long int skip = retVal;
+         for ( int i = 0; i < count; i++ ) {
+            if ( skip >= (long int)iov[i].iov_len ) {
+               skip -= iov[i].iov_len;
+               continue;
+            }
+            outbuf->Add((unsigned char*)iov[i].iov_base + skip, iov[i].iov_len - skip);
+            skip = 0;
+         }
+         out_added += len;
+         out_written += retVal;
+         Backlog(len - retVal);
+         if ( Flush() ) {
+            mutex->Unlock();
+            NotifyDone();
+            return true;
+         }
       }
+      mutex->Unlock();
+      NotifyDone();
+      Disconnect();
+      return false;
    }
    else {
       mutex->Unlock();
@@ -195,66 +453,1393 @@ bool TTAsyncSocket::Send(unsigned char * buf, int len)
    }
 }  
 
-void TTAsyncSocket::ReadThread()
+//
+// Pending
+//
+// Returns true while there is data waiting to be written, or zero 
+// copy buffers the kernel hasn't given back.  The mutex must be 
+// held.
+
+bool TTAsyncSocket::Pending()
 {
-   // notify our owner that we are connecting now.
-   notify->Notify(id, TT_NOTIFY_BEGIN, NULL);
+   return sending || segments || waiting || outbuf->Size() > 0 || sendbuf->Size() > 0;
+}
+
+//
+// SendFile
+//
+// Queue length bytes of the open file fd, starting at offset, to 
+// go out after whatever was sent before it.  A length of zero or 
+// less sends to the end of the file.  The descriptor must stay 
+// open until TT_NOTIFY_FILE_DONE is sent for it, which happens 
+// once the file has been handed to the kernel or, if the socket 
+// closes first, when it ends.
+
+bool TTAsyncSocket::SendFile(int fd, long int offset, long int length)
+{
+   if ( length <= 0 ) {
+      struct stat st;
+      if ( fstat(fd, &st) < 0 ) return false;
+      length = st.st_size - offset;
+   }
    
-   // connect the socket, if we fail, notify the user and 
-   // quit.
-   if ( sock == NULL ) {
-      // connect the socket.
-      sock = new TTSocket();
-      if ( sock->Connect(host,port,10) ) {
-         TT_Debug("TTAsyncSocket::ReadThread Connect worked");
+   mutex->Lock();
+   if ( status > TTAS_STATUS_CONNECTED ) {
+      mutex->Unlock();
+      return false;
+   }
+   TTSendSegment * file = new TTSendSegment(out_added);
+   file->fd = fd;
+   file->offset = offset;
+   file->remaining = length;
+   return Queue(file);
+}
+
+//
+// SendZeroCopy
+//
+// Queue a buffer to be sent without copying it.  The buffer must 
+// stay untouched until TT_NOTIFY_SEND_DONE arrives with it as data, 
+// that is when the kernel no longer needs it or, if the socket 
+// closes first, when it ends.  Buffers smaller than TT_ZEROCOPY_MIN 
+// are cheaper to copy, they are sent like Send() and the 
+// notification follows straight away.  Returns false, without a 
+// notification, if the socket isn't taking data.
+
+bool TTAsyncSocket::SendZeroCopy(unsigned char * buf, int len)
+{
+   mutex->Lock();
+   if ( status > TTAS_STATUS_CONNECTED ) {
+      mutex->Unlock();
+      return false;
+   }
+   TTSendSegment * segment = new TTSendSegment(out_added);
+   segment->buf = buf;
+   segment->remaining = len;
+   if ( len < TT_ZEROCOPY_MIN ) {
+      mutex->Unlock();
+      if ( !Send(buf, len) ) {
+         delete segment;
+         return false;
       }
-      else {
-         TT_Debug("TTAsyncSocket::ReadThread Connect Failed");
-         status = TTAS_STATUS_CLOSED;
-         notify->Notify(id, TT_NOTIFY_END, NULL);
-         return;
+      mutex->Lock();
+      segment->remaining = 0;
+   }
+   return Queue(segment);
+}
+
+//
+// SendShared
+//
+// Queue a shared buffer to be sent without copying it.  The socket 
+// holds a reference until it has finished with the buffer, which 
+// must not change meanwhile.  Buffers of TT_ZEROCOPY_MIN bytes and 
+// more go out with MSG_ZEROCOPY, smaller ones are written straight 
+// from the buffer.  Returns false, holding no reference, if the 
+// socket isn't taking data.
+
+bool TTAsyncSocket::SendShared(TTRefBuffer * buffer)
+{
+   mutex->Lock();
+   if ( status > TTAS_STATUS_CONNECTED ) {
+      mutex->Unlock();
+      return false;
+   }
+   buffer->Hold();
+   TTSendSegment * segment = new TTSendSegment(out_added);
+   segment->buf = buffer->Data();
+   segment->remaining = buffer->Length();
+   segment->shared = buffer;
+   segment->zerocopy = ( buffer->Length() >= TT_ZEROCOPY_MIN );
+   return Queue(segment);
+}
+
+//
+// Shape
+//
+// Limit the socket to sendRate bytes a second out and recvRate in, 
+// zero lifting a limit.  The kernel is asked to pace the sends at 
+// the same rate where it can, so they leave evenly rather than in 
+// bursts as the limit refills.
+
+void TTAsyncSocket::Shape(long int sendRate, long int recvRate)
+{
+   mutex->Lock();
+   send_limit->Set(sendRate);
+   recv_limit->Set(recvRate);
+   if ( sock && status == TTAS_STATUS_CONNECTED ) sock->SetPacingRate(sendRate);
+   mutex->Unlock();
+}
+
+//
+// Share
+//
+// Put the socket under limits shared with other sockets, on top of 
+// its own.  Either may be NULL.  Must be called before the socket 
+// is connected.
+
+void TTAsyncSocket::Share(TTTokenBucket * sendLimit, TTTokenBucket * recvLimit)
+{
+   shared_send = sendLimit;
+   shared_recv = recvLimit;
+}
+
+//
+// Watermarks
+//
+// Set the send queue's high and low water marks in bytes.  A low 
+// mark above the high one is taken as the high one.
+
+void TTAsyncSocket::Watermarks(long int high, long int low)
+{
+   if ( low > high ) low = high;
+   mutex->Lock();
+   high_water = high;
+   low_water = low;
+   mutex->Unlock();
+}
+
+//
+// Backlog
+//
+// Count bytes on to, or with a negative count off, the send queue.  
+// Data posted from another thread for the loop is counted as soon 
+// as it is posted, so this doesn't take the mutex.
+
+void TTAsyncSocket::Backlog(long int bytes)
+{
+   __sync_fetch_and_add(&queued, bytes);
+}
+
+//
+// Over
+//
+// Returns true if the send queue is over the high water mark, in 
+// which case TT_NOTIFY_WRITABLE will follow once it has drained to 
+// the low one.
+
+bool TTAsyncSocket::Over()
+{
+   if ( queued <= high_water ) return false;
+   above = true;
+   return true;
+}
+
+//
+// Alive
+//
+// Check that an idle connection is still good, from any thread: 
+// connected, with no error, close or stray data waiting on the 
+// socket.  A shared memory channel's socket carries doorbells, so 
+// only its state counts.
+
+bool TTAsyncSocket::Alive()
+{
+   mutex->Lock();
+   bool alive = ( status == TTAS_STATUS_CONNECTED && !closing && sock && (link || sock->Alive()) );
+   mutex->Unlock();
+   return alive;
+}
+
+//
+// SetOptions
+//
+// Tune the socket, straight away if it exists or else as soon as it 
+// is created, before it connects.
+
+void TTAsyncSocket::SetOptions(const TTSocketOptions * opts)
+{
+   mutex->Lock();
+   if ( !options ) options = new TTSocketOptions();
+   *options = *opts;
+   if ( sock && sock->Handle() >= 0 ) sock->SetOptions(options);
+   mutex->Unlock();
+}
+
+//
+// ReadLimit
+//
+// Stop reading while bytes or more received data are waiting in 
+// inbuf, zero for no limit.  From the reactor's thread.
+
+void TTAsyncSocket::ReadLimit(long int bytes)
+{
+   in_limit = bytes;
+   if ( paused && !Full() ) ResumeRead();
+}
+
+//
+// Full
+//
+// Returns true once the owner has left as much unread as the read 
+// limit allows.  A framed socket doesn't count a message it hasn't 
+// got all of, it could never be delivered otherwise.
+
+bool TTAsyncSocket::Full()
+{
+   if ( in_limit <= 0 || inbuf->Size() < in_limit ) return false;
+   return !framer || inbuf->Size() >= framer->Need();
+}
+
+//
+// Frame
+//
+// Deliver what arrives as length prefixed messages, or lines, of 
+// the given TT_FRAME_* format, up to max bytes each, rather than as 
+// a stream.  TT_FRAME_NONE goes back to the stream.  From the 
+// reactor's thread, or before the socket is connected.
+
+void TTAsyncSocket::Frame(int format, long int max)
+{
+   delete framer;
+   framer = NULL;
+   if ( format != TT_FRAME_NONE ) framer = new TTFramer(format, max);
+   if ( status == TTAS_STATUS_CONNECTED && inbuf->Size() > 0 && !NotifyIn() ) Close();
+}
+
+//
+// NotifyIn
+//
+// Show the owner what has been received, all of it with 
+// TT_NOTIFY_IN, or each complete message with TT_NOTIFY_MESSAGE.  
+// Returns false if the messages are broken, the socket should then 
+// be closed.  From the reactor's thread.
+
+bool TTAsyncSocket::NotifyIn()
+{
+   if ( !framer ) {
+      notify->Notify(id, TT_NOTIFY_IN, inbuf);
+      return true;
+   }
+   
+   // the owner may make us read again from a message, which comes 
+   // back here with the message still in inbuf.  Leave what that 
+   // read to the loop already running.
+   if ( delivering ) return true;
+   delivering = true;
+   TTMessage message;
+   long int offset;
+   long int taken;
+   bool ok = true;
+   while ( !closing && framer ) {
+      taken = framer->Next(inbuf->Buffer(), inbuf->Size(), &offset, &message.length);
+      if ( taken == 0 ) break;
+      if ( taken < 0 ) {
+         TT_Debug("TTAsyncSocket::NotifyIn() broken message framing");
+         ok = false;
+         break;
       }
+      message.data = inbuf->Buffer() + offset;
+      notify->Notify(id, TT_NOTIFY_MESSAGE, &message);
+      inbuf->Pop(taken);
+   }
+   delivering = false;
+   return ok;
+}
+
+//
+// ResumeRead
+//
+// Start reading again after the read limit stopped it.  The owner 
+// is shown what is waiting first, whether or not reading had 
+// stopped, since it may be ready for more now, and reading only 
+// stops again if it doesn't make room.  From the reactor's thread.
+
+void TTAsyncSocket::ResumeRead()
+{
+   if ( closing ) return;
+   bool wasPaused = paused;
+   paused = false;
+   if ( inbuf->Size() > 0 && !NotifyIn() ) {
+      Close();
+      return;
    }
+   if ( !wasPaused ) return;
+   if ( !completion ) Drain();
+   else if ( Full() ) paused = true;
+   else if ( !closing && !recv_pace ) reactor->Recv(sock->Handle(), this);
+}
+
+//
+// Queue
+//
+// Add a segment to the send queue and start it moving.  Called 
+// with the mutex held, which is released.
+
+bool TTAsyncSocket::Queue(TTSendSegment * segment)
+{
+   if ( segment->remaining <= 0 ) Append(&done, &done_tail, segment);
    else {
-      // TODO: Test sock
+      Append(&segments, &segments_tail, segment);
+      Backlog(segment->remaining);
    }
    
-   // if there's waiting data in the out buffer, send it now.
+   bool ok = ( status < TTAS_STATUS_CONNECTED || Flush() );
+   mutex->Unlock();
+   NotifyDone();
+   if ( !ok ) Disconnect();
+   return true;
+}
+
+//
+// ConnectThread
+//
+// Body of the short lived lookup thread.  Resolves the host name 
+// and hands the address back to the reactor's thread to connect.  
+// The socket isn't closed while the lookup is running, so it is 
+// safe to use until resolving is cleared.
+
+void TTAsyncSocket::ConnectThread()
+{
+   unsigned long ip = TTSocket::GetHostIP(host);
+   
    mutex->Lock();
-   if ( outbuf->Size() > 0 ) {
-      if ( sock->Send((const unsigned char*)outbuf->Buffer(), outbuf->Size()) < 0 ) {
-         TT_Debug("TTAsyncSocket::ReadThread() Pre-send failed.");
-         status = TTAS_STATUS_CLOSED;
-         mutex->Unlock();
-         notify->Notify(id, TT_NOTIFY_END, NULL);
-         return;
+   remote_ip = ip;
+   resolving = false;
+   kick = reactor->Schedule(this, 0);
+   mutex->Unlock();
+}
+
+//
+// HandleResolved
+//
+// The resolver has the host's address, hand it to the reactor's 
+// thread to connect.  Called with the resolver locked.
+
+void TTAsyncSocket::HandleResolved(long int request, unsigned long ip)
+{
+   mutex->Lock();
+   if ( request == lookup ) {
+      lookup = 0;
+      remote_ip = ip;
+      resolving = false;
+      kick = reactor->Schedule(this, 0);
+   }
+   mutex->Unlock();
+}
+
+//
+// HandleTimer
+//
+// Either the kick that starts the connect on the reactor's thread, 
+// the connect's deadline, or a shaped socket's limit having 
+// refilled enough to carry on sending or receiving.
+
+void TTAsyncSocket::HandleTimer(long int timer)
+{
+   mutex->Lock();
+   if ( timer == linger ) {
+      mutex->Unlock();
+      Linger(true);
+      return;
+   }
+   if ( timer == send_pace ) {
+      send_pace = 0;
+      bool ok = true;
+      if ( !closing && attached && (status == TTAS_STATUS_CONNECTED || status == TTAS_STATUS_STOPPED) ) {
+         ok = Flush();
+         if ( ok && status == TTAS_STATUS_STOPPED && !Pending() ) sock->Shutdown();
       }
+      mutex->Unlock();
+      NotifyDone();
+      if ( !ok ) Close();
+      return;
    }
-   status = TTAS_STATUS_CONNECTED;
+   if ( timer == recv_pace ) {
+      recv_pace = 0;
+      bool go = !closing && attached;
+      mutex->Unlock();
+      if ( !go ) return;
+      if ( !completion ) Drain();
+      else if ( !paused ) reactor->Recv(sock->Handle(), this);
+      return;
+   }
+   if ( timer == kick ) {
+      kick = 0;
+      bool go = ( status == TTAS_STATUS_CONNECTING );
+      mutex->Unlock();
+      if ( go ) Dial();
+      else Close();
+      return;
+   }
+   if ( timer != deadline ) {
+      mutex->Unlock();
+      return;
+   }
+   deadline = 0;
+   if ( status != TTAS_STATUS_CONNECTING ) {
+      mutex->Unlock();
+      return;
+   }
+   TT_Debug("TTAsyncSocket::HandleTimer() connect timed out");
+   status = TTAS_STATUS_STOPPED;
+   bool wait = resolving && !resolver;
    mutex->Unlock();
-   notify->Notify(id,TT_NOTIFY_CONNECTED, NULL);
-   unsigned char * buffer = new unsigned char[TT_MAX_WRITE];
    
-         
-   // go into read loop.
-   int retVal = 0;
-   while ( status == TTAS_STATUS_CONNECTED ) {
-      retVal = sock->Recv(buffer, TT_MAX_WRITE, 10);
-      if ( retVal < 0 ) {
-         TT_Debug("TTAsyncSocket::ReadThread() Fail on RECV");
-         break;
-      }
-      else if ( retVal > 0 ) {
-         // add to our buffer and notify the owner.
-         inbuf->Add(buffer, retVal);
-         notify->Notify(id,TT_NOTIFY_IN, inbuf);
+   // a lookup thread still running closes the socket when it gets 
+   // back, a resolver lookup is cancelled by Finish().
+   if ( !wait ) Close();
+}
+
+//
+// Dial
+//
+// Start the connect, from the reactor's thread.  A readiness 
+// reactor watches for the socket to turn writable, a completion 
+// reactor makes the connect itself.
+
+void TTAsyncSocket::Dial()
+{
+   bool local = ( TTSocket::LocalPath(host) != NULL );
+   if ( !local && remote_ip == 0 ) {
+      TT_Debug("TTAsyncSocket::Dial() could not resolve the host");
+      Close();
+      return;
+   }
+   
+   mutex->Lock();
+   remote = new struct sockaddr_storage;
+   int remoteLen;
+   if ( local ) remoteLen = TTSocket::LocalAddress(host, (struct sockaddr_un*)remote);
+   else {
+      struct sockaddr_in * addr = (struct sockaddr_in*)remote;
+      memset(addr, 0, sizeof(*addr));
+      addr->sin_family = AF_INET;
+      addr->sin_port = htons(port);
+      addr->sin_addr.s_addr = htonl(remote_ip);
+      remoteLen = sizeof(*addr);
+   }
+   if ( remoteLen < 0 ) {
+      mutex->Unlock();
+      TT_Debug("TTAsyncSocket::Dial() bad unix socket path");
+      Close();
+      return;
+   }
+   sock = new TTSocket();
+   if ( options && sock->Open(local) >= 0 ) sock->SetOptions(options);
+   
+   int retVal;
+   if ( reactor->Completion() ) {
+      retVal = -1;
+      if ( sock->Open(local) >= 0 ) {
+         attached = reactor->Connect(sock->Handle(), (struct sockaddr*)remote, remoteLen, this);
+         if ( attached ) retVal = 0;
       }
-      else if ( retVal == 0 ) {
-         // 0 from TTSocket means a timeout occured, 
-         // so we do nothing here
+   }
+   else {
+      retVal = sock->ConnectStart((struct sockaddr*)remote, remoteLen);
+      if ( retVal == 0 ) {
+         dialing = true;
+         attached = reactor->Add(sock->Handle(), this);
+         if ( !attached ) retVal = -1;
       }
    }
-   delete [] buffer;
-   status = TTAS_STATUS_CLOSED;
-   notify->Notify(id, TT_NOTIFY_END, NULL);
+   mutex->Unlock();
+   
+   if ( retVal < 0 ) {
+      TT_Debug("TTAsyncSocket::Dial() Connect Failed");
+      Close();
+   }
+   else if ( retVal > 0 ) Connected();
+}
+
+//
+// HandleConnect
+//
+// A completion reactor has finished the connect.
+
+void TTAsyncSocket::HandleConnect(int result)
+{
+   if ( result < 0 ) {
+      TT_Debug("TTAsyncSocket::HandleConnect() Connect Failed");
+      Close();
+   }
+   else Connected();
+}
+
+//
+// Connected
+//
+// The connect worked, drop the deadline and get going.
+
+void TTAsyncSocket::Connected()
+{
+   TT_Debug("TTAsyncSocket::Connected() Connect worked");
+   mutex->Lock();
+   reactor->Cancel(deadline);
+   deadline = 0;
+   mutex->Unlock();
+   Attach();
+}
+
+//
+// Attach
+//
+// Register the connected socket with the reactor and start on 
+// anything queued while connecting.  The socket must not be 
+// touched by the calling thread after this returns true, the 
+// reactor may close it at any time.
+
+bool TTAsyncSocket::Attach()
+{
+   mutex->Lock();
+   if ( status != TTAS_STATUS_CONNECTING ) {
+      // disconnected before we got going.
+      mutex->Unlock();
+      Close();
+      return false;
+   }
+   if ( shared && !sock->Shared() && !Offer() ) {
+      mutex->Unlock();
+      TT_Debug("TTAsyncSocket::Attach() could not set up shared memory.");
+      Close();
+      return false;
+   }
+   status = TTAS_STATUS_CONNECTED;
+   if ( send_limit->Limited() ) sock->SetPacingRate(send_limit->Rate());
+   mutex->Unlock();
+   notify->Notify(id,TT_NOTIFY_CONNECTED, NULL);
+
+   // the mutex keeps the reactor's callbacks out until the queue 
+   // has been started.  A readiness reactor reports the new socket 
+   // as writable straight away, so its queue is left for that.
+   mutex->Lock();
+   bool added;
+   bool ok;
+   if ( completion ) {
+      added = reactor->Recv(sock->Handle(), this);
+      ok = added && Flush();
+   }
+   else if ( attached && !reactor->Completion() ) {
+      // registered while connecting, the writable event has been 
+      // and gone.
+      added = true;
+      ok = Flush();
+   }
+   else {
+      sock->SetNonBlocking();
+      added = reactor->Add(sock->Handle(), this);
+      ok = added;
+   }
+   attached = added;
+   mutex->Unlock();
+   NotifyDone();
+   
+   if ( !added ) {
+      TT_Debug("TTAsyncSocket::Attach() reactor refused the socket.");
+      Close();
+      return false;
+   }
+   if ( !ok ) Disconnect();
+   return true;
+}
+
+//
+// Flush
+//
+// Move queued data towards the wire.  The mutex must be held.  
+// Returns false if the socket failed.
+//
+// Segments queued by SendFile() and SendZeroCopy() are kept in 
+// order with the data in outbuf, each one records how much had been 
+// queued before it.  Segments the kernel is finished with move to 
+// the done list, NotifyDone() reports them once the mutex has been 
+// released.
+//
+// With a readiness reactor, write from outbuf and the segments until 
+// everything is out or the socket is full, the next writable event 
+// picks up from there.  Files go out with sendfile(), straight from 
+// the page cache.  Buffers go out with MSG_ZEROCOPY and wait on the 
+// waiting list until the kernel reports them finished on the 
+// socket's error queue, see Reap().
+//
+// With a completion reactor, if nothing is in flight, move the 
+// queued data into sendbuf and hand it to the reactor.  Files are 
+// read into sendbuf a chunk at a time by the reactor too, see 
+// HandleFileRead().  Buffers are handed to the reactor as they are 
+// for a zero copy send, and so are shared buffers too small for 
+// one, they can't change while the socket holds them.  Only a 
+// caller's buffer too small for zero copy is copied into sendbuf.
+
+bool TTAsyncSocket::Flush()
+{
+   int retVal;
+   long int ahead;
+   long int grant;
+   TTSendSegment * segment;
+
+   // shaped and out of allowance, the timer will be along.  A 
+   // shared socket waits for its link.
+   if ( send_pace ) return true;
+   if ( shared && !link ) return true;
+
+   if ( !completion ) {
+      while ( true ) {
+         ahead = Ahead();
+         segment = segments;
+         if ( ahead == 0 && !segment ) return true;
+         grant = Allowance(send_limit, shared_send, ( ahead > 0 ) ? ahead : segment->remaining);
+         if ( grant == 0 ) {
+            Pace(( ahead > 0 ) ? ahead : segment->remaining);
+            return true;
+         }
+         if ( ahead > 0 ) {
+            retVal = Write(outbuf->Buffer(), grant);
+            if ( retVal < grant ) Refund(send_limit, shared_send, grant - (retVal > 0 ? retVal : 0));
+            if ( retVal < 0 ) return false;
+            if ( retVal == 0 ) return true;
+            outbuf->Pop(retVal);
+            out_written += retVal;
+            Backlog(-retVal);
+            continue;
+         }
+         else if ( segment->buf ) {
+            if ( !zc_tried && segment->zerocopy ) {
+               zc_enabled = sock->EnableZeroCopy();
+               zc_tried = true;
+            }
+            if ( zc_enabled && segment->zerocopy ) retVal = sock->WriteZeroCopy(segment->buf + segment->offset, grant);
+            else retVal = Write(segment->buf + segment->offset, grant);
+            if ( retVal > 0 && zc_enabled && segment->zerocopy ) segment->last_seq = zc_seq++;
+            if ( retVal > 0 ) segment->offset += retVal;
+         }
+         else {
+            retVal = WriteFile(segment->fd, &segment->offset, grant);
+         }
+         if ( retVal < grant ) Refund(send_limit, shared_send, grant - (retVal > 0 ? retVal : 0));
+         if ( retVal < 0 ) return false;
+         if ( retVal == 0 ) return true;
+         segment->remaining -= retVal;
+         Backlog(-retVal);
+         if ( segment->remaining == 0 ) {
+            segment = Pop(&segments, &segments_tail);
+            if ( segment->buf && zc_enabled && segment->zerocopy ) Append(&waiting, &waiting_tail, segment);
+            else Append(&done, &done_tail, segment);
+         }
+      }
+   }
+
+   if ( sending ) return true;
+   if ( sendbuf->Size() == 0 ) {
+      ahead = Ahead();
+      segment = segments;
+      if ( ahead == 0 && segment && segment->buf ) {
+         grant = Allowance(send_limit, shared_send, segment->remaining);
+         if ( grant == 0 ) {
+            Pace(segment->remaining);
+            return true;
+         }
+         sending = segment->zerocopy && reactor->SendZeroCopy(sock->Handle(), segment->buf + segment->offset, grant, this);
+         if ( sending ) segment->notifies++;
+         else if ( segment->shared ) sending = reactor->Send(sock->Handle(), segment->buf + segment->offset, grant, this);
+         if ( sending ) {
+            inflight = segment;
+            send_granted = grant;
+            return true;
+         }
+         Refund(send_limit, shared_send, grant);
+         // no zero copy here, or too small to be worth it, fall 
+         // back to copying it.
+         sendbuf->Add(segment->buf + segment->offset, segment->remaining);
+         Append(&done, &done_tail, Pop(&segments, &segments_tail));
+      }
+      else if ( ahead == 0 && segment ) {
+         int chunk = TT_FILE_CHUNK;
+         if ( segment->remaining < chunk ) chunk = (int)segment->remaining;
+         unsigned char * space = sendbuf->Reserve(chunk);
+         if ( !space ) return false;
+         sending = reactor->ReadFile(sock->Handle(), segment->fd, space, chunk, segment->offset, this);
+         if ( sending ) {
+            file_inflight = segment;
+            return true;
+         }
+         // a reactor that can't read files for us, read it here.
+         retVal = pread(segment->fd, space, chunk, segment->offset);
+         if ( retVal <= 0 ) return false;
+         sendbuf->Commit(retVal);
+         segment->offset += retVal;
+         segment->remaining -= retVal;
+         if ( segment->remaining == 0 ) Append(&done, &done_tail, Pop(&segments, &segments_tail));
+      }
+      else if ( ahead == 0 ) return true;
+      else if ( ahead == outbuf->Size() ) {
+         TTBuffer * temp = sendbuf;
+         sendbuf = outbuf;
+         outbuf = temp;
+         out_written += ahead;
+      }
+      else {
+         sendbuf->Add(outbuf->Buffer(), ahead);
+         outbuf->Pop(ahead);
+         out_written += ahead;
+      }
+   }
+   grant = Allowance(send_limit, shared_send, sendbuf->Size());
+   if ( grant == 0 ) {
+      Pace(sendbuf->Size());
+      return true;
+   }
+   sending = reactor->Send(sock->Handle(), sendbuf->Buffer(), grant, this);
+   if ( sending ) send_granted = grant;
+   else Refund(send_limit, shared_send, grant);
+   return true;
+}
+
+//
+// Allowance
+//
+// Returns how many of want bytes the socket's own limit and the 
+// shared one, if any, both allow now.  Neither bucket has a lock, 
+// an unshaped socket gets all of them straight back.
+
+long int TTAsyncSocket::Allowance(TTTokenBucket * own, TTTokenBucket * shared, long int want)
+{
+   long int grant = own->Take(want);
+   if ( shared && grant > 0 ) {
+      long int common = shared->Take(grant);
+      if ( common < grant ) own->Give(grant - common);
+      grant = common;
+   }
+   return grant;
+}
+
+//
+// Refund
+//
+// Give back an allowance that wasn't used.
+
+void TTAsyncSocket::Refund(TTTokenBucket * own, TTTokenBucket * shared, long int unused)
+{
+   if ( unused <= 0 ) return;
+   own->Give(unused);
+   if ( shared ) shared->Give(unused);
+}
+
+//
+// Charge
+//
+// Count bytes already received against the limits.  Returns false 
+// if either has run out.
+
+bool TTAsyncSocket::Charge(TTTokenBucket * own, TTTokenBucket * shared, long int used)
+{
+   bool ok = own->Charge(used);
+   if ( shared && !shared->Charge(used) ) ok = false;
+   return ok;
+}
+
+//
+// Wait
+//
+// Milliseconds until the limits allow want bytes, or a burst.
+
+int TTAsyncSocket::Wait(TTTokenBucket * own, TTTokenBucket * shared, long int want)
+{
+   int ms = own->Limited() ? own->Wait(want) : 1;
+   if ( shared && shared->Limited() ) {
+      int common = shared->Wait(want);
+      if ( common > ms ) ms = common;
+   }
+   return ms;
+}
+
+//
+// Pace
+//
+// Out of allowance with want bytes to send, start them again once 
+// the limits have refilled.  The mutex must be held.
+
+void TTAsyncSocket::Pace(long int want)
+{
+   if ( send_pace == 0 && !closing ) send_pace = reactor->Schedule(this, Wait(send_limit, shared_send, want));
+}
+
+//
+// Ahead
+//
+// Returns how much of outbuf goes out before the next queued 
+// segment, or all of it when there are none.  The mutex must be 
+// held.
+
+long int TTAsyncSocket::Ahead()
+{
+   if ( segments ) return (long int)(segments->at - out_written);
+   return outbuf->Size();
+}
+
+//
+// Reap
+//
+// Readiness reactors only.  Collect zero copy completions from the 
+// socket's error queue and release the buffers they cover.  The 
+// mutex must be held.
+
+void TTAsyncSocket::Reap()
+{
+   unsigned int lo, hi;
+   unsigned int upto = 0;
+   bool any = false;
+   while ( sock->ReadZeroCopyDone(&lo, &hi) ) {
+      if ( !any || (int)(hi - upto) > 0 ) upto = hi;
+      any = true;
+   }
+   while ( any && waiting && (int)(waiting->last_seq - upto) <= 0 ) {
+      Append(&done, &done_tail, Pop(&waiting, &waiting_tail));
+   }
+}
+
+//
+// HandleZeroCopyDone
+//
+// A completion reactor has finished with one zero copy send.  
+// Sends complete in order, so it belongs to the oldest segment 
+// still owed one.
+
+void TTAsyncSocket::HandleZeroCopyDone()
+{
+   mutex->Lock();
+   TTSendSegment * segment = waiting;
+   while ( segment && segment->notifies == 0 ) segment = segment->next;
+   if ( !segment && segments && segments->notifies > 0 ) segment = segments;
+   if ( segment ) segment->notifies--;
+   while ( waiting && waiting->notifies == 0 ) {
+      Append(&done, &done_tail, Pop(&waiting, &waiting_tail));
+   }
+   if ( status == TTAS_STATUS_STOPPED && !closing && !Pending() ) sock->Shutdown();
+   mutex->Unlock();
+   NotifyDone();
+}
+
+//
+// NotifyDone
+//
+// Send TT_NOTIFY_FILE_DONE or TT_NOTIFY_SEND_DONE for each segment 
+// on the done list, or drop its shared buffer, and 
+// TT_NOTIFY_WRITABLE if the send queue went over its high water mark 
+// and has drained to the low one since.  Must be called without the 
+// mutex, the owner may well send more data from the notification.
+
+void TTAsyncSocket::NotifyDone()
+{
+   mutex->Lock();
+   TTSendSegment * list = done;
+   done = NULL;
+   done_tail = NULL;
+   bool writable = false;
+   if ( above && queued <= low_water && status == TTAS_STATUS_CONNECTED && !closing ) {
+      above = false;
+      writable = true;
+   }
+   mutex->Unlock();
+   
+   TTSendSegment * temp;
+   while ( list ) {
+      temp = list->next;
+      if ( list->shared ) list->shared->Drop();
+      else if ( list->buf ) notify->Notify(id, TT_NOTIFY_SEND_DONE, (void*)list->buf);
+      else notify->Notify(id, TT_NOTIFY_FILE_DONE, (void*)(long int)list->fd);
+      delete list;
+      list = temp;
+   }
+   if ( writable ) notify->Notify(id, TT_NOTIFY_WRITABLE, NULL);
+}
+
+//
+// Append, Pop
+//
+// Queue helpers for the segment lists.
+
+void TTAsyncSocket::Append(TTSendSegment ** head, TTSendSegment ** tail, TTSendSegment * segment)
+{
+   segment->next = NULL;
+   if ( *tail ) (*tail)->next = segment;
+   else *head = segment;
+   *tail = segment;
+}
+
+TTSendSegment * TTAsyncSocket::Pop(TTSendSegment ** head, TTSendSegment ** tail)
+{
+   TTSendSegment * segment = *head;
+   if ( segment ) {
+      *head = segment->next;
+      if ( !*head ) *tail = NULL;
+      segment->next = NULL;
+   }
+   return segment;
+}
+
+void TTAsyncSocket::Release(TTSendSegment * list)
+{
+   TTSendSegment * temp;
+   while ( list ) {
+      temp = list->next;
+      if ( list->shared ) list->shared->Drop();
+      delete list;
+      list = temp;
+   }
+}
+
+//
+// HandleEvent
+//
+// Called by the reactor when the socket changes state.  The 
+// reactor is edge triggered, so write until the queue is empty or 
+// the socket is full, and read until the socket is drained.
+//
+// A stopped socket keeps going until its queued writes are out, 
+// then it is shut down and the read side sees it close.
+
+void TTAsyncSocket::HandleEvent(int events)
+{
+   if ( status == TTAS_STATUS_CLOSED ) return;
+   if ( closing ) {
+      // zero copy completions for a socket waiting to close.
+      if ( events & TT_EVENT_ERROR ) Linger(false);
+      return;
+   }
+   
+   if ( dialing ) {
+      // the connect has finished one way or the other.
+      dialing = false;
+      if ( sock->ConnectResult() != 0 ) {
+         TT_Debug("TTAsyncSocket::HandleEvent() Connect Failed");
+         Close();
+         return;
+      }
+      Connected();
+      if ( status != TTAS_STATUS_CONNECTED ) return;
+   }
+   
+   if ( shared ) {
+      // the socket only brings the link, then the peer's doorbells 
+      // and its close, any of which may mean either ring has moved.
+      if ( !link ) {
+         if ( !Join() ) {
+            Close();
+            return;
+         }
+         if ( !link ) return;
+      }
+      events |= TT_EVENT_READ | TT_EVENT_WRITE;
+   }
+   
+   if ( events & (TT_EVENT_WRITE | TT_EVENT_ERROR) ) {
+      // zero copy completions are reported as errors.
+      mutex->Lock();
+      if ( waiting ) Reap();
+      bool ok = Flush();
+      if ( ok && status == TTAS_STATUS_STOPPED && !Pending() ) sock->Shutdown();
+      mutex->Unlock();
+      NotifyDone();
+      if ( !ok ) {
+         TT_Debug("TTAsyncSocket::HandleEvent() Fail on SEND");
+         Close();
+         return;
+      }
+   }
+   if ( !(events & (TT_EVENT_READ | TT_EVENT_ERROR)) ) return;
+
+   Drain();
+}
+
+//
+// Drain
+//
+// Readiness reactors only.  Read straight into inbuf until the 
+// socket is drained, then tell the owner once.  With a receive 
+// limit the reads stop when it runs out and a timer picks up where 
+// they left off.
+//
+// A shared socket reads from its link instead.  What arrives on the 
+// socket itself is only doorbells, and once the socket has closed 
+// the channel ends as soon as the link is empty.
+
+void TTAsyncSocket::Drain()
+{
+   int retVal = 0;
+   long int batch = 0;
+   long int total = 0;
+   long int grant;
+   unsigned char * space;
+   bool gone = false;
+   bool empty = false;
+   // held back, the timer or ResumeRead() will be along.
+   if ( recv_pace || paused ) return;
+   if ( shared ) {
+      if ( !link ) return;
+      gone = !Answer();
+   }
+   while ( status == TTAS_STATUS_CONNECTED || status == TTAS_STATUS_STOPPED ) {
+      if ( Full() ) {
+         // the owner isn't keeping up.  Let it see what it has, and 
+         // if that doesn't make room stop reading.
+         if ( batch > 0 ) {
+            batch = 0;
+            if ( !NotifyIn() ) {
+               retVal = -1;
+               break;
+            }
+            continue;
+         }
+         paused = true;
+         break;
+      }
+      grant = Allowance(recv_limit, shared_recv, read_size);
+      if ( grant == 0 ) {
+         mutex->Lock();
+         if ( !closing ) recv_pace = reactor->Schedule(this, Wait(recv_limit, shared_recv, read_size));
+         mutex->Unlock();
+         break;
+      }
+      space = inbuf->Reserve(grant);
+      if ( !space ) {
+         TT_Error("TTAsyncSocket::Drain() out of memory on RECV");
+         retVal = -1;
+         break;
+      }
+      retVal = shared ? link->Read(space, grant) : sock->Read(space, grant);
+      if ( retVal < grant ) Refund(recv_limit, shared_recv, grant - (retVal > 0 ? retVal : 0));
+      if ( retVal == 0 ) {
+         // drained, wait for the next edge.  A trickle this small 
+         // says the reads are bigger than they need to be.
+         empty = true;
+         if ( total < read_size / 4 && read_size > TT_READ_MIN ) read_size /= 2;
+         break;
+      }
+      else if ( retVal < 0 ) {
+         TT_Debug("TTAsyncSocket::Drain() Fail on RECV");
+         break;
+      }
+      inbuf->Commit(retVal);
+      batch += retVal;
+      total += retVal;
+      
+      // a full read says there is more where that came from.
+      if ( retVal == read_size && read_size < TT_READ_MAX ) read_size *= 2;
+      
+      if ( batch >= TT_READ_BATCH ) {
+         // a fast sender could keep us here for good, let the owner 
+         // catch up now and then.
+         batch = 0;
+         if ( !NotifyIn() ) {
+            retVal = -1;
+            break;
+         }
+      }
+   }
+   if ( batch > 0 && !NotifyIn() ) retVal = -1;
+   if ( retVal < 0 || (gone && empty) || !(status == TTAS_STATUS_CONNECTED || status == TTAS_STATUS_STOPPED) ) Close();
+}
+
+//
+// ShareMemory
+//
+// Carry the socket's data through a TTSharedLink.  The link is 
+// driven by readiness events on the socket, and has no use for 
+// zero copy.
+
+void TTAsyncSocket::ShareMemory()
+{
+   shared = true;
+   completion = false;
+   zc_tried = true;
+}
+
+//
+// Offer
+//
+// The dialing side of a shared socket, create the link and pass it 
+// to the peer.  The mutex must be held.
+
+bool TTAsyncSocket::Offer()
+{
+   link = TTSharedLink::Create(sock->Handle());
+   if ( !link ) return false;
+   int retVal = sock->SendDescriptor((const unsigned char*)TT_SHARED_HELLO, TT_SHARED_HELLO_LEN, link->Handle());
+   link->Release();
+   if ( retVal == TT_SHARED_HELLO_LEN ) return true;
+   delete link;
+   link = NULL;
+   return false;
+}
+
+//
+// Join
+//
+// The accepting side of a shared socket, map the link the peer 
+// passed.  Returns true if it is mapped or hasn't arrived yet, false 
+// if the peer sent something else or went away.
+
+bool TTAsyncSocket::Join()
+{
+   unsigned char hello[TT_SHARED_HELLO_LEN];
+   int fd;
+   int retVal = sock->ReadDescriptor(hello, TT_SHARED_HELLO_LEN, &fd);
+   if ( retVal == 0 ) return true;
+   TTSharedLink * joined = NULL;
+   if ( retVal == TT_SHARED_HELLO_LEN && fd >= 0 && memcmp(hello, TT_SHARED_HELLO, TT_SHARED_HELLO_LEN) == 0 ) {
+      joined = TTSharedLink::Map(fd, sock->Handle());
+   }
+   if ( fd >= 0 ) close(fd);
+   if ( !joined ) {
+      TT_Debug("TTAsyncSocket::Join() no shared memory from the peer");
+      return false;
+   }
+   mutex->Lock();
+   link = joined;
+   mutex->Unlock();
+   return true;
+}
+
+//
+// Answer
+//
+// Read the doorbells waiting on a shared socket, they carry nothing.  
+// A short read has emptied the socket, only a full one needs another 
+// look.  Returns false once the peer has closed.
+
+bool TTAsyncSocket::Answer()
+{
+   unsigned char bells[64];
+   int retVal;
+   while ( (retVal = sock->Read(bells, sizeof(bells))) == (int)sizeof(bells) ) ;
+   return retVal >= 0;
+}
+
+//
+// Write, WriteV, WriteFile
+//
+// Readiness writes, through the link on a shared socket and through 
+// the socket otherwise.  The mutex must be held.
+
+int TTAsyncSocket::Write(const unsigned char * buf, int len)
+{
+   if ( shared ) return link ? link->Write(buf, len) : 0;
+   return sock->Write(buf, len);
+}
+
+int TTAsyncSocket::WriteV(const struct iovec * iov, int count)
+{
+   if ( shared ) return link ? link->WriteV(iov, count) : 0;
+   return sock->WriteV(iov, count);
+}
+
+int TTAsyncSocket::WriteFile(int fd, off_t * offset, long int len)
+{
+   if ( shared ) return link ? link->WriteFile(fd, offset, len) : 0;
+   return sock->SendFile(fd, offset, len);
+}
+
+//
+// HandleRecv
+//
+// Completion reactors deliver received data here.  A len of zero 
+// or less means the peer closed or the receive failed.
+
+void TTAsyncSocket::HandleRecv(unsigned char * buf, int len)
+{
+   if ( closing ) return;
+   if ( len <= 0 ) {
+      Close();
+      return;
+   }
+   // the data is in before the limits could be asked, so it is 
+   // charged after.  Past them the receive stops until the timer.
+   bool over = !Charge(recv_limit, shared_recv, len);
+   inbuf->Add(buf, len);
+   if ( !NotifyIn() ) {
+      Close();
+      return;
+   }
+   if ( Full() && !paused ) {
+      paused = true;
+      reactor->StopRecv(sock->Handle(), this);
+   }
+   else if ( over && !paused ) {
+      mutex->Lock();
+      if ( !closing && !recv_pace ) {
+         reactor->StopRecv(sock->Handle(), this);
+         recv_pace = reactor->Schedule(this, Wait(recv_limit, shared_recv, read_size));
+      }
+      mutex->Unlock();
+   }
+}
+
+//
+// HandleFileRead
+//
+// The next chunk of a file queued by SendFile() has been read into 
+// sendbuf, send it on.
+
+void TTAsyncSocket::HandleFileRead(int result)
+{
+   mutex->Lock();
+   sending = false;
+   TTSendSegment * segment = file_inflight;
+   file_inflight = NULL;
+   bool ok = ( result > 0 && segment );
+   if ( ok ) {
+      sendbuf->Commit(result);
+      segment->offset += result;
+      segment->remaining -= result;
+      if ( segment->remaining == 0 ) Append(&done, &done_tail, Pop(&segments, &segments_tail));
+      if ( status == TTAS_STATUS_CONNECTED || status == TTAS_STATUS_STOPPED ) ok = Flush();
+   }
+   mutex->Unlock();
+   NotifyDone();
+   if ( !ok ) {
+      TT_Debug("TTAsyncSocket::HandleFileRead() could not read the file");
+      Close();
+   }
+}
+
+//
+// HandleSendDone
+//
+// A batch handed over by Flush() has gone out, or part of it 
+// has.  Send the rest, then whatever was queued meanwhile.
+
+void TTAsyncSocket::HandleSendDone(int result)
+{
+   mutex->Lock();
+   sending = false;
+   if ( send_granted > result ) Refund(send_limit, shared_send, send_granted - (result > 0 ? result : 0));
+   send_granted = 0;
+   if ( result > 0 ) Backlog(-result);
+   if ( result < 0 ) {
+      TT_Debug("TTAsyncSocket::HandleSendDone() send failed");
+      mutex->Unlock();
+      Close();
+      return;
+   }
+   if ( inflight ) {
+      // sent straight from the segment's buffer.  After a zero copy 
+      // send the buffer is held until the reactor reports the kernel 
+      // is done with it.
+      TTSendSegment * segment = inflight;
+      inflight = NULL;
+      segment->offset += result;
+      segment->remaining -= result;
+      if ( segment->remaining <= 0 ) {
+         segment = Pop(&segments, &segments_tail);
+         if ( segment->notifies > 0 ) Append(&waiting, &waiting_tail, segment);
+         else Append(&done, &done_tail, segment);
+      }
+   }
+   else if ( result > 0 ) sendbuf->Pop(result);
+   if ( sendbuf->Size() == 0 ) sendbuf->Reset();
+   bool ok = true;
+   if ( status == TTAS_STATUS_CONNECTED || status == TTAS_STATUS_STOPPED ) ok = Flush();
+   if ( ok && status == TTAS_STATUS_STOPPED && !Pending() ) sock->Shutdown();
+   mutex->Unlock();
+   NotifyDone();
+   if ( !ok ) Close();
+}
+
+//
+// Close
+//
+// Stop the socket and take it out of the reactor.  The reactor 
+// calls HandleRemoved() once it no longer refers to the socket, 
+// which may be straight away or, for a completion reactor, after 
+// outstanding operations have been cancelled and the kernel has 
+// finished with every zero copy buffer.  A readiness reactor can't 
+// tell, so the socket waits on its error queue first, see Linger().
+
+void TTAsyncSocket::Close()
+{
+   mutex->Lock();
+   if ( closing ) {
+      mutex->Unlock();
+      return;
+   }
+   closing = true;
+   status = TTAS_STATUS_STOPPED;
+   bool wasAttached = attached;
+   if ( wasAttached && !completion && waiting ) Reap();
+   if ( wasAttached && !completion && waiting ) {
+      linger = reactor->Schedule(this, TT_ZEROCOPY_LINGER);
+      mutex->Unlock();
+      NotifyDone();
+      return;
+   }
+   mutex->Unlock();
+   NotifyDone();
+
+   if ( wasAttached ) reactor->Remove(sock->Handle(), this);
+   else Finish();
+}
+
+//
+// Linger
+//
+// A closing socket is waiting for the kernel to give back its zero 
+// copy buffers.  Once it has, or TT_ZEROCOPY_LINGER has run out, 
+// take the socket out of the reactor.  Finish() resets the 
+// connection if any are still held.
+
+void TTAsyncSocket::Linger(bool expired)
+{
+   mutex->Lock();
+   if ( linger == 0 ) {
+      mutex->Unlock();
+      return;
+   }
+   Reap();
+   if ( waiting && !expired ) {
+      mutex->Unlock();
+      NotifyDone();
+      return;
+   }
+   if ( !expired ) reactor->Cancel(linger);
+   linger = 0;
+   mutex->Unlock();
+   NotifyDone();
+   reactor->Remove(sock->Handle(), this);
+}
+
+void TTAsyncSocket::HandleRemoved()
+{
+   Finish();
+}
+
+//
+// Finish
+//
+// Release the socket and send the end notification.  Setting the 
+// closed status is the last thing done, once it is set the owner 
+// may delete the socket.
+
+void TTAsyncSocket::Finish()
+{
+   mutex->Lock();
+   reactor->Cancel(deadline);
+   reactor->Cancel(kick);
+   reactor->Cancel(send_pace);
+   reactor->Cancel(recv_pace);
+   reactor->Cancel(linger);
+   deadline = 0;
+   kick = 0;
+   linger = 0;
+   send_pace = 0;
+   recv_pace = 0;
+   long int request = lookup;
+   lookup = 0;
+   // a zero copy buffer is only done with once the kernel says so, 
+   // or it has dropped the connection.  A completion reactor only 
+   // gets here once the kernel has finished with every one.
+   if ( sock && !completion && waiting ) Reap();
+   if ( sock && !completion && waiting ) sock->Abort();
+   else if ( sock ) sock->Disconnect();
+   delete link;
+   link = NULL;
+   // segments that never went out are done with too.
+   while ( segments ) Append(&done, &done_tail, Pop(&segments, &segments_tail));
+   while ( waiting ) Append(&done, &done_tail, Pop(&waiting, &waiting_tail));
+   mutex->Unlock();
+   // the resolver calls us with its lock held, cancel without ours.
+   if ( request ) resolver->Cancel(request);
+   NotifyDone();
+   notify->Notify(id, TT_NOTIFY_END, NULL);
+   status = TTAS_STATUS_CLOSED;
 }
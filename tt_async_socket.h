@@ -7,8 +7,60 @@
 // thread context.  Synchronizing is up to the caller, but the socket is 
 // reentrant and synchronized.
 //
-// The socket is implemented with a single worker thread doing the reads, 
-// writes are non-blocking and happen in the caller's context.
+// The socket does not own a thread.  I/O is driven by a TTReactor 
+// event loop which calls HandleEvent() when the socket is readable 
+// or writable.  A readable socket is drained straight into inbuf, 
+// with reads that grow while they come back full and shrink while 
+// they come back mostly empty, and the owner gets one TT_NOTIFY_IN 
+// for the lot.  Send() writes what the socket will take without 
+// blocking and queues the rest in outbuf, which is flushed as the 
+// socket becomes writable.  SendFile() queues part of a file in 
+// the same stream, it is sent with sendfile() without passing 
+// through user space.  SendZeroCopy() queues a caller owned buffer 
+// which, above TT_ZEROCOPY_MIN bytes, is sent with MSG_ZEROCOPY and 
+// handed back with TT_NOTIFY_SEND_DONE once the kernel has finished 
+// with it.  SendShared() queues a TTRefBuffer the same way, holding 
+// a reference instead of notifying, so many sockets can send one 
+// copy of the data.
+//
+// Outbound connects don't block either.  The connect is started on 
+// the reactor's thread and finishes there, when the socket turns 
+// writable or, with a completion reactor, through HandleConnect().  
+// A reactor timer gives up on it once the timeout passes.  A host 
+// name is looked up with the TTResolver given to Connect(), without 
+// one the lookup takes a short lived thread.
+//
+// With a completion reactor (io_uring) the reactor does the I/O: 
+// received data arrives through HandleRecv(), and sends are queued in 
+// outbuf and handed to the reactor one batch at a time, the batch in 
+// flight being held in sendbuf until HandleSendDone().
+//
+// The bytes accepted but not yet written are counted against the 
+// socket's high water mark, see Watermarks().  Over() tells a sender 
+// the socket has more queued than it should, and once the queue has 
+// drained to the low water mark the owner gets TT_NOTIFY_WRITABLE.
+//
+// ReadLimit() caps how much received data may wait in inbuf.  Once 
+// the owner leaves that much unread the socket stops reading, the 
+// kernel's receive window fills and TCP holds the sender back, until 
+// ResumeRead().
+//
+// Shape() limits the rate the socket sends and receives at, Share() 
+// puts it under limits shared with other sockets as well.  Writes 
+// and reads stop when a limit runs out and a reactor timer starts 
+// them again once it has refilled, so a shaped socket is paced 
+// rather than bursty.  A completion reactor's receives are counted 
+// as they arrive and stopped once past the limit.
+//
+// A channel to a shm:/path carries its data through a TTSharedLink, 
+// rings in memory shared with the peer process, instead of the 
+// socket.  The dialing side creates the rings and passes them over 
+// the Unix socket as soon as it connects, after that the socket 
+// only carries the link's doorbells and its close.  Such a socket is 
+// always driven by readiness events, with either engine.
+//
+// Frame() has the socket deliver length prefixed messages, or lines, 
+// one TT_NOTIFY_MESSAGE each, instead of TT_NOTIFY_IN, see TTFramer.
 //
 // The socket is a use-once then throw away model.
 //
@@ -20,12 +72,24 @@
 #define __tt_async_socket_h
 
 #include <pthread.h>
+#include <sys/types.h>
+
+#include "ttools/tt_reactor.h"
 
+struct sockaddr_storage;
 class TTBuffer;
+class TTFramer;
+class TTRefBuffer;
+class TTSendSegment;
+class TTSharedLink;
 class TTSemaphore;
 class TTMutex;
 class TTNotify;
+class TTResolver;
 class TTSocket;
+class TTSocketOptions;
+class TTTokenBucket;
+struct iovec;
 
 const int TTAS_STATUS_READY = 0;
 const int TTAS_STATUS_CONNECTING = 1;
@@ -33,34 +97,153 @@ const int TTAS_STATUS_CONNECTED = 2;
 const int TTAS_STATUS_STOPPED = 3;
 const int TTAS_STATUS_CLOSED = 4;
 
-class TTAsyncSocket {
+const int TT_FILE_CHUNK = 65536;  // file reads for completion reactors
+const int TT_ZEROCOPY_MIN = 32768;  // smaller caller buffers are copied
+const int TT_ZEROCOPY_LINGER = 5000;  // ms a close waits on zero copy buffers
+const int TT_CONNECT_TIMEOUT = 10000;  // milliseconds
+const int TT_READ_MIN = 4096;  // adaptive receive size bounds
+const int TT_READ_MAX = 262144;
+const int TT_READ_BATCH = 1048576;  // notify at least this often while draining
+const long int TT_HIGH_WATER = 4194304;  // default send queue watermarks
+const long int TT_LOW_WATER = 1048576;
+
+// what a network send reports
+const int TT_SEND_FAILED = 0;
+const int TT_SEND_OK = 1;
+const int TT_SEND_FULL = 2;   // queued, but over the high water mark
+
+class TTAsyncSocket : public TTReactorHandler {
 
 public:
 
-   TTAsyncSocket(TTNotify * tn, long int id);
+   TTAsyncSocket(TTNotify * tn, long int id, TTReactor * rct);
    ~TTAsyncSocket();
 
-   bool Connect(char * hst, int prt);
+   bool Connect(char * hst, int prt, int tmout = TT_CONNECT_TIMEOUT, TTResolver * rsv = NULL, const TTSocketOptions * opts = NULL);
    bool Connect(TTSocket * sk);
    bool Disconnect();
    
    bool Send(unsigned char * buf, int len);
-   void ReadThread();
+   bool SendV(const struct iovec * iov, int count);
+   bool SendFile(int fd, long int offset, long int length);
+   bool SendZeroCopy(unsigned char * buf, int len);
+   bool SendShared(TTRefBuffer * buffer);
+   void Shape(long int sendRate, long int recvRate);
+   void Share(TTTokenBucket * sendLimit, TTTokenBucket * recvLimit);
+   void Watermarks(long int high, long int low);
+   void Backlog(long int bytes);
+   bool Over();
+   void ReadLimit(long int bytes);
+   void Frame(int format, long int max);
+   void SetOptions(const TTSocketOptions * opts);
+   void ResumeRead();
+   long int Queued() { return queued; }
+   void ConnectThread();
+   virtual void HandleEvent(int events);
+   virtual void HandleRecv(unsigned char * buf, int len);
+   virtual void HandleSendDone(int result);
+   virtual void HandleZeroCopyDone();
+   virtual void HandleConnect(int result);
+   virtual void HandleFileRead(int result);
+   virtual void HandleTimer(long int timer);
+   virtual void HandleResolved(long int request, unsigned long ip);
+   virtual void HandleRemoved();
    long int ID(){return id;}
    long int Status(){return status;}
+   bool Pooled(){return pooled;}
+   bool Alive();
+   void SetPooled(){pooled = true;}
 
 private:
    void Stop();
+   void Dial();
+   void Connected();
+   bool Attach();
+   bool Flush();
+   void Drain();
+   bool Full();
+   bool NotifyIn();
+   void ShareMemory();
+   bool Offer();
+   bool Join();
+   bool Answer();
+   int Write(const unsigned char * buf, int len);
+   int WriteV(const struct iovec * iov, int count);
+   int WriteFile(int fd, off_t * offset, long int len);
+   long int Allowance(TTTokenBucket * own, TTTokenBucket * shared, long int want);
+   void Refund(TTTokenBucket * own, TTTokenBucket * shared, long int unused);
+   bool Charge(TTTokenBucket * own, TTTokenBucket * shared, long int used);
+   int Wait(TTTokenBucket * own, TTTokenBucket * shared, long int want);
+   void Pace(long int want);
+   bool Pending();
+   long int Ahead();
+   bool Queue(TTSendSegment * segment);
+   void Reap();
+   void NotifyDone();
+   void Append(TTSendSegment ** head, TTSendSegment ** tail, TTSendSegment * segment);
+   TTSendSegment * Pop(TTSendSegment ** head, TTSendSegment ** tail);
+   void Release(TTSendSegment * list);
+   void Close();
+   void Linger(bool expired);
+   void Finish();
    
    int status;
    char * host;
    int port;
+   int timeout;
+   unsigned long remote_ip;
+   struct sockaddr_storage * remote;
+   long int deadline;
+   long int kick;
+   long int linger;
+   bool resolving;
+   TTResolver * resolver;
+   long int lookup;
+   bool dialing;
+   int read_size;
+   long int in_limit;
+   bool paused;
+   TTFramer * framer;
+   bool delivering;
+   bool pooled;
+   TTTokenBucket * send_limit;
+   TTTokenBucket * recv_limit;
+   TTTokenBucket * shared_send;
+   TTTokenBucket * shared_recv;
+   long int send_pace;
+   long int recv_pace;
+   long int send_granted;
    TTSocket * sock;
+   TTSharedLink * link;
+   bool shared;
+   bool completion;
+   TTSocketOptions * options;
    TTBuffer * inbuf;
    TTBuffer * outbuf;
+   TTBuffer * sendbuf;
+   TTSendSegment * segments;
+   TTSendSegment * segments_tail;
+   TTSendSegment * waiting;
+   TTSendSegment * waiting_tail;
+   TTSendSegment * done;
+   TTSendSegment * done_tail;
+   TTSendSegment * inflight;
+   TTSendSegment * file_inflight;
+   bool zc_tried;
+   bool zc_enabled;
+   unsigned int zc_seq;
+   volatile long int queued;
+   long int high_water;
+   long int low_water;
+   volatile bool above;
+   long long out_added;
+   long long out_written;
+   bool sending;
+   bool attached;
+   bool closing;
    TTNotify * notify;
    TTMutex * mutex;
-   pthread_t read_thread_id;
+   TTReactor * reactor;
    long int id;
 };
 
@@ -50,7 +50,15 @@ bool TTBuffer::Add(const unsigned char * buf, int bufSize)
       allocated = ((bufSize/TT_CHUNK_SIZE)+1)*TT_CHUNK_SIZE;
       buffer = (unsigned char*)malloc(allocated);
    }
-   else if ( (used+bufSize) > allocated ) {
+   else if ( (used+bufSize) > allocated && read_index > 0 ) {
+      // reclaim the space already popped off the front before 
+      // growing, so a buffer used as a queue doesn't creep.
+      memmove(buffer, buffer+read_index, used-read_index);
+      used -= read_index;
+      read_index = 0;
+   }
+   
+   if ( (used+bufSize) > allocated ) {
       allocated += (((bufSize/TT_CHUNK_SIZE)+1)*TT_CHUNK_SIZE);
       unsigned char * temp;
       temp = (unsigned char*)realloc(buffer, allocated);
@@ -66,6 +74,43 @@ bool TTBuffer::Add(const unsigned char * buf, int bufSize)
    return true;
 }
 
+//
+// Reserve
+//
+// Make room for at least size more bytes at the end of the buffer 
+// and return where they go, so data can be read straight into the 
+// buffer.  Commit() then adds however many were written.  Returns 
+// NULL if the memory can't be had.
+
+unsigned char * TTBuffer::Reserve(int size)
+{
+   if ( read_index > 0 && (used+size) > allocated ) {
+      memmove(buffer, buffer+read_index, used-read_index);
+      used -= read_index;
+      read_index = 0;
+   }
+   if ( (used+size) > allocated ) {
+      long int want = ((used+size)/TT_CHUNK_SIZE+1)*TT_CHUNK_SIZE;
+      unsigned char * temp = (unsigned char*)realloc(buffer, want);
+      if ( temp == NULL ) {
+         return NULL;
+      }
+      buffer = temp;
+      allocated = want;
+   }
+   return buffer+used;
+}
+
+//
+// Commit
+//
+// Add size bytes written into the space given by Reserve().
+
+void TTBuffer::Commit(int size)
+{
+   if ( size > 0 && (used+size) <= allocated ) used += size;
+}
+
 //
 // Insert into an already allocated buffer, if not enough room  exists 
 // in the current allocation, returns false.
@@ -99,7 +144,7 @@ bool TTBuffer::Pop(int popSize)
 
    read_index += popSize;
    
-   if ( read_index >= allocated ) {
+   if ( read_index >= used ) {
       free(buffer);
       buffer = NULL;
       read_index = 0;
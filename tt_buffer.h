@@ -24,6 +24,9 @@ public:
    bool AddShort(short int);
    bool AddByte(unsigned char);
 
+   unsigned char * Reserve(int size);
+   void Commit(int size);
+
    bool Pop(int popSize);
    unsigned short ShortFromBuffer(int bytes);
    unsigned char * Buffer(); 
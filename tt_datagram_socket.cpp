@@ -0,0 +1,467 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTDatagramSocket - a UDP channel.  The socket is non-blocking and
+// driven by a TTReactor like the stream sockets, each readiness
+// event drains it with recvmmsg(), TT_DGRAM_BATCH datagrams per call,
+// and every datagram is passed on as a TT_NOTIFY_DATAGRAM carrying a
+// TTDatagram with the peer's address.
+//
+// SendTo() copies the datagram into a batch that goes out in one
+// sendmmsg() once it is full, or straight away unless more is set.
+// SendSegments() hands one large buffer to the kernel to be cut into
+// equal datagrams (UDP GSO), falling back to a batch where the
+// kernel can't.  With offload set at Open() the kernel may also
+// coalesce received datagrams (UDP GRO), they are split again before
+// they are passed on.
+//
+// Sends may be made from any thread.  Close() is asynchronous, the
+// socket sends TT_NOTIFY_END once the reactor has let go of it and
+// deletes itself when the last Hold() is released.
+//
+// Part of the TTools package.
+
+#include <cstddef>
+#include <string.h>
+
+#ifdef WIN32
+#else
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#endif
+
+#include "ttools/tt_datagram_socket.h"
+#include "ttools/tt_notify.h"
+#include "ttools/tt_mutex.h"
+#include "ttools/tt_functions.h"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+const int TT_DGRAM_PAYLOAD_MAX = 65507;
+
+TTDatagramSocket::TTDatagramSocket(TTNotify * tn, long int pid, TTReactor * rct)
+{
+   notify = tn;
+   id = pid;
+   reactor = rct;
+   fd = -1;
+   slot = TT_DGRAM_MAX;
+   stop = false;
+   detached = 0;
+   in_event = false;
+   refs = 1;   // the reactor's, released by HandleRemoved()
+   offload = false;
+   gso = true;
+   queued = 0;
+   dropped = 0;
+   inbuf = NULL;
+   outbuf = NULL;
+   inmsgs = NULL;
+   outmsgs = NULL;
+   inv = NULL;
+   outv = NULL;
+   inaddrs = NULL;
+   outaddrs = NULL;
+   control = NULL;
+   mutex = new TTMutex();
+}
+
+TTDatagramSocket::~TTDatagramSocket()
+{
+   if ( fd >= 0 ) close(fd);
+   delete [] inbuf;
+   delete [] outbuf;
+   delete [] inmsgs;
+   delete [] outmsgs;
+   delete [] inv;
+   delete [] outv;
+   delete [] inaddrs;
+   delete [] outaddrs;
+   delete [] control;
+   delete mutex;
+}
+
+//
+// Open
+//
+// Bind to the given interface, NULL for all of them, and port, 0
+// for any, and start receiving.  With offload set the kernel is
+// asked to coalesce received datagrams.  Returns false if the
+// socket could not be set up, the socket must then be released.
+
+bool TTDatagramSocket::Open(char * interface, int port, bool ofld)
+{
+   fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+   if ( fd < 0 ) {
+      TT_Debug("TTDatagramSocket::Open() could not allocate the socket");
+      return false;
+   }
+
+   // room for bursts, the kernel caps it at rmem_max / wmem_max.
+   int size = TT_DGRAM_BUFFER;
+   setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+   setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+   struct sockaddr_in sockAddr;
+   memset(&sockAddr, 0, sizeof(sockAddr));
+   sockAddr.sin_family = AF_INET;
+   if ( !interface ) sockAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+   else sockAddr.sin_addr.s_addr = inet_addr(interface);
+   sockAddr.sin_port = htons((u_short)port);
+   if ( bind(fd, (struct sockaddr *)&sockAddr, sizeof(sockAddr)) < 0 ) {
+      TT_Debug("TTDatagramSocket::Open() could not bind");
+      return false;
+   }
+
+   int one = 1;
+   offload = ofld;
+   if ( offload && setsockopt(fd, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0 ) {
+      TT_Debug("TTDatagramSocket::Open() UDP_GRO not supported");
+      offload = false;
+   }
+   slot = offload ? TT_DGRAM_OFFLOAD_MAX : TT_DGRAM_MAX;
+
+   // the message headers point at their own slots for good, only
+   // the lengths and addresses change from call to call.
+   int cmsgSpace = CMSG_SPACE(sizeof(int));
+   inbuf = new unsigned char[TT_DGRAM_BATCH * slot];
+   outbuf = new unsigned char[TT_DGRAM_BATCH * TT_DGRAM_MAX];
+   inmsgs = new struct mmsghdr[TT_DGRAM_BATCH];
+   outmsgs = new struct mmsghdr[TT_DGRAM_BATCH];
+   inv = new struct iovec[TT_DGRAM_BATCH];
+   outv = new struct iovec[TT_DGRAM_BATCH];
+   inaddrs = new struct sockaddr_in[TT_DGRAM_BATCH];
+   outaddrs = new struct sockaddr_in[TT_DGRAM_BATCH];
+   control = new unsigned char[TT_DGRAM_BATCH * cmsgSpace];
+   memset(inmsgs, 0, sizeof(struct mmsghdr) * TT_DGRAM_BATCH);
+   memset(outmsgs, 0, sizeof(struct mmsghdr) * TT_DGRAM_BATCH);
+   memset(outaddrs, 0, sizeof(struct sockaddr_in) * TT_DGRAM_BATCH);
+   for ( int i = 0; i < TT_DGRAM_BATCH; i++ ) {
+      inv[i].iov_base = inbuf + i * slot;
+      inmsgs[i].msg_hdr.msg_iov = &inv[i];
+      inmsgs[i].msg_hdr.msg_iovlen = 1;
+      inmsgs[i].msg_hdr.msg_name = &inaddrs[i];
+      outv[i].iov_base = outbuf + i * TT_DGRAM_MAX;
+      outmsgs[i].msg_hdr.msg_iov = &outv[i];
+      outmsgs[i].msg_hdr.msg_iovlen = 1;
+      outmsgs[i].msg_hdr.msg_name = &outaddrs[i];
+      outmsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+      outaddrs[i].sin_family = AF_INET;
+   }
+
+   if ( !reactor->Add(fd, this) ) {
+      TT_Debug("TTDatagramSocket::Open() could not add the socket to the reactor");
+      return false;
+   }
+   return true;
+}
+
+//
+// Port
+//
+// The port the socket is bound to, useful after opening port 0.
+
+int TTDatagramSocket::Port()
+{
+   struct sockaddr_in sockAddr;
+   socklen_t len = sizeof(sockAddr);
+   if ( fd < 0 || getsockname(fd, (struct sockaddr *)&sockAddr, &len) < 0 ) return 0;
+   return ntohs(sockAddr.sin_port);
+}
+
+void TTDatagramSocket::Hold()
+{
+   __sync_fetch_and_add(&refs, 1);
+}
+
+void TTDatagramSocket::Release()
+{
+   if ( __sync_sub_and_fetch(&refs, 1) == 0 ) delete this;
+}
+
+//
+// Close
+//
+// Stop receiving and let go of the socket.  From the reactor's own
+// thread the socket is removed directly, from anywhere else a
+// readiness reactor is woken by shutting the socket down and removes
+// it from the loop.
+
+void TTDatagramSocket::Close()
+{
+   Hold();
+   if ( !stop ) {
+      stop = true;
+      if ( reactor->Completion() ) Detach();
+      else if ( reactor->InLoop() ) {
+         // HandleEvent() removes it on the way out.
+         if ( !in_event ) Detach();
+      }
+      else shutdown(fd, SHUT_RDWR);
+   }
+   Release();
+}
+
+//
+// Detach
+//
+// Take the socket out of the reactor, once.
+
+void TTDatagramSocket::Detach()
+{
+   if ( __sync_bool_compare_and_swap(&detached, 0, 1) ) reactor->Remove(fd, this);
+}
+
+//
+// HandleRemoved
+//
+// The reactor has let go, tell the owner and drop the reactor's
+// reference.
+
+void TTDatagramSocket::HandleRemoved()
+{
+   notify->Notify(id, TT_NOTIFY_END, NULL);
+   Release();
+}
+
+//
+// HandleEvent
+//
+// Drain the socket, TT_DGRAM_BATCH datagrams per system call.
+
+void TTDatagramSocket::HandleEvent(int events)
+{
+   Hold();
+   in_event = true;
+   int cmsgSpace = CMSG_SPACE(sizeof(int));
+   int count;
+   struct msghdr * hdr;
+   struct cmsghdr * cmsg;
+   int segment;
+
+   while ( !stop ) {
+      for ( int i = 0; i < TT_DGRAM_BATCH; i++ ) {
+         inv[i].iov_len = slot;
+         inmsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+         inmsgs[i].msg_hdr.msg_control = offload ? control + i * cmsgSpace : NULL;
+         inmsgs[i].msg_hdr.msg_controllen = offload ? cmsgSpace : 0;
+         inmsgs[i].msg_hdr.msg_flags = 0;
+      }
+      TT_CountSyscall();
+      count = recvmmsg(fd, inmsgs, TT_DGRAM_BATCH, MSG_DONTWAIT, NULL);
+      if ( count < 0 ) {
+         if ( errno == EINTR ) continue;
+         break;
+      }
+      for ( int i = 0; i < count && !stop; i++ ) {
+         hdr = &inmsgs[i].msg_hdr;
+         if ( hdr->msg_flags & MSG_TRUNC ) {
+            dropped++;
+            continue;
+         }
+         segment = 0;
+         if ( offload ) {
+            for ( cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg) ) {
+               if ( cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO ) {
+                  memcpy(&segment, CMSG_DATA(cmsg), sizeof(int));
+               }
+            }
+         }
+         Deliver(inbuf + i * slot, inmsgs[i].msg_len, segment, &inaddrs[i]);
+      }
+      if ( count < TT_DGRAM_BATCH ) break;
+   }
+
+   in_event = false;
+   if ( stop ) Detach();
+   Release();
+}
+
+//
+// Deliver
+//
+// Pass a received datagram on, or each of the datagrams the kernel
+// coalesced into it.
+
+void TTDatagramSocket::Deliver(unsigned char * buf, int len, int segment, struct sockaddr_in * from)
+{
+   TTDatagram datagram;
+   datagram.ip = ntohl(from->sin_addr.s_addr);
+   datagram.port = ntohs(from->sin_port);
+   if ( segment <= 0 ) segment = len;
+
+   int offset = 0;
+   do {
+      datagram.data = buf + offset;
+      datagram.length = ( len - offset < segment ) ? len - offset : segment;
+      notify->Notify(id, TT_NOTIFY_DATAGRAM, (void*)&datagram);
+      offset += datagram.length;
+   } while ( offset < len );
+}
+
+//
+// SendTo
+//
+// Send a datagram to ip (host byte order) and port.  The datagram
+// is copied into the current batch, which goes out now unless more
+// is set and there is room for more.  Returns false if the socket
+// is closed or the kernel refused the batch.
+
+bool TTDatagramSocket::SendTo(unsigned long ip, int port, unsigned char * buf, int len, bool more)
+{
+   if ( stop || len < 0 || len > TT_DGRAM_PAYLOAD_MAX ) return false;
+
+   mutex->Lock();
+   bool ok = true;
+   if ( len > TT_DGRAM_MAX ) {
+      // too big for a batch slot, send it on its own.
+      ok = FlushLocked();
+      struct sockaddr_in addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(port);
+      addr.sin_addr.s_addr = htonl(ip);
+      TT_CountSyscall();
+      if ( sendto(fd, buf, len, MSG_DONTWAIT, (struct sockaddr *)&addr, sizeof(addr)) < 0 ) {
+         dropped++;
+         ok = false;
+      }
+      mutex->Unlock();
+      return ok;
+   }
+
+   int i = queued++;
+   memcpy(outbuf + i * TT_DGRAM_MAX, buf, len);
+   outv[i].iov_len = len;
+   outaddrs[i].sin_port = htons(port);
+   outaddrs[i].sin_addr.s_addr = htonl(ip);
+   if ( !more || queued == TT_DGRAM_BATCH ) ok = FlushLocked();
+   mutex->Unlock();
+   return ok;
+}
+
+//
+// Flush
+//
+// Send the datagrams batched so far.
+
+bool TTDatagramSocket::Flush()
+{
+   mutex->Lock();
+   bool ok = FlushLocked();
+   mutex->Unlock();
+   return ok;
+}
+
+//
+// FlushLocked
+//
+// Send the batch in as few sendmmsg() calls as the kernel allows.
+// What it won't take is dropped, as the network would.  The mutex
+// must be held.
+
+bool TTDatagramSocket::FlushLocked()
+{
+   int sent = 0;
+   int count;
+   bool ok = true;
+   while ( sent < queued ) {
+      TT_CountSyscall();
+      count = sendmmsg(fd, outmsgs + sent, queued - sent, MSG_DONTWAIT);
+      if ( count < 0 ) {
+         if ( errno == EINTR ) continue;
+         dropped += queued - sent;
+         ok = false;
+         break;
+      }
+      sent += count;
+   }
+   queued = 0;
+   return ok;
+}
+
+//
+// SendSegments
+//
+// Send len bytes to ip and port as datagrams of segment bytes each,
+// the last one may be shorter.  The kernel does the cutting where it
+// supports UDP GSO, TT_DGRAM_GSO_SEGMENTS datagrams per call,
+// otherwise the datagrams go out in batches.
+
+bool TTDatagramSocket::SendSegments(unsigned long ip, int port, unsigned char * buf, int len, int segment)
+{
+   if ( stop || segment <= 0 || segment > TT_DGRAM_MAX || len < 0 ) return false;
+
+   struct sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(port);
+   addr.sin_addr.s_addr = htonl(ip);
+
+   int most = TT_DGRAM_GSO_SEGMENTS;
+   if ( most * segment > TT_DGRAM_PAYLOAD_MAX ) most = TT_DGRAM_PAYLOAD_MAX / segment;
+   int offset = 0;
+   bool ok = true;
+
+   mutex->Lock();
+   ok = FlushLocked();
+   while ( gso && offset < len ) {
+      int chunk = len - offset;
+      if ( chunk > most * segment ) chunk = most * segment;
+
+      struct iovec iov;
+      iov.iov_base = buf + offset;
+      iov.iov_len = chunk;
+      unsigned char cbuf[CMSG_SPACE(sizeof(unsigned short))];
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_name = &addr;
+      msg.msg_namelen = sizeof(addr);
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      if ( chunk > segment ) {
+         msg.msg_control = cbuf;
+         msg.msg_controllen = sizeof(cbuf);
+         struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+         cmsg->cmsg_level = SOL_UDP;
+         cmsg->cmsg_type = UDP_SEGMENT;
+         cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned short));
+         unsigned short size = segment;
+         memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+      }
+      TT_CountSyscall();
+      if ( sendmsg(fd, &msg, MSG_DONTWAIT) >= 0 ) {
+         offset += chunk;
+         continue;
+      }
+      if ( errno == EINTR ) continue;
+      if ( errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP ) {
+         // no segmentation offload here, batch from now on.
+         TT_Debug("TTDatagramSocket::SendSegments() UDP GSO not supported");
+         gso = false;
+         break;
+      }
+      dropped += (len - offset + segment - 1) / segment;
+      mutex->Unlock();
+      return false;
+   }
+   mutex->Unlock();
+
+   while ( offset < len ) {
+      int piece = ( len - offset < segment ) ? len - offset : segment;
+      offset += piece;
+      if ( !SendTo(ip, port, buf + offset - piece, piece, offset < len) ) ok = false;
+   }
+   return ok;
+}
@@ -0,0 +1,108 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTDatagramSocket - a UDP channel.  The socket is non-blocking and
+// driven by a TTReactor like the stream sockets, each readiness
+// event drains it with recvmmsg(), TT_DGRAM_BATCH datagrams per call,
+// and every datagram is passed on as a TT_NOTIFY_DATAGRAM carrying a
+// TTDatagram with the peer's address.
+//
+// SendTo() copies the datagram into a batch that goes out in one
+// sendmmsg() once it is full, or straight away unless more is set.
+// SendSegments() hands one large buffer to the kernel to be cut into
+// equal datagrams (UDP GSO), falling back to a batch where the
+// kernel can't.  With offload set at Open() the kernel may also
+// coalesce received datagrams (UDP GRO), they are split again before
+// they are passed on.
+//
+// Sends may be made from any thread.  Close() is asynchronous, the
+// socket sends TT_NOTIFY_END once the reactor has let go of it and
+// deletes itself when the last Hold() is released.
+//
+// Part of the TTools package.
+
+#ifndef __tt_datagram_socket_h
+#define __tt_datagram_socket_h
+
+#include "ttools/tt_reactor.h"
+
+class TTMutex;
+class TTNotify;
+struct mmsghdr;
+struct iovec;
+struct sockaddr_in;
+
+const int TT_DGRAM_BATCH = 32;     // datagrams per system call
+const int TT_DGRAM_MAX = 2048;     // larger datagrams are dropped
+const int TT_DGRAM_OFFLOAD_MAX = 65536;
+const int TT_DGRAM_GSO_SEGMENTS = 64;
+const int TT_DGRAM_BUFFER = 4194304;
+
+//
+// The data of a TT_NOTIFY_DATAGRAM, only valid during the
+// notification.  The address is in host byte order.
+
+class TTDatagram {
+
+public:
+
+   unsigned char * data;
+   int length;
+   unsigned long ip;
+   int port;
+};
+
+class TTDatagramSocket : public TTReactorHandler {
+
+public:
+
+   TTDatagramSocket(TTNotify * tn, long int pid, TTReactor * rct);
+
+   bool Open(char * interface, int port, bool offload = false);
+   void Close();
+   bool SendTo(unsigned long ip, int port, unsigned char * buf, int len, bool more = false);
+   bool SendSegments(unsigned long ip, int port, unsigned char * buf, int len, int segment);
+   bool Flush();
+   int Port();
+   void Hold();
+   void Release();
+   long int ID() { return id; }
+   long int Dropped() { return dropped; }
+
+   virtual void HandleEvent(int events);
+   virtual void HandleRemoved();
+
+private:
+
+   ~TTDatagramSocket();
+   bool FlushLocked();
+   void Detach();
+   void Deliver(unsigned char * buf, int len, int segment, struct sockaddr_in * from);
+
+   long int id;
+   int fd;
+   int slot;
+   volatile bool stop;
+   volatile int detached;
+   bool in_event;
+   volatile int refs;
+   bool offload;
+   bool gso;
+   int queued;
+   long int dropped;
+   unsigned char * inbuf;
+   unsigned char * outbuf;
+   struct mmsghdr * inmsgs;
+   struct mmsghdr * outmsgs;
+   struct iovec * inv;
+   struct iovec * outv;
+   struct sockaddr_in * inaddrs;
+   struct sockaddr_in * outaddrs;
+   unsigned char * control;
+   TTMutex * mutex;
+   TTNotify * notify;
+   TTReactor * reactor;
+};
+
+#endif // __tt_datagram_socket_h
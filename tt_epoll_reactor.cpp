@@ -0,0 +1,140 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTEpollReactor - readiness engine for TTReactor.  An edge-triggered 
+// epoll loop, so a handler must drain its descriptor (read until it 
+// would block) each time it is called.
+//
+// Part of the TTools package.
+
+#include <cstddef>
+
+#ifdef WIN32
+#else
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <errno.h>
+#endif
+
+#include "ttools/tt_epoll_reactor.h"
+#include "ttools/tt_functions.h"
+
+TTEpollReactor::TTEpollReactor()
+{
+   event_index = 0;
+   event_count = 0;
+   epoll_fd = epoll_create(TT_REACTOR_MAX_EVENTS);
+   if ( epoll_fd < 0 ) {
+      TT_Error("TTEpollReactor::TTEpollReactor() epoll_create failed");
+   }
+
+   // the wake descriptor lets Stop() break the loop out of
+   // epoll_wait.  It is registered with a NULL handler.
+
+   wake_fd = eventfd(0, EFD_NONBLOCK);
+   if ( wake_fd >= 0 && epoll_fd >= 0 ) {
+      struct epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.ptr = NULL;
+      epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+   }
+}
+
+TTEpollReactor::~TTEpollReactor()
+{
+   Stop();
+   if ( wake_fd >= 0 ) close(wake_fd);
+   if ( epoll_fd >= 0 ) close(epoll_fd);
+}
+
+bool TTEpollReactor::Ready()
+{
+   if ( epoll_fd < 0 || wake_fd < 0 ) return false;
+
+   // clear any wakeup left over from a previous Stop().
+   uint64_t count;
+   if ( read(wake_fd, &count, sizeof(count)) < 0 ) count = 0;
+   return true;
+}
+
+void TTEpollReactor::Wake()
+{
+   uint64_t one = 1;
+   TT_CountSyscall();
+   if ( write(wake_fd, &one, sizeof(one)) < 0 ) {
+      TT_Debug("TTEpollReactor::Wake() wake failed");
+   }
+}
+
+//
+// Add a descriptor to the loop.  The descriptor is watched for
+// both read and write readiness, edge triggered, so it only has
+// to be registered once for its whole life.
+
+bool TTEpollReactor::Add(int fd, TTReactorHandler * handler)
+{
+   struct epoll_event ev;
+   ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+   ev.data.ptr = (void*)handler;
+   TT_CountSyscall();
+   if ( epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0 ) {
+      TT_Debug("TTEpollReactor::Add() epoll_ctl failed");
+      return false;
+   }
+   return true;
+}
+
+//
+// Remove a descriptor from the loop.  This must be called from
+// the reactor thread (normally from inside HandleEvent) or while
+// the loop is stopped.  Any events for the handler that are
+// still pending in the current batch are dropped, so the handler
+// is told it has been removed before this returns.
+
+void TTEpollReactor::Remove(int fd, TTReactorHandler * handler)
+{
+   struct epoll_event ev;
+   TT_CountSyscall();
+   epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+   for ( int i = event_index + 1; i < event_count; i++ ) {
+      if ( events[i].data.ptr == (void*)handler ) events[i].data.ptr = NULL;
+   }
+   handler->HandleRemoved();
+}
+
+//
+// Run
+//
+// Do the thread loop here.
+
+void TTEpollReactor::Run()
+{
+   int retVal;
+   int mask;
+   TTReactorHandler * handler;
+
+   while ( !stop ) {
+      TT_CountSyscall();
+      retVal = epoll_wait(epoll_fd, events, TT_REACTOR_MAX_EVENTS, -1);
+      if ( retVal < 0 ) {
+         if ( errno == EINTR ) continue;
+         TT_Error("TTEpollReactor::Run() epoll_wait failed");
+         break;
+      }
+
+      event_count = retVal;
+      for ( event_index = 0; event_index < event_count; event_index++ ) {
+         handler = (TTReactorHandler*)events[event_index].data.ptr;
+         if ( !handler ) continue;
+
+         mask = 0;
+         if ( events[event_index].events & (EPOLLIN | EPOLLRDHUP) ) mask |= TT_EVENT_READ;
+         if ( events[event_index].events & EPOLLOUT ) mask |= TT_EVENT_WRITE;
+         if ( events[event_index].events & (EPOLLERR | EPOLLHUP) ) mask |= TT_EVENT_ERROR;
+         handler->HandleEvent(mask);
+      }
+      event_count = 0;
+      event_index = 0;
+   }
+}
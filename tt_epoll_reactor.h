@@ -0,0 +1,50 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTEpollReactor - readiness engine for TTReactor.  An edge-triggered 
+// epoll loop, so a handler must drain its descriptor (read until it 
+// would block) each time it is called.
+//
+// Part of the TTools package.
+
+#ifndef __tt_epoll_reactor_h
+#define __tt_epoll_reactor_h
+
+#ifdef WIN32
+#else
+#include <sys/epoll.h>
+#endif
+
+#include "ttools/tt_reactor.h"
+
+const int TT_REACTOR_MAX_EVENTS = 256;
+
+class TTEpollReactor : public TTReactor {
+
+public:
+
+   TTEpollReactor();
+   ~TTEpollReactor();
+
+   virtual int Engine() { return TT_ENGINE_EPOLL; }
+
+   virtual bool Add(int fd, TTReactorHandler * handler);
+   virtual void Remove(int fd, TTReactorHandler * handler);
+
+protected:
+
+   virtual bool Ready();
+   virtual void Wake();
+   virtual void Run();
+
+private:
+
+   int epoll_fd;
+   int wake_fd;
+   int event_index;
+   int event_count;
+   struct epoll_event events[TT_REACTOR_MAX_EVENTS];
+};
+
+#endif // __tt_epoll_reactor_h
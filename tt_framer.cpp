@@ -0,0 +1,132 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTFramer - splits a received byte stream into length prefixed
+// messages, or lines.
+//
+// Part of the TTools package.
+
+#include "ttools/tt_framer.h"
+#include "ttools/tt_functions.h"
+
+//
+// Create a framer for the given format, taking messages of up to
+// mx bytes.
+
+TTFramer::TTFramer(int fmt, long int mx)
+{
+   format = fmt;
+   max = mx;
+   need = 0;
+   scanned = 0;
+}
+
+//
+// Next
+//
+// Look for a complete message at the start of buf, which holds len
+// bytes.  Returns one of three responses:
+//
+//    >0 : the bytes the message takes up in buf, prefix or line end
+//         included.  The message itself is *length bytes from
+//         *offset.
+//     0 : the message isn't all there yet, Need() says how many
+//         bytes it takes in all when the prefix is there to tell
+//    <0 : the prefix is broken or the message too long
+//
+// A line not yet ended is remembered as scanned as far as len, so
+// buf must start at the same place until a message is returned.
+
+long int TTFramer::Next(const unsigned char * buf, long int len, long int * offset, long int * length)
+{
+   long int size = 0;
+   int header = 0;
+   need = len + 1;
+
+   if ( format == TT_FRAME_LINE ) {
+      if ( scanned > len ) scanned = 0;
+      long int end = TT_FindByte(buf + scanned, len - scanned, '\n');
+      if ( end < 0 ) {
+         // a \r at the end may be the start of the line end.
+         scanned = len;
+         size = ( len > 0 && buf[len - 1] == '\r' ) ? len - 1 : len;
+         return ( size > max ) ? -1 : 0;
+      }
+      end += scanned;
+      scanned = 0;
+      size = ( end > 0 && buf[end - 1] == '\r' ) ? end - 1 : end;
+      if ( size > max ) return -1;
+      *offset = 0;
+      *length = size;
+      return end + 1;
+   }
+   else if ( format == TT_FRAME_16 ) {
+      if ( len < 2 ) return 0;
+      size = ((long int)buf[0] << 8) | buf[1];
+      header = 2;
+   }
+   else if ( format == TT_FRAME_32 ) {
+      if ( len < 4 ) return 0;
+      size = ((long int)buf[0] << 24) | ((long int)buf[1] << 16) | ((long int)buf[2] << 8) | buf[3];
+      header = 4;
+   }
+   else if ( format == TT_FRAME_VARINT ) {
+      unsigned char byte;
+      do {
+         if ( header >= len ) return 0;
+         if ( header >= TT_FRAME_HEADER_MAX ) return -1;
+         byte = buf[header];
+         size |= (long int)(byte & 0x7f) << (7 * header);
+         header++;
+      } while ( byte & 0x80 );
+   }
+   else return -1;
+
+   if ( size > max ) return -1;
+   need = header + size;
+   if ( len < need ) return 0;
+   *offset = header;
+   *length = size;
+   return need;
+}
+
+//
+// Header
+//
+// Write the length prefix for a message of length bytes into
+// header, which has room for TT_FRAME_HEADER_MAX bytes.  Returns
+// the size of the prefix, none for a line, or -1 if the length won't
+// fit the format.
+
+int TTFramer::Header(int format, long int length, unsigned char * header)
+{
+   if ( length < 0 ) return -1;
+   if ( format == TT_FRAME_LINE ) return 0;
+   if ( format == TT_FRAME_16 ) {
+      if ( length > 0xffff ) return -1;
+      header[0] = (unsigned char)((length >> 8) & 0xff);
+      header[1] = (unsigned char)(length & 0xff);
+      return 2;
+   }
+   if ( format == TT_FRAME_32 ) {
+      if ( length > 0xffffffffL ) return -1;
+      header[0] = (unsigned char)((length >> 24) & 0xff);
+      header[1] = (unsigned char)((length >> 16) & 0xff);
+      header[2] = (unsigned char)((length >> 8) & 0xff);
+      header[3] = (unsigned char)(length & 0xff);
+      return 4;
+   }
+   if ( format == TT_FRAME_VARINT ) {
+      if ( length > 0xffffffffL ) return -1;
+      int size = 0;
+      do {
+         header[size] = (unsigned char)(length & 0x7f);
+         length >>= 7;
+         if ( length ) header[size] |= 0x80;
+         size++;
+      } while ( length );
+      return size;
+   }
+   return -1;
+}
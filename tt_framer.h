@@ -0,0 +1,69 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTFramer - splits a received byte stream into length prefixed
+// messages, or lines.  A channel with a framer gets one
+// TT_NOTIFY_MESSAGE per complete message instead of TT_NOTIFY_IN,
+// the data being a TTMessage that points straight into the receive
+// buffer.  Nothing is copied or allocated per message, the message
+// is only valid during the notification, and the framer takes it
+// out of the buffer once the notification returns.
+//
+// The length prefix counts the bytes after it and is one of
+//
+//    TT_FRAME_16     : two bytes, high byte first, as AddShort()
+//    TT_FRAME_32     : four bytes, high byte first, as AddLong()
+//    TT_FRAME_VARINT : base 128, low seven bits first, the top bit
+//                      set on every byte but the last
+//
+// or there is no prefix and TT_FRAME_LINE ends each message with \n 
+// or \r\n, which isn't part of the message.  The search for the end 
+// of a line picks up where the last one left off, so a long line 
+// arriving in many pieces is only scanned once, see TT_FindByte().
+//
+// A length over the framer's maximum, or a line longer than it, is 
+// taken as a broken stream.
+//
+// Part of the TTools package.
+
+#ifndef __tt_framer_h
+#define __tt_framer_h
+
+const int TT_FRAME_NONE = 0;
+const int TT_FRAME_16 = 1;
+const int TT_FRAME_32 = 2;
+const int TT_FRAME_VARINT = 3;
+const int TT_FRAME_LINE = 4;
+const long int TT_FRAME_MAX = 16777216;  // default largest message
+const int TT_FRAME_HEADER_MAX = 5;       // a varint for 32 bits
+
+class TTMessage {
+
+public:
+
+   unsigned char * data;
+   long int length;
+};
+
+class TTFramer {
+
+public:
+
+   TTFramer(int fmt, long int mx = TT_FRAME_MAX);
+
+   int Format() { return format; }
+   long int Need() { return need; }
+   long int Next(const unsigned char * buf, long int len, long int * offset, long int * length);
+
+   static int Header(int format, long int length, unsigned char * header);
+
+private:
+
+   int format;
+   long int max;
+   long int need;
+   long int scanned;
+};
+
+#endif // __tt_framer_h
@@ -13,10 +13,29 @@
 #include <windows.h>
 #else
 #include <unistd.h>
+#include <time.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TT_SIMD_X86
 #endif
 
 using namespace std;
 
+//
+// One thread's system call count, on its own cache line.  Counters 
+// are never freed, a thread that has gone still counts.
+
+struct TTSyscallCounter {
+   volatile long int count;
+   TTSyscallCounter * next;
+   char pad[48];
+};
+
+static TTSyscallCounter * volatile tt_syscall_counters = NULL;
+static __thread TTSyscallCounter * tt_syscall_counter = NULL;
+
 void TT_Slice()
 {
 #ifdef WIN32
@@ -52,6 +71,67 @@ char * TT_StringFromBuffer(unsigned char * buf, int offset, int len)
    return str;
 }
 
+//
+// TT_FindByte
+//
+// Returns the offset of the first byte in buffer's len bytes, or -1 
+// if there is none.  On x86 it compares 32 bytes at a time with AVX2 
+// where the processor has it, else 16 at a time with SSE2, and byte 
+// by byte elsewhere.
+
+static long int FindByteScalar(const unsigned char * buffer, long int len, unsigned char byte)
+{
+   for ( long int i = 0; i < len; i++ ) {
+      if ( buffer[i] == byte ) return i;
+   }
+   return -1;
+}
+
+#ifdef TT_SIMD_X86
+__attribute__((target("sse2")))
+static long int FindByteSSE2(const unsigned char * buffer, long int len, unsigned char byte)
+{
+   __m128i want = _mm_set1_epi8((char)byte);
+   long int i = 0;
+   for ( ; i + 16 <= len; i += 16 ) {
+      __m128i block = _mm_loadu_si128((const __m128i*)(buffer + i));
+      int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, want));
+      if ( mask ) return i + __builtin_ctz(mask);
+   }
+   long int rest = FindByteScalar(buffer + i, len - i, byte);
+   return rest < 0 ? -1 : i + rest;
+}
+
+__attribute__((target("avx2")))
+static long int FindByteAVX2(const unsigned char * buffer, long int len, unsigned char byte)
+{
+   __m256i want = _mm256_set1_epi8((char)byte);
+   long int i = 0;
+   for ( ; i + 32 <= len; i += 32 ) {
+      __m256i block = _mm256_loadu_si256((const __m256i*)(buffer + i));
+      unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, want));
+      if ( mask ) return i + __builtin_ctz(mask);
+   }
+   long int rest = FindByteSSE2(buffer + i, len - i, byte);
+   return rest < 0 ? -1 : i + rest;
+}
+#endif
+
+long int TT_FindByte(const unsigned char * buffer, long int len, unsigned char byte)
+{
+#ifdef TT_SIMD_X86
+   // the answer never changes, so threads racing to set it is harmless.
+   static int level = -1;
+   if ( level < 0 ) {
+      __builtin_cpu_init();
+      level = __builtin_cpu_supports("avx2") ? 2 : __builtin_cpu_supports("sse2") ? 1 : 0;
+   }
+   if ( level == 2 ) return FindByteAVX2(buffer, len, byte);
+   if ( level == 1 ) return FindByteSSE2(buffer, len, byte);
+#endif
+   return FindByteScalar(buffer, len, byte);
+}
+
 //
 // TT_IntegerToString
 //
@@ -67,6 +147,51 @@ char * TT_IntegerToString(int num)
    return newStr;
 }
 
+//
+// TT_CountSyscall
+//
+// Count system calls made on the library's I/O paths so the 
+// engines can be compared.  Each thread counts on its own, so the 
+// loops never share a cache line for it, and TT_SyscallCount() adds 
+// them up.
+
+void TT_CountSyscall(int count)
+{
+   TTSyscallCounter * counter = tt_syscall_counter;
+   if ( !counter ) {
+      counter = new TTSyscallCounter();
+      counter->count = 0;
+      do counter->next = tt_syscall_counters;
+      while ( !__sync_bool_compare_and_swap(&tt_syscall_counters, counter->next, counter) );
+      tt_syscall_counter = counter;
+   }
+   __atomic_store_n(&counter->count, counter->count + count, __ATOMIC_RELAXED);
+}
+
+long int TT_SyscallCount()
+{
+   long int total = 0;
+   TTSyscallCounter * counter = __atomic_load_n(&tt_syscall_counters, __ATOMIC_ACQUIRE);
+   for ( ; counter; counter = counter->next ) total += __atomic_load_n(&counter->count, __ATOMIC_RELAXED);
+   return total;
+}
+
+//
+// TT_Now
+//
+// The monotonic clock in nanoseconds.
+
+long long TT_Now()
+{
+#ifdef WIN32
+   return (long long)GetTickCount64() * 1000000LL;
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
 //
 // TT_Debug
 
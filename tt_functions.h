@@ -20,5 +20,11 @@ char * TT_IntegerToString(int num);
 
 unsigned short TT_ShortFromBuffer(unsigned char * buffer, int offset);
 char * TT_StringFromBuffer(unsigned char * buffer, int offset, int len);
+long int TT_FindByte(const unsigned char * buffer, long int len, unsigned char byte);
+
+void TT_CountSyscall(int count = 1);
+long int TT_SyscallCount();
+
+long long TT_Now();
 
 #endif
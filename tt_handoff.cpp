@@ -0,0 +1,82 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTHandoff - lock-free queue for passing items to an event loop
+// from other threads.  Any number of threads may Push(), a single
+// consumer (the loop that owns the queue) calls Take() to detach
+// everything queued so far in one step.
+//
+// Producers push onto a stack with compare and swap, the consumer
+// swaps the whole stack out and reverses it.  Nodes are never
+// popped one at a time, so there is no ABA problem to worry about.
+//
+// Part of the TTools package.
+
+#include <cstddef>
+
+#include "ttools/tt_handoff.h"
+
+TTHandoffNode::TTHandoffNode(void * itm)
+{
+   next = NULL;
+   item = itm;
+}
+
+TTHandoff::TTHandoff()
+{
+   head = NULL;
+}
+
+//
+// Frees any nodes still queued.  The items themselves belong to
+// the caller, Take() them first if they need releasing.
+
+TTHandoff::~TTHandoff()
+{
+   TTHandoffNode * node = head;
+   TTHandoffNode * temp;
+   while ( node ) {
+      temp = node->next;
+      delete node;
+      node = temp;
+   }
+}
+
+//
+// Push
+//
+// Queue an item.  Safe from any thread.  Returns true if the
+// queue was empty beforehand.
+
+bool TTHandoff::Push(void * itm)
+{
+   TTHandoffNode * node = new TTHandoffNode(itm);
+   TTHandoffNode * old;
+   do {
+      old = head;
+      node->next = old;
+   } while ( !__sync_bool_compare_and_swap(&head, old, node) );
+   return old == NULL;
+}
+
+//
+// Take
+//
+// Detach every queued node and return them oldest first, or NULL
+// if the queue is empty.  Only the consumer may call this, and it
+// owns (and must delete) the nodes returned.
+
+TTHandoffNode * TTHandoff::Take()
+{
+   TTHandoffNode * node = __sync_lock_test_and_set(&head, (TTHandoffNode*)NULL);
+   TTHandoffNode * list = NULL;
+   TTHandoffNode * temp;
+   while ( node ) {
+      temp = node->next;
+      node->next = list;
+      list = node;
+      node = temp;
+   }
+   return list;
+}
@@ -0,0 +1,43 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTHandoff - lock-free queue for passing items to an event loop
+// from other threads.  Any number of threads may Push(), a single
+// consumer (the loop that owns the queue) calls Take() to detach
+// everything queued so far in one step.
+//
+// Push() returns true when the queue was empty, which is the only
+// time the consumer needs to be woken.
+//
+// Part of the TTools package.
+
+#ifndef __tt_handoff_h
+#define __tt_handoff_h
+
+class TTHandoffNode {
+
+public:
+
+   TTHandoffNode(void * itm);
+
+   TTHandoffNode * next;
+   void * item;
+};
+
+class TTHandoff {
+
+public:
+
+   TTHandoff();
+   ~TTHandoff();
+
+   bool Push(void * itm);
+   TTHandoffNode * Take();
+
+private:
+
+   TTHandoffNode * volatile head;
+};
+
+#endif // __tt_handoff_h
@@ -2,21 +2,35 @@
 // File     : $Id$
 // Author   : Trent McNair
 //
-// TTListener - threaded network listener.  Creates 
-// a thread that listens for incoming network connections, 
-// assigns them a TTSocket, and performs a callback.
+// TTListener - network listener.  Listens for incoming network 
+// connections, assigns them a TTSocket, and performs a callback.
 // The callback must take the allocated TTSocket and 
 // do *something* with it.  The callback handler is 
 // responsible for de-allocating the TTSocket.
 //
+// The listening socket is non-blocking and driven by a TTReactor, 
+// the listener's own epoll reactor if it isn't given one.  Each 
+// readiness event drains the accept queue with accept4().  With a 
+// completion reactor (io_uring) the reactor accepts with a multishot 
+// accept and calls HandleAccept() instead, Stop() must not be called 
+// from the reactor's thread in that case.
+//
+// Several listeners, each on its own reactor, can share a port with 
+// SO_REUSEPORT, the kernel then spreads the connections over them.  
+// Accepted sockets are passed on with the listener's tag as the 
+// notification's channel, so the owner can tell them apart.
+//
 // Part of the TTools package.
 
 #include <string.h>
 
 #ifdef WIN32
 #else
-#include <unistd.h> // for usleep
+#include <unistd.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <errno.h>
 #include <arpa/inet.h>  // inet_addr and other net db functions
 #endif
 
@@ -24,69 +38,130 @@
 #include "ttools/tt_notify.h"
 #include "ttools/tt_functions.h"
 #include "ttools/tt_socket.h"
-#include "ttools/tt_mutex.h"
+#include "ttools/tt_semaphore.h"
 
-TTListener::TTListener(TTNotify * ttn)
+TTListener::TTListener(TTNotify * ttn, TTReactor * rct, long int tg)
 {
-   thread_id = 0;
+   tag = tg;
+   reuse_port = false;
+   own_reactor = ( rct == NULL );
+   if ( own_reactor ) reactor = TTReactor::Create(TT_ENGINE_EPOLL);
+   else reactor = rct;
+   removed = new TTSemaphore(0);
+   accept_fd = -1;
    stop = false;
    port = 0;
+   backlog = TT_LISTEN_BACKLOG;
    interface = NULL;
+   shared = false;
+   options = NULL;
    notify = ttn;
    running = false;
 }
 
 TTListener::~TTListener()
 {
-   Stop(); // stop the listner and collect the thread.
+   Stop(); // stop the listener and let go of the socket.
+   if ( own_reactor ) delete reactor;
    delete [] interface;
+   delete options;
+   delete removed;
 }
 
 //
-// EntryPoint
-//
-// Private class where the thread is created.
+// Start listening on the given interface and port, with room for 
+// bcklg connections waiting to be accepted.  With reuse set the 
+// port may be shared with other listeners that set it too, opts 
+// tunes every socket accepted.  If the listener is already running 
+// it is stopped first.  Returns false if the port could not be 
+// opened.
 
-void * TTListener::EntryPoint(void* param)
-{
-   ((TTListener*)param)->Run();
-   return 0;
-}
-
-//
-// Start the listening thread.  If a thread is already 
-// running it will be killed.
-
-void TTListener::Start(char * ifc, int prt)
+bool TTListener::Start(char * ifc, int prt, int bcklg, bool reuse, const TTSocketOptions * opts)
 {
    Stop();
    
+   delete options;
+   options = NULL;
+   if ( opts ) options = new TTSocketOptions(*opts);
+   
    port = prt;
+   backlog = bcklg;
+   reuse_port = reuse;
+   delete [] interface;
    if ( ifc ) {
       interface = new char[strlen(ifc)+1];
       strcpy(interface, ifc);
    }
    else interface = NULL;
+   shared = TTSocket::SharedAddress(interface);
    
-   pthread_create(&thread_id, NULL, EntryPoint, (void*)this);
+   accept_fd = Open();
+   if ( accept_fd < 0 ) return false;
+   
+   bool ok;
+   TT_CountSyscall();
+   if ( listen(accept_fd, backlog) < 0 ) ok = false;
+   else if ( reactor->Completion() ) ok = reactor->Accept(accept_fd, this);
+   else ok = reactor->Add(accept_fd, this);
+   if ( !ok ) {
+      TT_Debug("TTListener::Start() could not start accepting");
+      close(accept_fd);
+      accept_fd = -1;
+      return false;
+   }
+   stop = false;
+   running = true;
+   return true;
 }
 
 //
-// Run
+// Open
 //
-// Do the thread loop here.
+// Create the non-blocking listening socket and bind it to our 
+// interface and port.  Returns the descriptor, or -1 on failure.
 
-void TTListener::Run()
+int TTListener::Open()
 {
-   // first, set up the listening socket.
-   int listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+   struct sockaddr_un localAddr;
+   int localLen = TTSocket::LocalAddress(interface, &localAddr);
+   if ( TTSocket::LocalPath(interface) && localLen < 0 ) {
+      TT_Debug("TTListener::Open() bad unix socket path");
+      return -1;
+   }
+   
+   int listenSocket = socket(localLen > 0 ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
    if ( listenSocket < 0 ) {
-      TT_Debug("TTListener::Run() error on listen socket allocation");
-      stop = false;
-      running = false;
-      return;
+      TT_Debug("TTListener::Open() error on listen socket allocation");
+      return -1;
+   }
+   
+   if ( localLen > 0 ) {
+      // a path can't be shared like a port, and the file of a 
+      // listener that went away would make the bind fail.
+      TTSocket::Apply(listenSocket, options);
+      struct stat st;
+      if ( localAddr.sun_path[0] && stat(localAddr.sun_path, &st) == 0 && S_ISSOCK(st.st_mode) ) {
+         unlink(localAddr.sun_path);
+      }
+      if ( bind(listenSocket, (struct sockaddr *)&localAddr, localLen) ) {
+         close(listenSocket);
+         return -1;
+      }
+      return listenSocket;
    }
    
+   int one = 1;
+   setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+   if ( reuse_port && setsockopt(listenSocket, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0 ) {
+      TT_Debug("TTListener::Open() SO_REUSEPORT not supported");
+      close(listenSocket);
+      return -1;
+   }
+   
+   // set before listen() so that connections are made with them, 
+   // each accepted socket is a copy of this one.
+   TTSocket::Apply(listenSocket, options);
+   
    // bind the socket to the specified port
    
    struct sockaddr_in sockAddr;
@@ -97,45 +172,87 @@ void TTListener::Run()
    sockAddr.sin_port = htons((u_short)port); 
    
    if(bind(listenSocket,(struct sockaddr *)&sockAddr, sizeof(sockAddr))) {
-      running = false;
-      stop = false;
-      return;
+      close(listenSocket);
+      return -1;
    }
-   
-   
+   return listenSocket;
+}
+
+//
+// HandleEvent
+//
+// Readiness reactors only.  The listening socket is edge triggered, 
+// so accept until the queue is empty.  Accepted sockets come back 
+// non-blocking, ready for the reactor.  Once Stop() has shut the 
+// socket down the accept fails and the socket leaves the reactor.
+
+void TTListener::HandleEvent(int events)
+{
    int tempSock;
-   struct sockaddr_in newAddr;
-   socklen_t newAddrLen;
-   memset(&newAddr,0,sizeof(newAddr));
-   TTSocket * tsock = NULL;
-   
-   while ( true ) {
    
-      if ( listen(listenSocket, 3) >= 0 ) {
-         // we have a connection
-         tempSock = accept(listenSocket,(struct sockaddr*) &newAddr, &newAddrLen);
-         if ( tempSock >= 0 ) {
-            tsock = new TTSocket(tempSock);
-            notify->Notify(0,TT_NOTIFY_ACCEPT, (void*)tsock);
-         }
+   while ( !stop ) {
+      TT_CountSyscall();
+      tempSock = accept4(accept_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if ( tempSock >= 0 ) {
+         HandleAccept(tempSock);
+         continue;
       }
-      else {
-         // TODO: handle error condition well
-         TT_Debug("TTListener::Run() error on listen, pausing...");
-         usleep(10);
+      if ( errno == EAGAIN || errno == EWOULDBLOCK ) return;
+      if ( errno == EINTR || errno == ECONNABORTED ) continue;
+      if ( errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM ) {
+         // out of descriptors, the next connection raises another 
+         // event.
+         TT_Debug("TTListener::HandleEvent() out of resources on accept");
+         return;
       }
-
-      if ( stop ) break;
+      break;
    }
-   running = false;
+   reactor->Remove(accept_fd, this);
 }
 
+//
+// HandleAccept
+//
+// Called for each accepted connection.
+
+void TTListener::HandleAccept(int fd)
+{
+   TTSocket * tsock = new TTSocket(fd);
+   tsock->SetShared(shared);
+   notify->Notify(tag,TT_NOTIFY_ACCEPT, (void*)tsock);
+}
+
+//
+// HandleRemoved
+//
+// The reactor has let go of the listening socket, let Stop() 
+// return.  Stop() closes it, so the descriptor can't be reused 
+// while Stop() still refers to it.
+
+void TTListener::HandleRemoved()
+{
+   removed->Up();
+}
+
+//
+// Stop listening.  Returns once the listening socket is closed, 
+// without waiting on a connection.  From a readiness reactor's own 
+// thread the socket is removed directly, from anywhere else it is 
+// shut down, which wakes the reactor to remove it.
+
 void TTListener::Stop()
 {
-   // wait on the thread, if there is one.
+   if ( accept_fd < 0 ) return;
    stop = true;
-   if ( thread_id != 0 ) pthread_join(thread_id,NULL);
+   
+   if ( reactor->Completion() ) reactor->Remove(accept_fd, this);
+   else if ( reactor->InLoop() ) reactor->Remove(accept_fd, this);
+   else shutdown(accept_fd, SHUT_RDWR);
+   removed->Down();
+   close(accept_fd);
+   accept_fd = -1;
    running = false;
-   thread_id = 0;
-   stop = false;
+   
+   const char * path = TTSocket::LocalPath(interface);
+   if ( path && path[0] != '@' ) unlink(path);
 }
@@ -2,53 +2,82 @@
 // File     : $Id$
 // Author   : Trent McNair
 //
-// TTListener - threaded network listener.  Creates 
-// a thread that listens for incoming network connections, 
-// assigns them a TTSocket, and performs a callback.
+// TTListener - network listener.  Listens for incoming network 
+// connections, assigns them a TTSocket, and performs a callback.
 // The callback must take the allocated TTSocket and 
 // do *something* with it.  The callback handler is 
 // responsible for de-allocating the TTSocket.
 //
+// The listening socket is non-blocking and driven by a TTReactor, 
+// the listener's own epoll reactor if it isn't given one.  Each 
+// readiness event drains the accept queue with accept4().  With a 
+// completion reactor (io_uring) the reactor accepts with a multishot 
+// accept and calls HandleAccept() instead, Stop() must not be called 
+// from the reactor's thread in that case.
+//
+// Several listeners, each on its own reactor, can share a port with 
+// SO_REUSEPORT, the kernel then spreads the connections over them.  
+// Options given to Start() are set on the listening socket, accepted 
+// sockets inherit them from it.
+//
+// An interface of the form unix:/path listens on a Unix domain 
+// socket at that path instead, the port then only names the 
+// listener.  A stale socket file left at the path is replaced, and 
+// the file is removed again by Stop().  Sockets accepted on a 
+// shm:/path are marked to set up shared memory with their peer.
+//
+// Accepted sockets are passed on with the listener's tag as the 
+// notification's channel, so the owner can tell them apart.
+//
 // Part of the TTools package.
 
 #ifndef __tt_listener_h
 #define __tt_listener_h
 
-#ifdef WIN32
-#else
-#include <pthread.h>
-#endif
+#include "ttools/tt_reactor.h"
 
 class TTNotify;
 class TTSocket;
-class TTMutex;
+class TTSocketOptions;
+class TTSemaphore;
+
+const int TT_LISTEN_BACKLOG = 4096;  // capped by net.core.somaxconn
 
-class TTListener {
+class TTListener : public TTReactorHandler {
 
 public:
 
-   TTListener(TTNotify * ttn);
+   TTListener(TTNotify * ttn, TTReactor * rct = NULL, long int tg = 0);
    ~TTListener();
    
-   void Start(char * ifc, int prt);
+   bool Start(char * ifc, int prt, int bcklg = TT_LISTEN_BACKLOG, bool reuse = false, const TTSocketOptions * opts = NULL);
    void Stop();
+   int Port() { return port; }
+   long int Tag() { return tag; }
    
+   virtual void HandleEvent(int events);
+   virtual void HandleAccept(int fd);
+   virtual void HandleRemoved();
 
-protected:
 
-   void Run();
-      
 private:
 
-   static void * EntryPoint(void *);
+   int Open();
 
    bool running;
-   bool stop;
+   volatile bool stop;
+   bool own_reactor;
+   bool reuse_port;
+   bool shared;
    int port;
+   int backlog;
+   long int tag;
    char * interface;
+   TTSocketOptions * options;
    TTNotify * notify;
-   pthread_t thread_id;
-   TTMutex * mutex;
+   TTReactor * reactor;
+   TTSemaphore * removed;
+   int accept_fd;
 };
 
 #endif
@@ -5,20 +5,34 @@
 // TTNetwork - class represents a network - a group of connected 
 // sockets and network listeners.  This class can be used to 
 // implement robust servers.
+//
+// The sockets run on one or more TTShard event loops rather than 
+// a thread per socket, see TTReactor.
 
 #include <cstddef>
-#include <iostream>
 
-using namespace std;
+#ifdef WIN32
+#else
+#include <unistd.h>
+#endif
 
 #include "ttools/tt_listener.h"
 #include "ttools/tt_network.h"
-#include "ttools/tt_hashtable.h"
+#include "ttools/tt_shard.h"
 #include "ttools/tt_socket.h"
 #include "ttools/tt_async_socket.h"
 #include "ttools/tt_functions.h"
-#include "ttools/tt_mutex.h"
+#include "ttools/tt_reactor.h"
 #include "ttools/tt_linked_list.h"
+#include "ttools/tt_mutex.h"
+#include "ttools/tt_resolver.h"
+#include "ttools/tt_pool.h"
+#include "ttools/tt_datagram_socket.h"
+#include "ttools/tt_hashtable.h"
+#include "ttools/tt_token_bucket.h"
+#include "ttools/tt_framer.h"
+#include "ttools/tt_ref_buffer.h"
+#include "ttools/tt_slot_map.h"
 
 //
 // This is the notify callback from the socket and listener 
@@ -33,56 +47,211 @@ void TTNetwork::DoNotify(long int channel, int type, void * data)
    
    if ( type == TT_NOTIFY_ACCEPT ) {
       TT_Debug("TTNetwork::DoNotify TT_NOTIFY_ACCEPT");
-      channel_source++;
-      TTAsyncSocket * ttas = new TTAsyncSocket(this,channel_source);
-      DoCleanup();
-      mutex->Lock();
-      sockets->Put(channel_source,(void*)ttas);
-      mutex->Unlock();
-      ttas->Connect((TTSocket*)data);
+      // a spread listener's tag names the shard it accepts for.
+      TTShard * shard = ( channel > 0 ) ? shards[channel - 1] : Assign();
+      TTAsyncSocket * ttas = shard->Open(NewChannel(shard));
+      if ( ttas ) ttas->Connect((TTSocket*)data);
+      else delete (TTSocket*)data;
    }
-   else if ( type == TT_NOTIFY_END ) {
-      // this socket is ready to be removed from the list
+   else if ( type == TT_NOTIFY_END && DropDatagram(channel) ) {
+      // a datagram channel has closed.
       notify->Notify(channel,type, data);
    }
+   else if ( type == TT_NOTIFY_END ) {
+      // this socket is ready to be removed from the list, ask 
+      // about the pool while it is surely still there.
+      bool pooled = Owner(channel)->Pooled(channel);
+      Owner(channel)->Ended(channel);
+      if ( !pooled || !pool->Filter(channel, type, data) ) notify->Notify(channel,type, data);
+   }
    else {
       TT_Debug("TTNetwork::DoNotify Other notification");
-      notify->Notify(channel,type, data);
+      // the pool keeps the notifications of channels it holds, the 
+      // rest never touch its lock.
+      bool pooled = ( channel > 0 && Owner(channel)->Pooled(channel) );
+      if ( !pooled || !pool->Filter(channel, type, data) ) notify->Notify(channel,type, data);
    }
 }
 
-TTNetwork::TTNetwork(TTNotify * ttn)
+//
+// Create a network.
+//
+//    ttn    : object to receive network notifications.
+//    engine : TT_ENGINE_EPOLL or TT_ENGINE_URING.
+//    shards : number of event loops, 0 for one per core.
+//
+// Each shard owns its own channels, the channel number says which, 
+// so no lock is shared between shards.  With more than one shard, 
+// notifications arrive on several threads at once.
+
+TTNetwork::TTNetwork(TTNotify * ttn, int engine, int count)
 {
    TT_Debug("TTNetwork::TTNetwork");
    notify = ttn;
-   sockets = new TTHashtable(521);
-   listener = new TTListener(this);
    channel_source = 0;
-   mutex = new TTMutex();
+   if ( count <= 0 ) count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+   if ( count <= 0 ) count = 1;
+   shard_count = count;
+   shard_next = 0;
+   shards = new TTShard*[shard_count];
+   send_limit = new TTTokenBucket();
+   recv_limit = new TTTokenBucket();
+   for ( int i = 0; i < shard_count; i++ ) {
+      shards[i] = new TTShard(this, i, shard_count, engine);
+      shards[i]->Share(send_limit, recv_limit);
+   }
+   resolver = new TTResolver(shards[0]->Reactor());
+   pool = new TTPool(this, shards[0]->Reactor());
+   
+   listeners = new TTLinkedList();
+   listen_mutex = new TTMutex();
+   listen_next = 0;
+   datagrams = new TTHashtable(521);
+   datagram_mutex = new TTMutex();
+   datagram_count = 0;
 }
 
 TTNetwork::~TTNetwork()
 {
    TT_Debug("TTNetwork::~TTNetwork");
    // TODO : Deallocate each item in the sockets list.
-   delete sockets;
-   delete listener;
+   pool->Stop();
+   ListenStop(0);
+   delete listeners;
+   delete listen_mutex;
+   for ( int i = 0; i < shard_count; i++ ) delete shards[i];
+   delete [] shards;
+   // after the loops, nothing can call into these now.  A datagram 
+   // channel still listed never got its end, so its loop's hold is 
+   // given back here along with ours.
+   datagram_mutex->Lock();
+   TTLinkedList * ttl = datagrams->Enumerate();
+   TTLinkedList * node;
+   TTDatagramSocket * dg;
+   while ( (node = ttl->Pop()) ) {
+      dg = (TTDatagramSocket*)node->item;
+      datagrams->Remove(dg->ID());
+      datagram_count--;
+      dg->Release();
+      dg->Release();
+      delete node;
+   }
+   delete ttl;
+   datagram_mutex->Unlock();
+   delete datagrams;
+   delete datagram_mutex;
+   delete pool;
+   delete resolver;
+   delete send_limit;
+   delete recv_limit;
+}
+
+//
+// Assign
+//
+// Pick the shard for a new channel, the one with the fewest live 
+// channels.  Ties go round robin so an idle network still spreads 
+// its channels out.
+
+TTShard * TTNetwork::Assign()
+{
+   int first = __sync_fetch_and_add(&shard_next, 1) % shard_count;
+   TTShard * best = shards[first];
+   TTShard * shard;
+   for ( int i = 1; i < shard_count; i++ ) {
+      shard = shards[(first + i) % shard_count];
+      if ( shard->Load() < best->Load() ) best = shard;
+   }
+   return best;
+}
+
+//
+// Owner
+//
+// Returns the shard that owns a channel.  Channel numbers are 
+// handed out so that the owner is the remainder by the shard 
+// count.
+
+TTShard * TTNetwork::Owner(long int channel)
+{
+   return shards[channel % shard_count];
+}
+
+long int TTNetwork::NewChannel(TTShard * shard)
+{
+   return shard->Reserve();
+}
+
+//
+// DatagramChannel
+//
+// Datagram channels aren't in any shard's table, they are numbered 
+// in the slot the tables never hand out so they can't clash with a 
+// socket's channel.
+
+long int TTNetwork::DatagramChannel(TTShard * shard)
+{
+   unsigned long sequence = __sync_add_and_fetch(&channel_source, 1) % ((1UL << TT_SLOT_GENERATION_BITS) - 1) + 1;
+   return TTSlotMap::Key(TT_SLOT_NONE, sequence) * shard_count + shard->Index();
 }
 
 //
 // Connect a socket to the given host an port. A TTNotify 
-// will be sent upon successful connect or connect failure.
+// will be sent upon successful connect or connect failure.  The 
+// connect never blocks the caller, it is abandoned if it hasn't 
+// finished within timeout milliseconds.  options, if given, are 
+// set on the socket before it connects.
+//
+// Host names are looked up by the network's TTResolver, so connects 
+// to the same host share one query and its cached answer.  A host of 
+// the form unix:/path connects to a Unix domain socket instead, with 
+// the same notifications as TCP, and shm:/path moves the data over a 
+// pair of shared memory rings, see TTSharedLink.  The listener must 
+// use shm: as well for that.
+
+long int TTNetwork::Connect(char * host, int port, int timeout, const TTSocketOptions * options)
+{
+   TTShard * shard = Assign();
+   long int channel = NewChannel(shard);
+   Dial(shard, channel, host, port, timeout, options);
+   return channel;
+}
+
+void TTNetwork::Dial(TTShard * shard, long int channel, char * host, int port, int timeout, const TTSocketOptions * options, bool pooled)
+{
+   TTAsyncSocket * ttas = shard->Open(channel);
+   if ( !ttas ) return;
+   if ( pooled ) ttas->SetPooled();
+   ttas->Connect(host,port,timeout,resolver,options);
+}
+
+//
+// Check out a pooled channel to the given host and port, an idle 
+// one if the pool has it or else a new connection.  Give it back 
+// with Checkin() when the exchange on it is over, or Disconnect() 
+// it if it is no good.  The idle channels are kept by a TTPool.
+
+long int TTNetwork::Checkout(char * host, int port, int timeout)
+{
+   return pool->Checkout(host, port, timeout);
+}
+
+//
+// Return a checked out channel to the pool.  Returns false if it 
+// was closed instead.
 
-long int TTNetwork::Connect(char * host, int port)
+bool TTNetwork::Checkin(long int channel)
 {
-   channel_source++;
-   TTAsyncSocket * ttas = new TTAsyncSocket(this,channel_source);
-   DoCleanup();
-   mutex->Lock();
-   sockets->Put(channel_source,(void*)ttas);
-   mutex->Unlock();
-   ttas->Connect(host,port);
-   return channel_source;
+   return pool->Checkin(channel);
+}
+
+//
+// Keep between minIdle and maxIdle idle connections to the given 
+// host and port, the minimum are connected straight away.
+
+void TTNetwork::PoolLimits(char * host, int port, int minIdle, int maxIdle)
+{
+   pool->Limits(host, port, minIdle, maxIdle);
 }
 
 //
@@ -90,49 +259,93 @@ long int TTNetwork::Connect(char * host, int port)
 
 void TTNetwork::Disconnect(long int chn)
 {
-   cout << "Disconnect channel0 " << chn << endl;
-   // Find the socket and send the data.
-   mutex->Lock();
-   cout << "Disconnect channel1 " << chn << endl;
-   TTAsyncSocket * ttas = NULL;
    TT_Debug("TTNetwork::Disconnect");
-   
-   ttas = (TTAsyncSocket*)sockets->Get(chn);
-   if ( ttas ) {
-      cout << "Disconnect channel2 " << chn << endl;
-      ttas->Disconnect();
-      cout << "Disconnect channel3 " << chn << endl;
+   if ( chn <= 0 ) return;
+   TTDatagramSocket * dg = Datagram(chn);
+   if ( dg ) {
+      dg->Close();
+      dg->Release();
    }
-   cout << "Disconnect channel4 " << chn << endl;
-   mutex->Unlock();
+   else Owner(chn)->Disconnect(chn);
 }
 
 //
-// Remove a disconnected socket, only called internally.
+// Returns the engine driving the network's sockets.  It is epoll 
+// when io_uring was asked for but the kernel doesn't support it.
 
-void TTNetwork::Remove(long int chn)
+int TTNetwork::Engine()
 {
-   cout << "Disconnect channel " << chn << endl;
-   // Find the socket and send the data.
-   mutex->Lock();
-   TTAsyncSocket * ttas = NULL;
-   
-   ttas = (TTAsyncSocket*)sockets->Get(chn);
-   if ( ttas ) {
-      sockets->Remove(chn);
-      delete ttas;
-   }
-   mutex->Unlock();
+   return shards[0]->Reactor()->Engine();
 }
 
-void TTNetwork::Listen(char * interface, int port)
+//
+// Listen for connections on the given interface and port, NULL 
+// for every interface.  backlog is how many connections may wait 
+// to be accepted on each listening socket.  With spread set every 
+// shard gets its own SO_REUSEPORT socket for the port.  options, if 
+// given, apply to every connection accepted on the port.  Returns 
+// false if the port could not be opened.
+//
+// A unix:/path interface listens on that path, port then only names 
+// it for ListenStop().  A path can't be spread.  shm:/path does the 
+// same and hands each connection shared memory rings, see Connect().
+
+bool TTNetwork::Listen(char * interface, int port, int backlog, bool spread, const TTSocketOptions * options)
 {
-   listener->Start(interface,port);
+   if ( TTSocket::LocalPath(interface) ) spread = false;
+   int count = spread ? shard_count : 1;
+   TTListener ** started = new TTListener*[count];
+   bool ok = true;
+   int i;
+   
+   listen_mutex->Lock();
+   for ( i = 0; i < count && ok; i++ ) {
+      if ( spread ) started[i] = new TTListener(this, shards[i]->Reactor(), i + 1);
+      else started[i] = new TTListener(this, shards[listen_next++ % shard_count]->Reactor());
+      ok = started[i]->Start(interface, port, backlog, spread, options);
+   }
+   
+   if ( ok ) {
+      for ( i = 0; i < count; i++ ) listeners->Insert((void*)started[i]);
+   }
+   else {
+      // one failed, take back the ones that started.
+      while ( i > 0 ) delete started[--i];
+   }
+   listen_mutex->Unlock();
+   delete [] started;
+   return ok;
 }
 
+//
+// Stop listening on a port, 0 for every port.  Connections already 
+// accepted carry on.
+
 void TTNetwork::ListenStop(int port)
 {
-   listener->Stop();
+   TTLinkedList * stopped = new TTLinkedList();
+   TTLinkedList * prev = listeners;
+   TTLinkedList * ttl;
+   TTListener * tl;
+   
+   listen_mutex->Lock();
+   while ( (ttl = prev->next) ) {
+      tl = (TTListener*)ttl->item;
+      if ( port == 0 || tl->Port() == port ) {
+         prev->next = ttl->next;
+         ttl->next = stopped->next;
+         stopped->next = ttl;
+      }
+      else prev = ttl;
+   }
+   listen_mutex->Unlock();
+   
+   // stopping waits on the loops, do it without the lock.
+   while ( (ttl = stopped->Pop()) ) {
+      delete (TTListener*)ttl->item;
+      delete ttl;
+   }
+   delete stopped;
 }
 
 //
@@ -141,76 +354,347 @@ void TTNetwork::ListenStop(int port)
 
 void TTNetwork::ShutdownNetwork()
 {
-   // STOP THE LISTENER(S)
+   // STOP THE LISTENER(S) AND THE POOL
    
-   listener->Stop();
+   pool->Stop();
+   ListenStop(0);
    
    // DISCONNECT EACH SOCKET
    
-   mutex->Lock();
+   for ( int i = 0; i < shard_count; i++ ) shards[i]->Shutdown();
    
-   TTLinkedList * ttl = sockets->Enumerate();
-   HashBucket * hb;
-   TTAsyncSocket * ts;
+   // AND EACH DATAGRAM CHANNEL
    
-   if ( ttl ) {
-      ttl = ttl->next;
-      while ( ttl ) {
-         hb = (HashBucket*)ttl->item;
-         ts = (TTAsyncSocket*)hb->value;
-         if ( ts ) ts->Disconnect();
-         ttl = ttl->next;
-      }
+   datagram_mutex->Lock();
+   TTLinkedList * ttl = datagrams->Enumerate();
+   TTLinkedList * node;
+   for ( node = ttl->next; node; node = node->next ) {
+      node->item = (void*)((TTDatagramSocket*)node->item)->ID();
    }
-   
-   mutex->Unlock();   
+   datagram_mutex->Unlock();
+   while ( (node = ttl->Pop()) ) {
+      Disconnect((long int)node->item);
+      delete node;
+   }
+   delete ttl;
 }
 
 //
-// Send some data on the given channel.
+// Send some data on the given channel.  Returns TT_SEND_FAILED if 
+// the channel is unknown, or TT_SEND_FULL if the data was queued but 
+// the channel has more than its high water mark waiting to go out.  
+// A caller told so should hold off until TT_NOTIFY_WRITABLE.  The 
+// other sends report the same way.
 
-bool TTNetwork::Send(long int channel, unsigned char * data, int dataLen)
+int TTNetwork::Send(long int channel, unsigned char * data, int dataLen)
 {
    TT_Debug("TTNetwork::Send 1");
-   TTAsyncSocket * ttas = NULL;
-   
-   // Find the socket and send the data.
-   mutex->Lock();
-   ttas = (TTAsyncSocket*)sockets->Get(channel);
-   if ( ttas ) {
-      ttas->Send(data,dataLen);
-      mutex->Unlock();
-      TT_Debug("TTNetwork::Send Sending data from TTNetwork::Send");
-      return true;
+   if ( channel <= 0 ) return TT_SEND_FAILED;
+   return Owner(channel)->Send(channel, data, dataLen);
+}
+
+//
+// Send several buffers on the given channel as though they were 
+// one, a header and its payload say, without gluing them together 
+// first.  The buffers may be reused as soon as this returns.
+
+int TTNetwork::SendV(long int channel, const struct iovec * iov, int count)
+{
+   if ( channel <= 0 || count <= 0 ) return TT_SEND_FAILED;
+   return Owner(channel)->SendV(channel, iov, count);
+}
+
+//
+// Shape
+//
+// Limit the given channel to sendRate bytes a second out and 
+// recvRate in, zero for no limit, see TTTokenBucket.  Returns false 
+// if the channel is unknown.
+
+bool TTNetwork::Shape(long int channel, long int sendRate, long int recvRate)
+{
+   if ( channel <= 0 ) return false;
+   return Owner(channel)->Shape(channel, sendRate, recvRate);
+}
+
+//
+// SendMessage
+//
+// Send data as one message, with a length prefix of the given 
+// TT_FRAME_* format in front, or a \n after it for TT_FRAME_LINE, 
+// for a peer that frames.  A line must not hold a \n itself.  
+// Returns TT_SEND_FAILED if the length doesn't fit the format.
+
+int TTNetwork::SendMessage(long int channel, int format, unsigned char * data, int dataLen)
+{
+   unsigned char header[TT_FRAME_HEADER_MAX];
+   int headerLen = TTFramer::Header(format, dataLen, header);
+   if ( headerLen < 0 ) return TT_SEND_FAILED;
+   struct iovec iov[2];
+   iov[0].iov_base = header;
+   iov[0].iov_len = headerLen;
+   iov[1].iov_base = data;
+   iov[1].iov_len = dataLen;
+   if ( format == TT_FRAME_LINE ) {
+      iov[0] = iov[1];
+      iov[1].iov_base = (void*)"\n";
+      iov[1].iov_len = 1;
    }
-   mutex->Unlock();
-   return false;
+   return SendV(channel, iov, 2);
+}
+
+//
+// Frame
+//
+// Deliver what the given channel receives as length prefixed 
+// messages, or lines, each one a TT_NOTIFY_MESSAGE with a 
+// TTMessage, instead of TT_NOTIFY_IN, see TTFramer.  format is one 
+// of the TT_FRAME_* formats, TT_FRAME_NONE going back to 
+// TT_NOTIFY_IN, and max the largest message taken, a longer one 
+// closes the channel.  Data received before the call is framed as 
+// well.  Returns false if the channel is unknown.
+
+bool TTNetwork::Frame(long int channel, int format, long int max)
+{
+   if ( channel <= 0 ) return false;
+   return Owner(channel)->Frame(channel, format, max);
+}
+
+//
+// FrameAll
+//
+// Frame every channel opened from now on, connected or accepted, 
+// as Frame() does.  Setting it before Listen() or Connect() means no 
+// data arrives ahead of the framing.
+
+void TTNetwork::FrameAll(int format, long int max)
+{
+   for ( int i = 0; i < shard_count; i++ ) shards[i]->FrameAll(format, max);
+}
+
+//
+// ShapeAll
+//
+// Limit the total rate of all the network's channels, on top of 
+// any limits of their own.  Zero for no limit.
+
+void TTNetwork::ShapeAll(long int sendRate, long int recvRate)
+{
+   send_limit->Set(sendRate);
+   recv_limit->Set(recvRate);
 }
 
 //
-// Cleanup any sockets that are marked as done.  This should be 
-// called regularly (perhapse each time a new socket is allocated) 
-// to cleanup unused memory and threads.
+// Send part of an open file on the given channel, in order with 
+// the data sent before and after it.  The file goes from the page 
+// cache to the socket without a copy through user space.  A length 
+// of zero or less sends to the end of the file.  The descriptor 
+// must stay open until TT_NOTIFY_FILE_DONE arrives for it.
 
-void TTNetwork::DoCleanup()
+int TTNetwork::SendFile(long int channel, int fd, long int offset, long int length)
 {
-   mutex->Lock();
-   TTLinkedList * ttl = sockets->Enumerate();
-   HashBucket * hb;
-   TTAsyncSocket * ts;
+   if ( channel <= 0 ) return TT_SEND_FAILED;
+   return Owner(channel)->SendFile(channel, fd, offset, length);
+}
+
+//
+// Send a buffer on the given channel without copying it, in order 
+// with the data sent before and after it.  The buffer must stay 
+// untouched until TT_NOTIFY_SEND_DONE arrives with it, which always 
+// follows unless this returns TT_SEND_FAILED.  Small buffers are 
+// copied anyway, see TT_ZEROCOPY_MIN, and are handed back straight 
+// away.
+
+int TTNetwork::SendZeroCopy(long int channel, unsigned char * data, int dataLen)
+{
+   if ( channel <= 0 ) return TT_SEND_FAILED;
+   return Owner(channel)->SendZeroCopy(channel, data, dataLen);
+}
+
+//
+// Broadcast
+//
+// Send one buffer to many channels.  Every channel queues the same 
+// TTRefBuffer, holding a reference until it has written it, so the 
+// data is never copied per channel and is freed once the last 
+// channel is done with it.  The caller drops its own reference when 
+// it likes, the buffer mustn't change after this.  Channels are 
+// grouped by shard, each shard taking its lock and waking its loop 
+// once for the lot.  Returns the number of channels the buffer was 
+// queued on, unknown channels are skipped.
+
+int TTNetwork::Broadcast(const long int * channels, int count, TTRefBuffer * buffer)
+{
+   if ( count <= 0 || !channels || !buffer ) return 0;
+   if ( shard_count == 1 ) return shards[0]->Broadcast(channels, count, buffer);
    
-   if ( ttl ) {
-      ttl = ttl->next;
-      while ( ttl ) {
-         hb = (HashBucket*)ttl->item;
-         ts = (TTAsyncSocket*)hb->value;
-         if ( ts && ts->Status() == TTAS_STATUS_CLOSED ) {
-            sockets->Remove(hb->ikey);
-            delete ts;
-         }
-         ttl = ttl->next;
+   long int * mine = new long int[count];
+   int sent = 0;
+   for ( int s = 0; s < shard_count; s++ ) {
+      int n = 0;
+      for ( int i = 0; i < count; i++ ) {
+         if ( channels[i] > 0 && Owner(channels[i]) == shards[s] ) mine[n++] = channels[i];
       }
+      sent += shards[s]->Broadcast(mine, n, buffer);
    }
+   delete [] mine;
+   return sent;
+}
+
+//
+// Watermarks
+//
+// Set the given channel's send queue watermarks in bytes, by 
+// default TT_HIGH_WATER and TT_LOW_WATER.  Returns false if the 
+// channel is unknown.
+
+bool TTNetwork::Watermarks(long int channel, long int high, long int low)
+{
+   if ( channel <= 0 ) return false;
+   return Owner(channel)->Watermarks(channel, high, low);
+}
+
+//
+// ReadLimit
+//
+// Stop reading the given channel while bytes or more of received 
+// data are left unread in its buffer, zero for no limit.  Data the 
+// owner pops during TT_NOTIFY_IN makes room straight away, data 
+// consumed any other way needs ResumeRead().  While a channel isn't 
+// reading the sender is held back by TCP flow control.  Returns 
+// false if the channel is unknown.
+
+bool TTNetwork::ReadLimit(long int channel, long int bytes)
+{
+   if ( channel <= 0 ) return false;
+   return Owner(channel)->ReadLimit(channel, bytes);
+}
+
+//
+// ResumeRead
+//
+// Start a channel stopped by its read limit reading again.  The 
+// owner gets TT_NOTIFY_IN with whatever is waiting first, stopped 
+// or not, and the channel stops again if that still isn't consumed.
+
+bool TTNetwork::ResumeRead(long int channel)
+{
+   if ( channel <= 0 ) return false;
+   return Owner(channel)->ResumeRead(channel);
+}
+
+//
+// SetOptions
+//
+// Tune the socket of an open channel.  Buffer sizes set this late 
+// may not take full effect.  Returns false if the channel is 
+// unknown.
+
+bool TTNetwork::SetOptions(long int channel, const TTSocketOptions * options)
+{
+   if ( channel <= 0 || !options ) return false;
+   return Owner(channel)->SetOptions(channel, options);
+}
+
+//
+// Open a UDP channel bound to the given interface, NULL for every 
+// interface, and port, 0 for any.  Received datagrams arrive as 
+// TT_NOTIFY_DATAGRAM, Disconnect() closes the channel.  With offload 
+// set the kernel may coalesce received datagrams, which saves work 
+// at high packet rates.  Returns the channel, or 0 if the port could 
+// not be opened.
+
+long int TTNetwork::OpenDatagram(char * interface, int port, bool offload)
+{
+   TTShard * shard = Assign();
+   long int channel = DatagramChannel(shard);
+   TTDatagramSocket * dg = new TTDatagramSocket(this, channel, shard->Reactor());
+   
+   // our hold, given back when the channel ends.
+   dg->Hold();
+   datagram_mutex->Lock();
+   datagrams->Put(channel, (void*)dg);
+   datagram_count++;
+   datagram_mutex->Unlock();
    
-   mutex->Unlock();
+   if ( !dg->Open(interface, port, offload) ) {
+      DropDatagram(channel);
+      dg->Release();
+      return 0;
+   }
+   return channel;
+}
+
+//
+// Datagram
+//
+// Find a datagram channel and hold it, or NULL if the channel isn't 
+// one.  The caller releases the hold.
+
+TTDatagramSocket * TTNetwork::Datagram(long int channel)
+{
+   if ( datagram_count == 0 ) return NULL;
+   datagram_mutex->Lock();
+   TTDatagramSocket * dg = (TTDatagramSocket*)datagrams->Get(channel);
+   if ( dg ) dg->Hold();
+   datagram_mutex->Unlock();
+   return dg;
+}
+
+//
+// DropDatagram
+//
+// Forget a datagram channel and give back our hold.  Returns false 
+// if the channel isn't one.
+
+bool TTNetwork::DropDatagram(long int channel)
+{
+   if ( datagram_count == 0 ) return false;
+   datagram_mutex->Lock();
+   TTDatagramSocket * dg = (TTDatagramSocket*)datagrams->Remove(channel);
+   if ( dg ) datagram_count--;
+   datagram_mutex->Unlock();
+   if ( !dg ) return false;
+   dg->Release();
+   return true;
+}
+
+//
+// Send a datagram on a UDP channel to ip (host byte order) and 
+// port.  With more set it may wait for the datagrams that follow so 
+// they all go out in one system call, the last of them must be sent 
+// without more.
+
+bool TTNetwork::SendDatagram(long int channel, unsigned long ip, int port, unsigned char * data, int dataLen, bool more)
+{
+   TTDatagramSocket * dg = Datagram(channel);
+   if ( !dg ) return false;
+   bool ok = dg->SendTo(ip, port, data, dataLen, more);
+   dg->Release();
+   return ok;
+}
+
+//
+// Send dataLen bytes on a UDP channel as datagrams of segment bytes 
+// each, cut up by the kernel where it can (UDP GSO).
+
+bool TTNetwork::SendSegments(long int channel, unsigned long ip, int port, unsigned char * data, int dataLen, int segment)
+{
+   TTDatagramSocket * dg = Datagram(channel);
+   if ( !dg ) return false;
+   bool ok = dg->SendSegments(ip, port, data, dataLen, segment);
+   dg->Release();
+   return ok;
+}
+
+//
+// Returns the local port of a UDP channel, 0 if it isn't one.
+
+int TTNetwork::DatagramPort(long int channel)
+{
+   TTDatagramSocket * dg = Datagram(channel);
+   if ( !dg ) return 0;
+   int port = dg->Port();
+   dg->Release();
+   return port;
 }
@@ -5,29 +5,72 @@
 // TTNetwork - class represents a network - a group of connected 
 // sockets and network listeners.  This class can be used to 
 // implement robust servers.
+//
+// The sockets run on one or more TTShard event loops rather than 
+// a thread per socket, see TTReactor.
 
 #ifndef __tt_network_h
 #define __tt_network_h
 
+#ifdef WIN32
+#else
+#include <sys/uio.h>    // struct iovec for SendV()
+#endif
+
 #include "ttools/tt_notify.h"
+#include "ttools/tt_reactor.h"
+#include "ttools/tt_listener.h"
+#include "ttools/tt_async_socket.h"
+#include "ttools/tt_framer.h"
 
+class TTLinkedList;
+class TTDatagramSocket;
 class TTHashtable;
-class TTListener;
 class TTMutex;
+class TTPool;
+class TTRefBuffer;
+class TTResolver;
+class TTShard;
+class TTSocketOptions;
+class TTTokenBucket;
 
 class TTNetwork : public TTNotify {
 
 public:
 
-   TTNetwork(TTNotify * ttn);
+   TTNetwork(TTNotify * ttn, int engine = TT_ENGINE_EPOLL, int shards = 1);
    ~TTNetwork();
    
-   long int Connect(char * host, int port);
+   long int Connect(char * host, int port, int timeout = TT_CONNECT_TIMEOUT, const TTSocketOptions * options = NULL);
    void Disconnect(long int chn);
-   void Listen(char * interface, int port);
+   long int Checkout(char * host, int port, int timeout = TT_CONNECT_TIMEOUT);
+   bool Checkin(long int channel);
+   void PoolLimits(char * host, int port, int minIdle, int maxIdle);
+   bool Listen(char * interface, int port, int backlog = TT_LISTEN_BACKLOG, bool spread = false, 
+               const TTSocketOptions * options = NULL);
    void ListenStop(int port);
    void ShutdownNetwork();
-   bool Send(long int channel, unsigned char * data, int dataLen);
+   int Send(long int channel, unsigned char * data, int dataLen);
+   int SendV(long int channel, const struct iovec * iov, int count);
+   int SendFile(long int channel, int fd, long int offset, long int length);
+   int SendZeroCopy(long int channel, unsigned char * data, int dataLen);
+   int Broadcast(const long int * channels, int count, TTRefBuffer * buffer);
+   bool Watermarks(long int channel, long int high, long int low);
+   bool ReadLimit(long int channel, long int bytes);
+   bool ResumeRead(long int channel);
+   bool SetOptions(long int channel, const TTSocketOptions * options);
+   bool Shape(long int channel, long int sendRate, long int recvRate);
+   void ShapeAll(long int sendRate, long int recvRate);
+   int SendMessage(long int channel, int format, unsigned char * data, int dataLen);
+   bool Frame(long int channel, int format, long int max = TT_FRAME_MAX);
+   void FrameAll(int format, long int max = TT_FRAME_MAX);
+   long int OpenDatagram(char * interface, int port, bool offload = false);
+   bool SendDatagram(long int channel, unsigned long ip, int port, unsigned char * data, int dataLen, bool more = false);
+   bool SendSegments(long int channel, unsigned long ip, int port, unsigned char * data, int dataLen, int segment);
+   int DatagramPort(long int channel);
+   int Engine();
+   int Shards() { return shard_count; }
+   TTResolver * Resolver() { return resolver; }
    
    virtual void DoNotify(long int channel, int type, void * data);
 
@@ -37,13 +80,30 @@ protected:
    
 private:
 
-   void Remove(long int channel);
-   void DoCleanup();
+   friend class TTPool;
+
+   TTShard * Assign();
+   TTShard * Owner(long int channel);
+   long int NewChannel(TTShard * shard);
+   long int DatagramChannel(TTShard * shard);
+   void Dial(TTShard * shard, long int channel, char * host, int port, int timeout, const TTSocketOptions * options = NULL, bool pooled = false);
+   TTDatagramSocket * Datagram(long int channel);
+   bool DropDatagram(long int channel);
    
    long int channel_source;
-   TTHashtable * sockets;
-   TTListener * listener;
-   TTMutex * mutex;
+   int shard_count;
+   int shard_next;
+   TTShard ** shards;
+   TTResolver * resolver;
+   TTPool * pool;
+   TTTokenBucket * send_limit;
+   TTTokenBucket * recv_limit;
+   TTLinkedList * listeners;
+   TTMutex * listen_mutex;
+   int listen_next;
+   TTHashtable * datagrams;
+   TTMutex * datagram_mutex;
+   volatile int datagram_count;
 };
 
 #endif //__tt_network_h
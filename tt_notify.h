@@ -13,6 +13,11 @@
 #define TT_NOTIFY_IN 4
 #define TT_NOTIFY_ACCEPT 5
 #define TT_NOTIFY_ERROR 6
+#define TT_NOTIFY_FILE_DONE 7   // data is the file descriptor
+#define TT_NOTIFY_SEND_DONE 8   // data is the buffer passed to SendZeroCopy
+#define TT_NOTIFY_DATAGRAM 9    // data is a TTDatagram
+#define TT_NOTIFY_WRITABLE 10   // the send queue has drained to its low water mark
+#define TT_NOTIFY_MESSAGE 11    // data is a TTMessage, see TTFramer
 
 class TTBuffer;
 class TTSocket;
@@ -0,0 +1,479 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTPool - pool of outbound connections for a TTNetwork, grouped by
+// host and port.  Checkout() hands out an idle connection to the
+// upstream when there is one and connects a new one when there
+// isn't, Checkin() gives it back for the next caller.  Each upstream
+// keeps between its minimum and maximum number of idle connections,
+// see Limits().
+//
+// While the pool holds a connection its notifications are kept from
+// the network's owner.  A held connection that closes is dropped, one
+// that receives data nobody asked for is closed, and idle connections
+// beyond the minimum close after TT_POOL_IDLE_TIMEOUT seconds.  A
+// timer on the reactor does the checks once a second and opens
+// connections to bring each upstream back up to its minimum.
+//
+// An upstream can also go without saying so, dropped by a firewall
+// or a NAT on the way.  Pooled connections run TCP keepalive, so such
+// a connection fails within a minute or so, and Checkout() checks an
+// idle connection's socket before handing it out.
+//
+// Part of the TTools package.
+
+#include <cstddef>
+#include <string.h>
+#include <stdio.h>
+
+#include "ttools/tt_pool.h"
+#include "ttools/tt_network.h"
+#include "ttools/tt_shard.h"
+#include "ttools/tt_socket.h"
+#include "ttools/tt_buffer.h"
+#include "ttools/tt_notify.h"
+#include "ttools/tt_hashtable.h"
+#include "ttools/tt_linked_list.h"
+#include "ttools/tt_mutex.h"
+#include "ttools/tt_functions.h"
+
+//
+// One upstream.  idle holds its idle connections, the most recently
+// checked in first.
+
+class TTPoolGroup {
+
+public:
+
+   TTPoolGroup(char * ky, char * hst, int prt)
+   {
+      key = new char[strlen(ky)+1];
+      strcpy(key, ky);
+      host = new char[strlen(hst)+1];
+      strcpy(host, hst);
+      port = prt;
+      min_idle = TT_POOL_MIN_IDLE;
+      max_idle = TT_POOL_MAX_IDLE;
+      timeout = TT_CONNECT_TIMEOUT;
+      idle = new TTLinkedList();
+      idle_count = 0;
+      shortfall = 0;
+   }
+   ~TTPoolGroup()
+   {
+      TTLinkedList * node;
+      while ( (node = idle->Pop()) ) delete node;
+      delete idle;
+      delete [] host;
+      delete [] key;
+   }
+
+   char * key;
+   char * host;
+   int port;
+   int min_idle;
+   int max_idle;
+   int timeout;
+   TTLinkedList * idle;
+   int idle_count;
+   int shortfall;
+};
+
+//
+// A pooled channel.  held is set while the pool has it, closing once
+// the pool has decided to close it and is waiting for the end.
+
+class TTPoolEntry {
+
+public:
+
+   TTPoolEntry(TTPoolGroup * grp, long int chn, bool hld)
+   {
+      group = grp;
+      channel = chn;
+      held = hld;
+      closing = false;
+      since = 0;
+   }
+
+   TTPoolGroup * group;
+   long int channel;
+   bool held;
+   bool closing;
+   long long since;
+};
+
+TTPool::TTPool(TTNetwork * net, TTReactor * rct)
+{
+   network = net;
+   reactor = rct;
+   stopped = false;
+   sweep = 0;
+   keepalive = new TTSocketOptions();
+   keepalive->keepalive_idle = TT_POOL_KEEPALIVE_IDLE;
+   keepalive->keepalive_interval = TT_POOL_KEEPALIVE_INTERVAL;
+   keepalive->keepalive_count = TT_POOL_KEEPALIVE_COUNT;
+   groups = new TTHashtable(521);
+   channels = new TTHashtable(DEFAULT_HASH_TABLE_SIZE);
+   mutex = new TTMutex();
+}
+
+//
+// The reactor must be stopped, or gone, before the pool is deleted.
+
+TTPool::~TTPool()
+{
+   TTLinkedList * ttl = channels->Enumerate();
+   TTLinkedList * node;
+   while ( (node = ttl->Pop()) ) {
+      delete (TTPoolEntry*)node->item;
+      delete node;
+   }
+   delete ttl;
+   ttl = groups->Enumerate();
+   while ( (node = ttl->Pop()) ) {
+      delete (TTPoolGroup*)node->item;
+      delete node;
+   }
+   delete ttl;
+   delete channels;
+   delete groups;
+   delete keepalive;
+   delete mutex;
+}
+
+//
+// Group
+//
+// Find the upstream for host and port, adding it if it is new.  The
+// mutex must be held.
+
+TTPoolGroup * TTPool::Group(char * host, int port)
+{
+   char * key = new char[strlen(host) + 16];
+   sprintf(key, "%s:%d", host, port);
+   TTPoolGroup * group = (TTPoolGroup*)groups->Get(key);
+   if ( !group ) {
+      group = new TTPoolGroup(key, host, port);
+      groups->Put(key, (void*)group);
+   }
+   delete [] key;
+
+   if ( sweep == 0 && !stopped ) sweep = reactor->Schedule(this, TT_POOL_CHECK);
+   return group;
+}
+
+//
+// Limits
+//
+// Set how many idle connections to keep to an upstream, and open
+// enough to reach the minimum now.
+
+void TTPool::Limits(char * host, int port, int minIdle, int maxIdle)
+{
+   if ( minIdle < 0 ) minIdle = 0;
+   if ( maxIdle < minIdle ) maxIdle = minIdle;
+
+   mutex->Lock();
+   TTPoolGroup * group = Group(host, port);
+   group->min_idle = minIdle;
+   group->max_idle = maxIdle;
+   int need = minIdle - group->idle_count;
+   mutex->Unlock();
+
+   Warm(group, need);
+}
+
+//
+// Checkout
+//
+// Returns a channel to host and port for the caller's use until
+// Checkin().  An idle connection is reused if there is one, or else
+// a new one is connected and the caller gets its
+// TT_NOTIFY_CONNECTED as usual.  Data may be sent on it straight
+// away either way.  An idle connection is checked first, one with
+// an error, a close or stray data waiting is closed and the next
+// one tried.
+
+long int TTPool::Checkout(char * host, int port, int timeout)
+{
+   TTLinkedList * dead = new TTLinkedList();
+   TTLinkedList * node;
+   TTPoolEntry * entry;
+   long int channel = 0;
+
+   mutex->Lock();
+   TTPoolGroup * group = Group(host, port);
+   group->timeout = timeout;
+   while ( !channel && (node = group->idle->Pop()) ) {
+      entry = (TTPoolEntry*)node->item;
+      delete node;
+      group->idle_count--;
+      // the upstream may have gone since, or be going.
+      if ( network->Owner(entry->channel)->Alive(entry->channel) ) {
+         entry->held = false;
+         channel = entry->channel;
+      }
+      else {
+         entry->closing = true;
+         dead->Insert((void*)entry->channel);
+      }
+   }
+   mutex->Unlock();
+
+   while ( (node = dead->Pop()) ) {
+      TT_Debug("TTPool::Checkout() idle connection failed its check");
+      network->Disconnect((long int)node->item);
+      delete node;
+   }
+   delete dead;
+
+   if ( channel ) return channel;
+   return Open(group, false, timeout);
+}
+
+//
+// Checkin
+//
+// Give a checked out channel back to the pool.  Returns false if
+// the pool closed it instead, because the upstream already has as
+// many idle connections as it keeps, or if it isn't a pooled
+// channel that is checked out.  Anything the caller still expects
+// on the channel must have arrived before it is checked in.
+
+bool TTPool::Checkin(long int channel)
+{
+   mutex->Lock();
+   TTPoolEntry * entry = (TTPoolEntry*)channels->Get(channel);
+   if ( !entry || entry->held ) {
+      mutex->Unlock();
+      return false;
+   }
+   TTPoolGroup * group = entry->group;
+   entry->held = true;
+   if ( stopped || group->idle_count >= group->max_idle ) {
+      entry->closing = true;
+      mutex->Unlock();
+      network->Disconnect(channel);
+      return false;
+   }
+   entry->since = TT_Now();
+   group->idle->Insert((void*)entry);
+   group->idle_count++;
+   mutex->Unlock();
+   return true;
+}
+
+//
+// Filter
+//
+// Sees the notifications of the channels the pool opened first, the
+// network only asks about those, so other channels never wait on
+// the pool's lock.  Returns true if the notification belongs to the
+// pool and must not be passed on.
+
+bool TTPool::Filter(long int channel, int type, void * data)
+{
+   mutex->Lock();
+   TTPoolEntry * entry = (TTPoolEntry*)channels->Get(channel);
+   if ( !entry ) {
+      mutex->Unlock();
+      return false;
+   }
+   bool held = entry->held;
+   if ( type == TT_NOTIFY_END ) {
+      Forget(entry);
+      mutex->Unlock();
+      return held;
+   }
+   if ( !held ) {
+      mutex->Unlock();
+      return false;
+   }
+
+   // sends made before the checkin still finish for the caller.
+   if ( type == TT_NOTIFY_FILE_DONE || type == TT_NOTIFY_SEND_DONE ) {
+      mutex->Unlock();
+      return false;
+   }
+
+   // an idle upstream has no business sending, don't trust it.
+   bool drop = false;
+   if ( type == TT_NOTIFY_IN ) {
+      TTBuffer * ttb = (TTBuffer*)data;
+      ttb->Pop(ttb->Size());
+      if ( !entry->closing ) {
+         TT_Debug("TTPool::Filter() unexpected data on an idle connection");
+         Unlink(entry);
+         entry->closing = true;
+         drop = true;
+      }
+   }
+   mutex->Unlock();
+
+   if ( drop ) network->Disconnect(channel);
+   return true;
+}
+
+//
+// Stop
+//
+// Stop the checks.  Connections are no longer kept once this is
+// called, checked in channels are closed.
+
+void TTPool::Stop()
+{
+   mutex->Lock();
+   stopped = true;
+   long int timer = sweep;
+   sweep = 0;
+   mutex->Unlock();
+   reactor->Cancel(timer);
+}
+
+//
+// Open
+//
+// Connect a new channel to an upstream, held by the pool or
+// checked out.
+
+long int TTPool::Open(TTPoolGroup * group, bool held, int timeout)
+{
+   TTShard * shard = network->Assign();
+   long int channel = network->NewChannel(shard);
+   TTPoolEntry * entry = new TTPoolEntry(group, channel, held);
+
+   // known before the socket exists, so no notification slips by.
+   mutex->Lock();
+   channels->Put(channel, (void*)entry);
+   mutex->Unlock();
+
+   network->Dial(shard, channel, group->host, group->port, timeout, keepalive, true);
+
+   if ( held ) {
+      // only offered once the channel exists, and if it didn't
+      // already fail.
+      mutex->Lock();
+      if ( channels->Get(channel) == (void*)entry && !entry->closing ) {
+         entry->since = TT_Now();
+         group->idle->Insert((void*)entry);
+         group->idle_count++;
+      }
+      mutex->Unlock();
+   }
+   return channel;
+}
+
+//
+// Warm
+//
+// Open count idle connections to an upstream.
+
+void TTPool::Warm(TTPoolGroup * group, int count)
+{
+   for ( int i = 0; i < count && !stopped; i++ ) Open(group, true, group->timeout);
+}
+
+//
+// Unlink
+//
+// Take a held entry off its upstream's idle list.  The mutex must be
+// held.
+
+void TTPool::Unlink(TTPoolEntry * entry)
+{
+   TTPoolGroup * group = entry->group;
+   TTLinkedList * prev = group->idle;
+   TTLinkedList * node;
+   while ( (node = prev->next) ) {
+      if ( node->item == (void*)entry ) {
+         prev->next = node->next;
+         delete node;
+         group->idle_count--;
+         return;
+      }
+      prev = node;
+   }
+}
+
+//
+// Forget
+//
+// The channel has ended, drop its entry.  The mutex must be held.
+
+void TTPool::Forget(TTPoolEntry * entry)
+{
+   if ( entry->held ) Unlink(entry);
+   channels->Remove(entry->channel);
+   delete entry;
+}
+
+//
+// HandleTimer
+//
+// The periodic check.  Close connections that have been idle too
+// long while the upstream has more than its minimum, then bring each
+// upstream back up to its minimum.
+
+void TTPool::HandleTimer(long int timer)
+{
+   TTLinkedList * expired = new TTLinkedList();
+   TTLinkedList * short_groups = new TTLinkedList();
+   TTLinkedList * node;
+
+   mutex->Lock();
+   if ( timer != sweep || stopped ) {
+      mutex->Unlock();
+      delete expired;
+      delete short_groups;
+      return;
+   }
+
+   long long limit = TT_Now() - TT_POOL_IDLE_TIMEOUT * 1000000000LL;
+   TTLinkedList * ttl = groups->Enumerate();
+   TTPoolGroup * group;
+   TTLinkedList * prev;
+   TTPoolEntry * entry;
+   while ( (node = ttl->Pop()) ) {
+      group = (TTPoolGroup*)node->item;
+      delete node;
+
+      // the oldest are at the back, keep the most recently used.
+      int keep = group->min_idle;
+      prev = group->idle;
+      int position = 0;
+      while ( (node = prev->next) ) {
+         entry = (TTPoolEntry*)node->item;
+         if ( position >= keep && entry->since < limit ) {
+            prev->next = node->next;
+            delete node;
+            group->idle_count--;
+            entry->closing = true;
+            expired->Insert((void*)entry->channel);
+         }
+         else {
+            prev = node;
+            position++;
+         }
+      }
+
+      group->shortfall = group->min_idle - group->idle_count;
+      if ( group->shortfall > 0 ) short_groups->Insert((void*)group);
+   }
+   delete ttl;
+   sweep = reactor->Schedule(this, TT_POOL_CHECK);
+   mutex->Unlock();
+
+   while ( (node = expired->Pop()) ) {
+      network->Disconnect((long int)node->item);
+      delete node;
+   }
+   delete expired;
+   while ( (node = short_groups->Pop()) ) {
+      group = (TTPoolGroup*)node->item;
+      Warm(group, group->shortfall);
+      delete node;
+   }
+   delete short_groups;
+}
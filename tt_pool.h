@@ -0,0 +1,80 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTPool - pool of outbound connections for a TTNetwork, grouped by
+// host and port.  Checkout() hands out an idle connection to the
+// upstream when there is one and connects a new one when there
+// isn't, Checkin() gives it back for the next caller.  Each upstream
+// keeps between its minimum and maximum number of idle connections,
+// see Limits().
+//
+// While the pool holds a connection its notifications are kept from
+// the network's owner.  A held connection that closes is dropped, one
+// that receives data nobody asked for is closed, and idle connections
+// beyond the minimum close after TT_POOL_IDLE_TIMEOUT seconds.  A
+// timer on the reactor does the checks once a second and opens
+// connections to bring each upstream back up to its minimum.
+//
+// An upstream can also go without saying so, dropped by a firewall
+// or a NAT on the way.  Pooled connections run TCP keepalive, so such
+// a connection fails within a minute or so, and Checkout() checks an
+// idle connection's socket before handing it out.
+//
+// Part of the TTools package.
+
+#ifndef __tt_pool_h
+#define __tt_pool_h
+
+#include "ttools/tt_reactor.h"
+
+class TTHashtable;
+class TTMutex;
+class TTNetwork;
+class TTPoolEntry;
+class TTPoolGroup;
+class TTSocketOptions;
+
+const int TT_POOL_MIN_IDLE = 0;
+const int TT_POOL_MAX_IDLE = 8;
+const int TT_POOL_IDLE_TIMEOUT = 30;   // seconds
+const int TT_POOL_CHECK = 1000;        // milliseconds between checks
+const int TT_POOL_KEEPALIVE_IDLE = 30;     // seconds quiet before probing
+const int TT_POOL_KEEPALIVE_INTERVAL = 10; // seconds between probes
+const int TT_POOL_KEEPALIVE_COUNT = 3;     // unanswered probes to give up
+
+class TTPool : public TTReactorHandler {
+
+public:
+
+   TTPool(TTNetwork * net, TTReactor * rct);
+   ~TTPool();
+
+   void Limits(char * host, int port, int minIdle, int maxIdle);
+   long int Checkout(char * host, int port, int timeout);
+   bool Checkin(long int channel);
+   bool Filter(long int channel, int type, void * data);
+   void Stop();
+
+   virtual void HandleEvent(int events) {};
+   virtual void HandleTimer(long int timer);
+
+private:
+
+   TTPoolGroup * Group(char * host, int port);
+   long int Open(TTPoolGroup * group, bool held, int timeout);
+   void Warm(TTPoolGroup * group, int count);
+   void Unlink(TTPoolEntry * entry);
+   void Forget(TTPoolEntry * entry);
+
+   bool stopped;
+   long int sweep;
+   TTHashtable * groups;
+   TTHashtable * channels;
+   TTSocketOptions * keepalive;
+   TTMutex * mutex;
+   TTNetwork * network;
+   TTReactor * reactor;
+};
+
+#endif // __tt_pool_h
@@ -0,0 +1,147 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTReactor - event loop that owns a set of socket descriptors and
+// dispatches their events to handlers from a single thread.
+//
+// Two engines are available.  TTEpollReactor is a readiness engine,
+// an edge-triggered epoll loop that calls HandleEvent() and leaves the
+// I/O to the handler.  TTUringReactor is a completion engine built on
+// io_uring, it does the accepts, receives and sends itself and hands
+// the results to the handler.  Create() builds the requested engine
+// and falls back to epoll when the kernel can't provide it.
+//
+// Every reactor also keeps one-shot timers for its handlers, see
+// TTTimers, which fire on the reactor's thread.
+//
+// Part of the TTools package.
+
+#include <cstddef>
+
+#include "ttools/tt_reactor.h"
+#include "ttools/tt_epoll_reactor.h"
+#include "ttools/tt_uring_reactor.h"
+#include "ttools/tt_timers.h"
+#include "ttools/tt_functions.h"
+
+TTReactor::TTReactor()
+{
+   stop = false;
+   running = false;
+   looping = false;
+   thread_id = 0;
+   timers = NULL;
+}
+
+TTReactor::~TTReactor()
+{
+   delete timers;
+}
+
+//
+// Create
+//
+// Build and start a reactor for the given engine.  If the engine
+// isn't supported by this kernel the epoll engine is used instead,
+// check Engine() on the result to see which one you got.
+
+TTReactor * TTReactor::Create(int engine)
+{
+   TTReactor * reactor = NULL;
+
+   if ( engine == TT_ENGINE_URING ) {
+      reactor = new TTUringReactor();
+      if ( reactor->Start() ) return reactor;
+      TT_Debug("TTReactor::Create() io_uring unavailable, using epoll");
+      delete reactor;
+   }
+
+   reactor = new TTEpollReactor();
+   if ( !reactor->Start() ) {
+      TT_Error("TTReactor::Create() could not start the reactor");
+   }
+   return reactor;
+}
+
+//
+// EntryPoint
+//
+// Private function where the thread is created.
+
+void * TTReactor::EntryPoint(void * param)
+{
+   TTReactor * reactor = (TTReactor*)param;
+   reactor->loop_id = pthread_self();
+   reactor->looping = true;
+   reactor->Run();
+   reactor->looping = false;
+   return 0;
+}
+
+//
+// Start the event loop thread.  Returns false if the loop is
+// already running or the engine could not be set up.
+
+bool TTReactor::Start()
+{
+   if ( running || !Ready() ) return false;
+   if ( !timers ) {
+      timers = new TTTimers();
+      if ( !Add(timers->Handle(), timers) ) {
+         TT_Error("TTReactor::Start() could not register the timers");
+      }
+   }
+   stop = false;
+   running = true;
+   if ( pthread_create(&thread_id, NULL, EntryPoint, (void*)this) != 0 ) {
+      running = false;
+      thread_id = 0;
+      return false;
+   }
+   return true;
+}
+
+//
+// Stop the event loop and wait for the thread to finish.
+// Descriptors that are still registered are left open.  Engines
+// must call this from their own destructor, the loop can't be
+// left running once the engine is gone.
+
+void TTReactor::Stop()
+{
+   if ( !running ) return;
+   stop = true;
+   Wake();
+   if ( thread_id != 0 ) pthread_join(thread_id, NULL);
+   thread_id = 0;
+   running = false;
+}
+
+//
+// Schedule
+//
+// Call handler->HandleTimer() from the loop in ms milliseconds.  
+// Returns the timer's id, for Cancel().
+
+long int TTReactor::Schedule(TTReactorHandler * handler, int ms)
+{
+   return timers->Schedule(handler, ms);
+}
+
+//
+// Cancel a timer, it won't fire after this returns unless it is 
+// firing on the loop right now.  Zero is ignored.
+
+void TTReactor::Cancel(long int timer)
+{
+   timers->Cancel(timer);
+}
+
+//
+// Returns true when called from the reactor's own thread.
+
+bool TTReactor::InLoop()
+{
+   return looping && pthread_equal(pthread_self(), loop_id);
+}
@@ -0,0 +1,135 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTReactor - event loop that owns a set of socket descriptors and
+// dispatches their events to handlers from a single thread.
+//
+// Two engines are available.  TTEpollReactor is a readiness engine,
+// an edge-triggered epoll loop that calls HandleEvent() and leaves the
+// I/O to the handler.  TTUringReactor is a completion engine built on
+// io_uring, it does the accepts, receives and sends itself and hands
+// the results to the handler.  Create() builds the requested engine
+// and falls back to epoll when the kernel can't provide it.
+//
+// Every reactor also keeps one-shot timers for its handlers, see
+// TTTimers, which fire on the reactor's thread.
+//
+// Part of the TTools package.
+
+#ifndef __tt_reactor_h
+#define __tt_reactor_h
+
+#ifdef WIN32
+#else
+#include <pthread.h>
+#endif
+
+#define TT_EVENT_READ 1
+#define TT_EVENT_WRITE 2
+#define TT_EVENT_ERROR 4
+
+struct sockaddr;
+class TTTimers;
+
+const int TT_ENGINE_EPOLL = 0;
+const int TT_ENGINE_URING = 1;
+
+class TTReactorHandler {
+
+public:
+
+   virtual ~TTReactorHandler() {};
+
+   // called from the reactor thread with a mask of TT_EVENT_*
+   // flags when the descriptor changes state.
+
+   virtual void HandleEvent(int events) = 0;
+
+   // completion engine callbacks, also on the reactor thread.
+   // HandleRecv gets a len <= 0 when the peer closed or the
+   // receive failed, the buffer is only valid during the call.
+   // Every SendZeroCopy() gets a HandleSendDone() and then a
+   // HandleZeroCopyDone() once its buffer may be reused, every
+   // ReadFile() a HandleFileRead().
+
+   virtual void HandleRecv(unsigned char * buf, int len) {};
+   virtual void HandleAccept(int fd) {};
+   virtual void HandleSendDone(int result) {};
+   virtual void HandleZeroCopyDone() {};
+   virtual void HandleConnect(int result) {};
+   virtual void HandleFileRead(int result) {};
+
+   // a timer set with Schedule() has fired.
+
+   virtual void HandleTimer(long int timer) {};
+
+   // a TTResolver request has been answered, ip is zero if the
+   // name did not resolve.
+
+   virtual void HandleResolved(long int request, unsigned long ip) {};
+
+   // called once the reactor holds no more references to the
+   // handler after Remove(), the handler may be deleted from here
+   // on.
+
+   virtual void HandleRemoved() {};
+};
+
+class TTReactor {
+
+public:
+
+   TTReactor();
+   virtual ~TTReactor();
+
+   static TTReactor * Create(int engine);
+
+   bool Start();
+   void Stop();
+   bool InLoop();
+
+   virtual int Engine() = 0;
+   virtual bool Completion() { return false; }
+
+   // readiness interface, every engine supports it.
+
+   virtual bool Add(int fd, TTReactorHandler * handler) = 0;
+   virtual void Remove(int fd, TTReactorHandler * handler) = 0;
+
+   // completion interface, only when Completion() is true.
+
+   virtual bool Recv(int fd, TTReactorHandler * handler) { return false; }
+   virtual void StopRecv(int fd, TTReactorHandler * handler) {};
+   virtual bool Accept(int fd, TTReactorHandler * handler) { return false; }
+   virtual bool Send(int fd, const unsigned char * buf, int len, TTReactorHandler * handler) { return false; }
+   virtual bool SendZeroCopy(int fd, const unsigned char * buf, int len, TTReactorHandler * handler) { return false; }
+   virtual bool Connect(int fd, const struct sockaddr * addr, int len, TTReactorHandler * handler) { return false; }
+   virtual bool ReadFile(int fd, int file, unsigned char * buf, int len, long int offset, TTReactorHandler * handler) { return false; }
+
+   // timers, from any thread.
+
+   long int Schedule(TTReactorHandler * handler, int ms);
+   void Cancel(long int timer);
+
+protected:
+
+   virtual bool Ready() = 0;
+   virtual void Wake() = 0;
+   virtual void Run() = 0;
+
+   bool stop;
+
+private:
+
+   TTTimers * timers;
+
+   static void * EntryPoint(void *);
+
+   bool running;
+   bool looping;
+   pthread_t thread_id;
+   pthread_t loop_id;
+};
+
+#endif // __tt_reactor_h
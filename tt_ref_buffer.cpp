@@ -0,0 +1,60 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTRefBuffer - an immutable, reference counted block of data shared
+// by the sockets sending it.
+//
+// Part of the TTools package.
+
+#include <string.h>
+
+#include "ttools/tt_ref_buffer.h"
+
+//
+// Create a block of len bytes for the caller to fill in, holding one 
+// reference.
+
+TTRefBuffer::TTRefBuffer(long int len)
+{
+   data = new unsigned char[len > 0 ? len : 1];
+   length = len;
+   refs = 1;
+}
+
+//
+// Create a block holding a copy of buf's len bytes, holding one 
+// reference.
+
+TTRefBuffer::TTRefBuffer(const unsigned char * buf, long int len)
+{
+   data = new unsigned char[len > 0 ? len : 1];
+   length = len;
+   refs = 1;
+   if ( len > 0 ) memcpy(data, buf, len);
+}
+
+TTRefBuffer::~TTRefBuffer()
+{
+   delete [] data;
+}
+
+//
+// Hold
+//
+// Take count more references.  Only a holder may take more.
+
+void TTRefBuffer::Hold(int count)
+{
+   __sync_fetch_and_add(&refs, count);
+}
+
+//
+// Drop
+//
+// Give up a reference, freeing the block with the last one.
+
+void TTRefBuffer::Drop()
+{
+   if ( __sync_sub_and_fetch(&refs, 1) == 0 ) delete this;
+}
@@ -0,0 +1,41 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTRefBuffer - an immutable, reference counted block of data that 
+// any number of sockets can send at once, see TTNetwork::Broadcast().  
+// Each socket it is queued on holds a reference until it has finished 
+// writing it, the block is freed when the last reference is dropped.
+//
+// The creator holds the first reference, fills the data in before 
+// handing the block out, and drops its reference once it no longer 
+// needs the block.  The count is updated atomically, so references 
+// may be dropped from any thread.
+//
+// Part of the TTools package.
+
+#ifndef __tt_ref_buffer_h
+#define __tt_ref_buffer_h
+
+class TTRefBuffer {
+
+public:
+
+   TTRefBuffer(long int len);
+   TTRefBuffer(const unsigned char * buf, long int len);
+
+   unsigned char * Data() { return data; }
+   long int Length() { return length; }
+   void Hold(int count = 1);
+   void Drop();
+
+private:
+
+   ~TTRefBuffer();
+
+   unsigned char * data;
+   long int length;
+   volatile int refs;
+};
+
+#endif // __tt_ref_buffer_h
@@ -0,0 +1,716 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTResolver - asynchronous host name resolver with a cache.  Names
+// are looked up in /etc/hosts first and then, unless the resolver is
+// in hosts only mode, with a DNS query for the A record sent over
+// UDP to the first nameserver in /etc/resolv.conf.  The query's
+// socket and its retry timer are driven by a TTReactor, nothing
+// blocks.
+//
+// Answers are cached for the TTL the server gave them, failures for
+// TT_RESOLVER_NEGATIVE_TTL seconds.  Lookups of a name that is
+// already being queried wait on the same query instead of sending
+// another.
+//
+// Resolve() may be called from any thread.  Answers that have to
+// wait come back through HandleResolved() on the resolver's reactor
+// thread, which may not be the caller's.  HandleResolved() is called
+// with the resolver locked, so it must be quick and must not call
+// back into the resolver.  Once Cancel() returns the handler won't
+// be called for that request.
+//
+// Part of the TTools package.
+
+#include <cstddef>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+
+#ifdef WIN32
+#else
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+#include "ttools/tt_resolver.h"
+#include "ttools/tt_slot_map.h"
+#include "ttools/tt_linked_list.h"
+#include "ttools/tt_mutex.h"
+#include "ttools/tt_functions.h"
+
+const int TT_DNS_MAX_NAME = 253;
+const int TT_DNS_MAX_MESSAGE = 1500;
+const int TT_DNS_TYPE_A = 1;
+const int TT_DNS_TYPE_CNAME = 5;
+const int TT_DNS_CLASS_IN = 1;
+
+//
+// A cached name.  While a query is out for it pending is set and
+// waiters holds the ids of the requests waiting on the answer.  An
+// ip of zero is a cached failure.
+
+class TTResolverEntry {
+
+public:
+
+   TTResolverEntry(char * nm)
+   {
+      name = new char[strlen(nm)+1];
+      strcpy(name, nm);
+      ip = 0;
+      expires = 0;
+      pending = false;
+      id = 0;
+      tries = 0;
+      sent = 0;
+      waiters = new TTLinkedList();
+   }
+   ~TTResolverEntry()
+   {
+      TTLinkedList * node;
+      while ( (node = waiters->Pop()) ) delete node;
+      delete waiters;
+      delete [] name;
+   }
+
+   char * name;
+   unsigned long ip;
+   long long expires;
+   bool pending;
+   unsigned short id;
+   int tries;
+   long long sent;
+   TTLinkedList * waiters;
+};
+
+//
+// An open addressed table of entries, keyed by name, or by query id
+// for the queries in flight.  Linear probing keeps a lookup to one
+// run of adjacent slots, with no chain to follow and nothing
+// allocated per entry.  The table doubles before it is half full,
+// and a removal shifts the rest of its run back over the hole rather
+// than leaving a marker behind.  It doesn't own the entries.
+
+class TTResolverTable {
+
+public:
+
+   TTResolverTable(bool ids)
+   {
+      by_id = ids;
+      capacity = 64;
+      count = 0;
+      slots = new TTResolverEntry*[capacity];
+      memset(slots, 0, capacity * sizeof(TTResolverEntry*));
+   }
+   ~TTResolverTable()
+   {
+      delete [] slots;
+   }
+
+   TTResolverEntry * Get(const char * name);
+   TTResolverEntry * Get(unsigned short id);
+   bool Put(TTResolverEntry * entry);
+   void Remove(TTResolverEntry * entry);
+   TTResolverEntry ** Entries();
+   long int Size() { return count; }
+
+private:
+
+   static unsigned long HashName(const char * name);
+   static unsigned long HashId(unsigned short id);
+   unsigned long Hash(TTResolverEntry * entry);
+   void Grow();
+
+   bool by_id;
+   TTResolverEntry ** slots;
+   long int capacity;
+   long int count;
+};
+
+//
+// FNV-1a over the name, and a multiplicative mix of the id, so
+// sequential ids still spread over the slots.
+
+unsigned long TTResolverTable::HashName(const char * name)
+{
+   unsigned long hash = 2166136261UL;
+   for ( ; *name; name++ ) hash = (hash ^ (unsigned char)*name) * 16777619UL;
+   return hash ^ (hash >> 15);
+}
+
+unsigned long TTResolverTable::HashId(unsigned short id)
+{
+   unsigned long hash = (unsigned long)id * 2654435761UL;
+   return hash ^ (hash >> 16);
+}
+
+unsigned long TTResolverTable::Hash(TTResolverEntry * entry)
+{
+   return by_id ? HashId(entry->id) : HashName(entry->name);
+}
+
+TTResolverEntry * TTResolverTable::Get(const char * name)
+{
+   long int mask = capacity - 1;
+   for ( long int i = HashName(name) & mask; slots[i]; i = (i + 1) & mask ) {
+      if ( strcmp(slots[i]->name, name) == 0 ) return slots[i];
+   }
+   return NULL;
+}
+
+TTResolverEntry * TTResolverTable::Get(unsigned short id)
+{
+   long int mask = capacity - 1;
+   for ( long int i = HashId(id) & mask; slots[i]; i = (i + 1) & mask ) {
+      if ( slots[i]->id == id ) return slots[i];
+   }
+   return NULL;
+}
+
+//
+// Add an entry.  Returns false if one with the same key is there.
+
+bool TTResolverTable::Put(TTResolverEntry * entry)
+{
+   if ( (by_id ? Get(entry->id) : Get(entry->name)) ) return false;
+   if ( (count + 1) * 2 > capacity ) Grow();
+   long int mask = capacity - 1;
+   long int i = Hash(entry) & mask;
+   while ( slots[i] ) i = (i + 1) & mask;
+   slots[i] = entry;
+   count++;
+   return true;
+}
+
+//
+// Take an entry out.  Each later entry of the run that may sit in
+// the hole, because its home slot isn't between the hole and where
+// it is, moves back into it, leaving a new hole behind.
+
+void TTResolverTable::Remove(TTResolverEntry * entry)
+{
+   long int mask = capacity - 1;
+   long int hole = Hash(entry) & mask;
+   while ( slots[hole] && slots[hole] != entry ) hole = (hole + 1) & mask;
+   if ( !slots[hole] ) return;
+
+   long int home;
+   for ( long int i = (hole + 1) & mask; slots[i]; i = (i + 1) & mask ) {
+      home = Hash(slots[i]) & mask;
+      if ( hole <= i ? (hole < home && home <= i) : (hole < home || home <= i) ) continue;
+      slots[hole] = slots[i];
+      hole = i;
+   }
+   slots[hole] = NULL;
+   count--;
+}
+
+//
+// Returns a NULL terminated copy of the entries, for walking the
+// table while changing it.  The caller deletes it.
+
+TTResolverEntry ** TTResolverTable::Entries()
+{
+   TTResolverEntry ** entries = new TTResolverEntry*[count + 1];
+   long int n = 0;
+   for ( long int i = 0; i < capacity; i++ ) {
+      if ( slots[i] ) entries[n++] = slots[i];
+   }
+   entries[n] = NULL;
+   return entries;
+}
+
+void TTResolverTable::Grow()
+{
+   TTResolverEntry ** old = slots;
+   long int oldCapacity = capacity;
+   capacity *= 2;
+   slots = new TTResolverEntry*[capacity];
+   memset(slots, 0, capacity * sizeof(TTResolverEntry*));
+
+   long int mask = capacity - 1;
+   long int j;
+   for ( long int i = 0; i < oldCapacity; i++ ) {
+      if ( !old[i] ) continue;
+      for ( j = Hash(old[i]) & mask; slots[j]; j = (j + 1) & mask );
+      slots[j] = old[i];
+   }
+   delete [] old;
+}
+
+//
+// Lower case a host name into key, which must hold
+// TT_DNS_MAX_NAME+1 bytes.  Returns false if it is too long.
+
+static bool TT_NameKey(const char * name, char * key)
+{
+   int len = strlen(name);
+   if ( len > 0 && name[len-1] == '.' ) len--;
+   if ( len <= 0 || len > TT_DNS_MAX_NAME ) return false;
+   for ( int i = 0; i < len; i++ ) key[i] = tolower((unsigned char)name[i]);
+   key[len] = 0;
+   return true;
+}
+
+//
+// Read a possibly compressed name from a DNS message at pos into
+// out, lower cased and dotted.  Returns the position after the name
+// or -1 if the message is malformed.
+
+static int TT_ReadName(const unsigned char * msg, int len, int pos, char * out)
+{
+   int end = -1;
+   int used = 0;
+   int jumps = 0;
+   while ( pos < len ) {
+      int label = msg[pos];
+      if ( label == 0 ) {
+         if ( end < 0 ) end = pos + 1;
+         out[used] = 0;
+         return end;
+      }
+      if ( (label & 0xC0) == 0xC0 ) {
+         if ( pos + 1 >= len || ++jumps > 16 ) return -1;
+         if ( end < 0 ) end = pos + 2;
+         pos = ((label & 0x3F) << 8) | msg[pos+1];
+         continue;
+      }
+      if ( pos + 1 + label > len || used + label + 1 > TT_DNS_MAX_NAME ) return -1;
+      if ( used > 0 ) out[used++] = '.';
+      for ( int i = 0; i < label; i++ ) out[used++] = tolower(msg[pos+1+i]);
+      pos += label + 1;
+   }
+   return -1;
+}
+
+//
+// Create a resolver.
+//
+//    rct : event loop that drives the queries.
+//    md  : TT_RESOLVE_DNS or TT_RESOLVE_HOSTS.
+
+TTResolver::TTResolver(TTReactor * rct, int md)
+{
+   reactor = rct;
+   mode = md;
+   sock = -1;
+   server_ip = 0;
+   server_port = 53;
+   next_id = (unsigned short)(TT_Now() & 0xFFFF);
+   sweep = 0;
+   hosts = new TTResolverTable(false);
+   cache = new TTResolverTable(false);
+   pending = new TTResolverTable(true);
+   live = new TTSlotMap();
+   mutex = new TTMutex();
+
+   LoadHosts();
+   if ( mode == TT_RESOLVE_DNS ) {
+      sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      if ( sock < 0 || !reactor->Add(sock, this) ) {
+         TT_Error("TTResolver::TTResolver() could not open the query socket");
+      }
+      LoadServer();
+   }
+}
+
+//
+// The reactor must be stopped, or gone, before the resolver is
+// deleted.
+
+TTResolver::~TTResolver()
+{
+   if ( sock >= 0 ) close(sock);
+
+   TTResolverEntry ** entries = cache->Entries();
+   for ( TTResolverEntry ** entry = entries; *entry; entry++ ) delete *entry;
+   delete [] entries;
+   entries = hosts->Entries();
+   for ( TTResolverEntry ** entry = entries; *entry; entry++ ) delete *entry;
+   delete [] entries;
+   delete cache;
+   delete pending;
+   delete hosts;
+   delete live;
+   delete mutex;
+}
+
+//
+// LoadHosts
+//
+// Read the IPv4 entries of /etc/hosts.  The first address given
+// for a name wins.
+
+void TTResolver::LoadHosts()
+{
+   FILE * fp = fopen("/etc/hosts", "r");
+   if ( !fp ) return;
+
+   char line[1024];
+   char key[TT_DNS_MAX_NAME+1];
+   char * token;
+   char * save;
+   TTResolverEntry * entry;
+   while ( fgets(line, sizeof(line), fp) ) {
+      char * hash = strchr(line, '#');
+      if ( hash ) *hash = 0;
+      token = strtok_r(line, " \t\r\n", &save);
+      if ( !token || inet_addr(token) == INADDR_NONE ) continue;
+      unsigned long ip = ntohl(inet_addr(token));
+      while ( (token = strtok_r(NULL, " \t\r\n", &save)) ) {
+         if ( !TT_NameKey(token, key) ) continue;
+         entry = new TTResolverEntry(key);
+         entry->ip = ip;
+         if ( !hosts->Put(entry) ) delete entry;
+      }
+   }
+   fclose(fp);
+}
+
+//
+// LoadServer
+//
+// Use the first IPv4 nameserver in /etc/resolv.conf, or the local
+// host if there isn't one.
+
+void TTResolver::LoadServer()
+{
+   char address[64];
+   strcpy(address, "127.0.0.1");
+
+   FILE * fp = fopen("/etc/resolv.conf", "r");
+   if ( fp ) {
+      char line[512];
+      char value[64];
+      while ( fgets(line, sizeof(line), fp) ) {
+         if ( sscanf(line, " nameserver %63s", value) == 1 && inet_addr(value) != INADDR_NONE ) {
+            strcpy(address, value);
+            break;
+         }
+      }
+      fclose(fp);
+   }
+   SetServer(address);
+}
+
+//
+// SetServer
+//
+// Send queries to the given nameserver, a dotted quad address.
+// Returns false if the address is no good.
+
+bool TTResolver::SetServer(char * address, int port)
+{
+   if ( sock < 0 || inet_addr(address) == INADDR_NONE ) return false;
+
+   struct sockaddr_in addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(port);
+   addr.sin_addr.s_addr = inet_addr(address);
+
+   mutex->Lock();
+   // a connected socket only hears from the server.
+   bool ok = ( connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0 );
+   if ( ok ) {
+      server_ip = ntohl(addr.sin_addr.s_addr);
+      server_port = port;
+   }
+   mutex->Unlock();
+   return ok;
+}
+
+//
+// Resolve
+//
+// Look up a host name.  If the answer is at hand, because the name
+// is an address, a hosts entry or cached, ip is set (zero if the
+// name doesn't resolve) and zero is returned.  Otherwise the
+// request's id is returned and handler->HandleResolved() gets the
+// answer later.
+
+long int TTResolver::Resolve(char * name, TTReactorHandler * handler, unsigned long * ip)
+{
+   *ip = 0;
+   if ( inet_addr(name) != INADDR_NONE ) {
+      *ip = ntohl(inet_addr(name));
+      return 0;
+   }
+   char key[TT_DNS_MAX_NAME+1];
+   if ( !TT_NameKey(name, key) ) return 0;
+
+   mutex->Lock();
+   TTResolverEntry * entry = hosts->Get(key);
+   if ( entry || mode == TT_RESOLVE_HOSTS ) {
+      if ( entry ) *ip = entry->ip;
+      mutex->Unlock();
+      return 0;
+   }
+
+   long long now = TT_Now();
+   entry = cache->Get(key);
+   if ( entry && !entry->pending && entry->expires > now ) {
+      *ip = entry->ip;
+      mutex->Unlock();
+      return 0;
+   }
+   if ( !entry ) {
+      if ( cache->Size() >= TT_RESOLVER_MAX_ENTRIES ) Prune();
+      entry = new TTResolverEntry(key);
+      cache->Put(entry);
+   }
+   if ( !entry->pending && !Query(entry) ) {
+      entry->ip = 0;
+      entry->expires = now + TT_RESOLVER_NEGATIVE_TTL * 1000000000LL;
+      mutex->Unlock();
+      return 0;
+   }
+
+   long int request = live->Reserve();
+   live->Put(request, (void*)handler);
+   entry->waiters->Insert((void*)request);
+   mutex->Unlock();
+   return request;
+}
+
+//
+// Cancel
+//
+// Forget a request, its handler won't be called.  Zero is ignored.
+
+void TTResolver::Cancel(long int request)
+{
+   if ( request == 0 ) return;
+   mutex->Lock();
+   live->Remove(request);
+   mutex->Unlock();
+}
+
+//
+// Query
+//
+// Send the first query for an entry and start the retry timer if
+// it isn't running.  The mutex must be held.
+
+bool TTResolver::Query(TTResolverEntry * entry)
+{
+   if ( sock < 0 || server_ip == 0 ) return false;
+
+   // find an id that isn't in use.
+   do {
+      entry->id = next_id++;
+   } while ( !pending->Put(entry) );
+   entry->pending = true;
+   entry->tries = 0;
+   Send(entry);
+
+   if ( sweep == 0 ) sweep = reactor->Schedule(this, TT_RESOLVER_RETRY);
+   return true;
+}
+
+//
+// Send
+//
+// Send, or resend, the A query for an entry.  The mutex must be
+// held.
+
+void TTResolver::Send(TTResolverEntry * entry)
+{
+   unsigned char msg[TT_DNS_MAX_NAME + 18];
+   int pos = 0;
+
+   // header: id, recursion desired, one question.
+   msg[pos++] = entry->id >> 8;
+   msg[pos++] = entry->id & 0xFF;
+   msg[pos++] = 0x01;
+   msg[pos++] = 0x00;
+   msg[pos++] = 0; msg[pos++] = 1;
+   memset(msg + pos, 0, 6);
+   pos += 6;
+
+   // the name as labels.
+   const char * label = entry->name;
+   const char * dot;
+   int len;
+   while ( *label ) {
+      dot = strchr(label, '.');
+      len = dot ? (int)(dot - label) : (int)strlen(label);
+      if ( len > 63 ) len = 63;
+      msg[pos++] = len;
+      memcpy(msg + pos, label, len);
+      pos += len;
+      label += len;
+      if ( *label == '.' ) label++;
+   }
+   msg[pos++] = 0;
+   msg[pos++] = 0; msg[pos++] = TT_DNS_TYPE_A;
+   msg[pos++] = 0; msg[pos++] = TT_DNS_CLASS_IN;
+
+   entry->tries++;
+   entry->sent = TT_Now();
+   TT_CountSyscall();
+   if ( send(sock, msg, pos, MSG_DONTWAIT) < 0 ) {
+      TT_Debug("TTResolver::Send() query not sent, will retry");
+   }
+}
+
+//
+// Answer
+//
+// Settle an entry and hand the answer to everyone waiting on it.
+// A ttl of zero answers the waiters without caching.  The mutex
+// must be held.
+
+void TTResolver::Answer(TTResolverEntry * entry, unsigned long ip, long int ttl)
+{
+   pending->Remove(entry);
+   entry->pending = false;
+   entry->ip = ip;
+   entry->expires = TT_Now() + (long long)ttl * 1000000000LL;
+
+   TTLinkedList * node;
+   TTReactorHandler * handler;
+   long int request;
+   while ( (node = entry->waiters->Pop()) ) {
+      request = (long int)node->item;
+      delete node;
+      handler = (TTReactorHandler*)live->Remove(request);
+      if ( handler ) handler->HandleResolved(request, ip);
+   }
+}
+
+//
+// HandleEvent
+//
+// Answers have arrived on the query socket.
+
+void TTResolver::HandleEvent(int events)
+{
+   unsigned char msg[TT_DNS_MAX_MESSAGE];
+   int len;
+   while ( true ) {
+      TT_CountSyscall();
+      len = recv(sock, msg, sizeof(msg), MSG_DONTWAIT);
+      if ( len < 0 ) return;
+      mutex->Lock();
+      Parse(msg, len);
+      mutex->Unlock();
+   }
+}
+
+//
+// Parse
+//
+// Match an answer to its query and settle the entry.  The lowest
+// TTL along the answer's CNAME chain is the one that counts.
+// Anything that doesn't match a pending query is dropped.  The
+// mutex must be held.
+
+void TTResolver::Parse(unsigned char * msg, int len)
+{
+   if ( len < 12 || !(msg[2] & 0x80) ) return;
+
+   unsigned short id = (msg[0] << 8) | msg[1];
+   TTResolverEntry * entry = pending->Get(id);
+   if ( !entry ) return;
+
+   int rcode = msg[3] & 0x0F;
+   int questions = (msg[4] << 8) | msg[5];
+   int answers = (msg[6] << 8) | msg[7];
+   char name[TT_DNS_MAX_NAME+1];
+   int pos = 12;
+
+   if ( questions != 1 ) return;
+   pos = TT_ReadName(msg, len, pos, name);
+   if ( pos < 0 || pos + 4 > len || strcmp(name, entry->name) != 0 ) return;
+   pos += 4;
+
+   if ( rcode != 0 ) {
+      Answer(entry, 0, TT_RESOLVER_NEGATIVE_TTL);
+      return;
+   }
+
+   unsigned long ip = 0;
+   long int ttl = -1;
+   int type, rclass, rdlen;
+   long int rttl;
+   for ( int i = 0; i < answers; i++ ) {
+      pos = TT_ReadName(msg, len, pos, name);
+      if ( pos < 0 || pos + 10 > len ) break;
+      type = (msg[pos] << 8) | msg[pos+1];
+      rclass = (msg[pos+2] << 8) | msg[pos+3];
+      rttl = ((long int)msg[pos+4] << 24) | (msg[pos+5] << 16) | (msg[pos+6] << 8) | msg[pos+7];
+      rdlen = (msg[pos+8] << 8) | msg[pos+9];
+      pos += 10;
+      if ( pos + rdlen > len ) break;
+      if ( rclass == TT_DNS_CLASS_IN && (type == TT_DNS_TYPE_A || type == TT_DNS_TYPE_CNAME) ) {
+         if ( rttl < 0 ) rttl = 0;
+         if ( ttl < 0 || rttl < ttl ) ttl = rttl;
+         if ( type == TT_DNS_TYPE_A && rdlen == 4 && ip == 0 ) {
+            ip = ((unsigned long)msg[pos] << 24) | (msg[pos+1] << 16) | (msg[pos+2] << 8) | msg[pos+3];
+         }
+      }
+      pos += rdlen;
+   }
+
+   if ( ip ) Answer(entry, ip, ttl);
+   else Answer(entry, 0, TT_RESOLVER_NEGATIVE_TTL);
+}
+
+//
+// HandleTimer
+//
+// Resend queries that haven't been answered, and give up on the
+// ones that have had all their tries.
+
+void TTResolver::HandleTimer(long int timer)
+{
+   mutex->Lock();
+   if ( timer != sweep ) {
+      mutex->Unlock();
+      return;
+   }
+   sweep = 0;
+
+   long long now = TT_Now();
+   TTResolverEntry ** entries = pending->Entries();
+   TTResolverEntry * entry;
+   for ( int i = 0; (entry = entries[i]); i++ ) {
+      // sent since the last sweep, it waits for the next one.
+      if ( now - entry->sent < TT_RESOLVER_RETRY * 500000LL ) continue;
+      if ( entry->tries >= TT_RESOLVER_TRIES ) {
+         TT_Debug("TTResolver::HandleTimer() no answer, giving up");
+         Answer(entry, 0, TT_RESOLVER_NEGATIVE_TTL);
+      }
+      else Send(entry);
+   }
+   delete [] entries;
+
+   if ( pending->Size() > 0 ) sweep = reactor->Schedule(this, TT_RESOLVER_RETRY);
+   mutex->Unlock();
+}
+
+//
+// Prune
+//
+// Drop every settled entry that has expired, to keep the cache from
+// growing without end.  The mutex must be held.
+
+void TTResolver::Prune()
+{
+   long long now = TT_Now();
+   TTResolverEntry ** entries = cache->Entries();
+   TTResolverEntry * entry;
+   for ( int i = 0; (entry = entries[i]); i++ ) {
+      if ( !entry->pending && entry->expires <= now ) {
+         cache->Remove(entry);
+         delete entry;
+      }
+   }
+   delete [] entries;
+}
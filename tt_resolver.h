@@ -0,0 +1,82 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTResolver - asynchronous host name resolver with a cache.  Names
+// are looked up in /etc/hosts first and then, unless the resolver is
+// in hosts only mode, with a DNS query for the A record sent over
+// UDP to the first nameserver in /etc/resolv.conf.  The query's
+// socket and its retry timer are driven by a TTReactor, nothing
+// blocks.
+//
+// Answers are cached for the TTL the server gave them, failures for
+// TT_RESOLVER_NEGATIVE_TTL seconds.  Lookups of a name that is
+// already being queried wait on the same query instead of sending
+// another.
+//
+// Resolve() may be called from any thread.  Answers that have to
+// wait come back through HandleResolved() on the resolver's reactor
+// thread, which may not be the caller's.  HandleResolved() is called
+// with the resolver locked, so it must be quick and must not call
+// back into the resolver.  Once Cancel() returns the handler won't
+// be called for that request.
+//
+// Part of the TTools package.
+
+#ifndef __tt_resolver_h
+#define __tt_resolver_h
+
+#include "ttools/tt_reactor.h"
+
+class TTMutex;
+class TTSlotMap;
+class TTResolverEntry;
+class TTResolverTable;
+
+const int TT_RESOLVE_DNS = 0;      // /etc/hosts, then DNS
+const int TT_RESOLVE_HOSTS = 1;    // /etc/hosts only
+
+const int TT_RESOLVER_RETRY = 1000;       // milliseconds between tries
+const int TT_RESOLVER_TRIES = 3;
+const int TT_RESOLVER_NEGATIVE_TTL = 5;   // seconds
+const int TT_RESOLVER_MAX_ENTRIES = 4096;
+
+class TTResolver : public TTReactorHandler {
+
+public:
+
+   TTResolver(TTReactor * rct, int md = TT_RESOLVE_DNS);
+   ~TTResolver();
+
+   bool SetServer(char * address, int port = 53);
+   long int Resolve(char * name, TTReactorHandler * handler, unsigned long * ip);
+   void Cancel(long int request);
+
+   virtual void HandleEvent(int events);
+   virtual void HandleTimer(long int timer);
+
+private:
+
+   void LoadHosts();
+   void LoadServer();
+   bool Query(TTResolverEntry * entry);
+   void Send(TTResolverEntry * entry);
+   void Answer(TTResolverEntry * entry, unsigned long ip, long int ttl);
+   void Parse(unsigned char * msg, int len);
+   void Prune();
+
+   int mode;
+   int sock;
+   unsigned long server_ip;
+   int server_port;
+   unsigned short next_id;
+   long int sweep;
+   TTResolverTable * hosts;
+   TTResolverTable * cache;
+   TTResolverTable * pending;
+   TTSlotMap * live;
+   TTMutex * mutex;
+   TTReactor * reactor;
+};
+
+#endif // __tt_resolver_h
@@ -0,0 +1,767 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTShard - one event loop of a TTNetwork together with the channels
+// it owns.  Each shard has its own TTReactor, its own channel table
+// and its own mutex, so shards never contend with each other.
+//
+// A channel is only ever touched by its shard's loop.  Sends and
+// disconnects made from any other thread are queued on the shard's
+// TTHandoff and the loop is woken to carry them out.
+//
+// Closed sockets are only deleted from the loop as well, so the loop
+// can call into its sockets without holding the shard's mutex.  A
+// socket that ends is put on the shard's reap queue, and the loop
+// takes closed sockets off it a batch at a time, so cleaning up
+// never walks the whole table.
+//
+// The channel table is a TTSlotMap, a channel number being the
+// table's key folded together with the shard's index.  Looking a
+// channel up takes no lock, the mutex only serializes the changes to
+// the table.  A sender off the loop that uses the socket it found
+// counts itself in the table's epoch while it does, and a closed
+// socket is only deleted once no such sender can still be using it.
+//
+// Part of the TTools package.
+
+#include <cstddef>
+#include <string.h>
+
+#ifdef WIN32
+#else
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#endif
+
+#include "ttools/tt_shard.h"
+#include "ttools/tt_async_socket.h"
+#include "ttools/tt_socket.h"
+#include "ttools/tt_handoff.h"
+#include "ttools/tt_slot_map.h"
+#include "ttools/tt_mutex.h"
+#include "ttools/tt_notify.h"
+#include "ttools/tt_functions.h"
+#include "ttools/tt_framer.h"
+#include "ttools/tt_ref_buffer.h"
+
+const int TT_SHARD_SEND = 0;
+const int TT_SHARD_FILE = 1;
+const int TT_SHARD_DISCONNECT = 2;
+const int TT_SHARD_CLEANUP = 3;
+const int TT_SHARD_ZEROCOPY = 4;
+const int TT_SHARD_SHAPE = 5;
+const int TT_SHARD_WATERMARKS = 6;
+const int TT_SHARD_READ_LIMIT = 7;
+const int TT_SHARD_RESUME = 8;
+const int TT_SHARD_OPTIONS = 9;
+const int TT_SHARD_FRAME = 10;
+const int TT_SHARD_BROADCAST = 11;
+const int TT_REAP_BATCH = 256;  // closed sockets deleted per cleanup
+const int TT_RECLAIM_WAIT = 10;  // ms before trying held back sockets again
+
+//
+// A request waiting on the handoff queue.  Sends carry a private 
+// copy of the data, zero copy sends carry the caller's buffer in 
+// user instead.  Shapes and watermarks carry their two values in 
+// offset and length, a read limit just the one in length, and 
+// options a copy of the caller's.  Framing carries the format in 
+// offset and the largest message in length.  A broadcast carries 
+// its channels and a reference on the shared buffer, one request 
+// for all of the shard's channels.  
+// Disconnects are queued too so they can't overtake the sends made 
+// before them.
+
+class TTShardRequest {
+
+public:
+
+   TTShardRequest(int tp, long int chn)
+   {
+      type = tp;
+      channel = chn;
+      data = NULL;
+      user = NULL;
+      dataLen = 0;
+      fd = -1;
+      offset = 0;
+      length = 0;
+      options = NULL;
+      channels = NULL;
+      count = 0;
+      shared = NULL;
+   }
+   ~TTShardRequest() 
+   { 
+      delete [] data; 
+      delete options;
+      delete [] channels;
+      if ( shared ) shared->Drop();
+   }
+
+   int type;
+   long int channel;
+   unsigned char * data;
+   unsigned char * user;
+   int dataLen;
+   int fd;
+   long int offset;
+   long int length;
+   TTSocketOptions * options;
+   long int * channels;
+   int count;
+   TTRefBuffer * shared;
+};
+
+//
+// Create a shard and start its event loop.
+//
+//    ttn    : receives the notifications of the shard's sockets.
+//    idx    : position of the shard in its network.
+//    count  : number of shards in the network.
+//    engine : TT_ENGINE_EPOLL or TT_ENGINE_URING.
+
+TTShard::TTShard(TTNotify * ttn, int idx, int count, int engine)
+{
+   notify = ttn;
+   index = idx;
+   stride = count;
+   load = 0;
+   dead = 0;
+   sockets = new TTSlotMap();
+   mutex = new TTMutex();
+   handoff = new TTHandoff();
+   reaping = new TTHandoff();
+   reclaim_timer = 0;
+   shared_send = NULL;
+   shared_recv = NULL;
+   frame_format = TT_FRAME_NONE;
+   frame_max = TT_FRAME_MAX;
+   reactor = TTReactor::Create(engine);
+
+   // the handoff queue wakes the loop through its own descriptor.
+   wake_fd = eventfd(0, EFD_NONBLOCK);
+   if ( wake_fd < 0 || !reactor->Add(wake_fd, this) ) {
+      TT_Error("TTShard::TTShard() could not register the handoff queue");
+   }
+}
+
+TTShard::~TTShard()
+{
+   reactor->Stop();
+   Drain(false);
+   if ( wake_fd >= 0 ) close(wake_fd);
+   delete reactor;
+   delete handoff;
+   TTHandoffNode * node = reaping->Take();
+   TTHandoffNode * temp;
+   while ( node ) {
+      temp = node->next;
+      delete node;
+      node = temp;
+   }
+   delete reaping;
+   delete sockets;
+   delete mutex;
+}
+
+//
+// Reserve
+//
+// Hand out a new channel number, nothing is found under it until 
+// Open().  Returns 0 if the shard's table is full.
+
+long int TTShard::Reserve()
+{
+   mutex->Lock();
+   long int key = sockets->Reserve();
+   mutex->Unlock();
+   return ( key > 0 ) ? key * stride + index : 0;
+}
+
+//
+// Open
+//
+// Allocate a socket for the given channel, from Reserve(), and add 
+// it to the shard's table.  The caller connects it.  Returns NULL 
+// if there is no channel.
+
+TTAsyncSocket * TTShard::Open(long int channel)
+{
+   if ( channel <= 0 ) return NULL;
+   TTAsyncSocket * ttas = new TTAsyncSocket(notify, channel, reactor);
+   ttas->Share(shared_send, shared_recv);
+   if ( frame_format != TT_FRAME_NONE ) ttas->Frame(frame_format, frame_max);
+   mutex->Lock();
+   sockets->Put(channel / stride, (void*)ttas);
+   mutex->Unlock();
+   __sync_fetch_and_add(&load, 1);
+   
+   // take the chance to reap anything left waiting, on the loop.  
+   // It costs a batch at most, however many channels are open.
+   if ( dead > 0 && reactor->InLoop() ) DoCleanup();
+   return ttas;
+}
+
+//
+// Find
+//
+// Look a channel up in the shard's table.
+
+TTAsyncSocket * TTShard::Find(long int channel)
+{
+   if ( channel <= 0 ) return NULL;
+   return (TTAsyncSocket*)sockets->Get(channel / stride);
+}
+
+//
+// Pooled
+//
+// Whether one of the shard's channels was opened by a TTPool.  The 
+// table lookup takes no lock.  Only for the channel's own 
+// notifications, while its socket can't go away.
+
+bool TTShard::Pooled(long int channel)
+{
+   TTAsyncSocket * ttas = Find(channel);
+   return ttas && ttas->Pooled();
+}
+
+//
+// Alive
+//
+// Check that one of the shard's channels is still connected and 
+// quiet, see TTAsyncSocket::Alive().  From any thread.
+
+bool TTShard::Alive(long int channel)
+{
+   int token = sockets->Enter();
+   TTAsyncSocket * ttas = Find(channel);
+   bool alive = ( ttas && ttas->Alive() );
+   sockets->Leave(token);
+   return alive;
+}
+
+//
+// Ended
+//
+// One of the shard's sockets has sent its end notification, it
+// no longer counts towards the shard's load and goes on the reap 
+// queue.  The socket is still finishing, so the loop is only asked 
+// to clean up, never from here, and only when the queue was empty.
+
+void TTShard::Ended(long int channel)
+{
+   __sync_fetch_and_sub(&load, 1);
+   __sync_fetch_and_add(&dead, 1);
+   if ( reaping->Push((void*)channel) ) Post(new TTShardRequest(TT_SHARD_CLEANUP, 0));
+}
+
+//
+// Send some data on the given channel.  From the shard's own loop
+// the data goes straight to the socket, from anywhere else it is
+// queued for the loop.  Returns TT_SEND_FAILED if the channel is 
+// unknown, TT_SEND_FULL if it is over its high water mark.
+
+int TTShard::Send(long int channel, unsigned char * data, int dataLen)
+{
+   if ( reactor->InLoop() ) {
+      TTAsyncSocket * ttas = Find(channel);
+      if ( !ttas ) return TT_SEND_FAILED;
+      ttas->Send(data, dataLen);
+      return ttas->Over() ? TT_SEND_FULL : TT_SEND_OK;
+   }
+   
+   int state = Expect(channel, dataLen);
+   if ( state == TT_SEND_FAILED ) return state;
+   TTShardRequest * request = new TTShardRequest(TT_SHARD_SEND, channel);
+   request->data = new unsigned char[dataLen];
+   request->dataLen = dataLen;
+   memcpy(request->data, data, dataLen);
+   Post(request);
+   return state;
+}
+
+//
+// Send a list of buffers on the given channel as one.  On the loop 
+// they are written without being glued together, from elsewhere 
+// they are gathered into the request's private copy.
+
+int TTShard::SendV(long int channel, const struct iovec * iov, int count)
+{
+   if ( reactor->InLoop() ) {
+      TTAsyncSocket * ttas = Find(channel);
+      if ( !ttas ) return TT_SEND_FAILED;
+      ttas->SendV(iov, count);
+      return ttas->Over() ? TT_SEND_FULL : TT_SEND_OK;
+   }
+   
+   int dataLen = 0;
+   for ( int i = 0; i < count; i++ ) dataLen += iov[i].iov_len;
+   int state = Expect(channel, dataLen);
+   if ( state == TT_SEND_FAILED ) return state;
+   TTShardRequest * request = new TTShardRequest(TT_SHARD_SEND, channel);
+   request->data = new unsigned char[dataLen];
+   request->dataLen = dataLen;
+   int at = 0;
+   for ( int i = 0; i < count; i++ ) {
+      memcpy(request->data + at, iov[i].iov_base, iov[i].iov_len);
+      at += iov[i].iov_len;
+   }
+   Post(request);
+   return state;
+}
+
+//
+// Send part of a file on the given channel, queued for the loop 
+// like Send().  A file sent to its end from off the loop only counts 
+// against the high water mark once the loop knows how long it is.
+
+int TTShard::SendFile(long int channel, int fd, long int offset, long int length)
+{
+   if ( reactor->InLoop() ) {
+      TTAsyncSocket * ttas = Find(channel);
+      if ( !ttas ) return TT_SEND_FAILED;
+      ttas->SendFile(fd, offset, length);
+      return ttas->Over() ? TT_SEND_FULL : TT_SEND_OK;
+   }
+   
+   int state = Expect(channel, ( length > 0 ) ? length : 0);
+   if ( state == TT_SEND_FAILED ) return state;
+   TTShardRequest * request = new TTShardRequest(TT_SHARD_FILE, channel);
+   request->fd = fd;
+   request->offset = offset;
+   request->length = length;
+   Post(request);
+   return state;
+}
+
+//
+// Send a buffer on the given channel without copying it, queued 
+// for the loop like Send() but without the private copy.  Once this 
+// returns other than TT_SEND_FAILED, TT_NOTIFY_SEND_DONE follows for 
+// the buffer, even if the channel goes away before the loop gets to 
+// it.
+
+int TTShard::SendZeroCopy(long int channel, unsigned char * data, int dataLen)
+{
+   if ( reactor->InLoop() ) {
+      TTAsyncSocket * ttas = Find(channel);
+      if ( !ttas || !ttas->SendZeroCopy(data, dataLen) ) return TT_SEND_FAILED;
+      return ttas->Over() ? TT_SEND_FULL : TT_SEND_OK;
+   }
+   
+   int state = Expect(channel, dataLen);
+   if ( state == TT_SEND_FAILED ) return state;
+   TTShardRequest * request = new TTShardRequest(TT_SHARD_ZEROCOPY, channel);
+   request->user = data;
+   request->dataLen = dataLen;
+   Post(request);
+   return state;
+}
+
+//
+// Broadcast
+//
+// Queue one shared buffer on each of the given channels, which must 
+// all be the shard's.  From off the loop a single request carries 
+// them all, and wakes the loop once.  A channel over its high water 
+// mark still takes the buffer and reports TT_NOTIFY_WRITABLE once 
+// it has drained.  Returns the number of channels the buffer was 
+// queued on.
+
+int TTShard::Broadcast(const long int * channels, int count, TTRefBuffer * buffer)
+{
+   if ( count <= 0 ) return 0;
+   if ( reactor->InLoop() ) return Deliver(channels, count, buffer, false);
+   
+   TTShardRequest * request = new TTShardRequest(TT_SHARD_BROADCAST, 0);
+   request->channels = new long int[count];
+   int token = sockets->Enter();
+   for ( int i = 0; i < count; i++ ) {
+      TTAsyncSocket * ttas = Find(channels[i]);
+      if ( !ttas ) continue;
+      ttas->Backlog(buffer->Length());
+      ttas->Over();
+      request->channels[request->count++] = channels[i];
+   }
+   sockets->Leave(token);
+   
+   int sent = request->count;
+   if ( sent == 0 ) {
+      delete request;
+      return 0;
+   }
+   buffer->Hold();
+   request->shared = buffer;
+   Post(request);
+   return sent;
+}
+
+//
+// Deliver
+//
+// Hand a shared buffer to each of the given channels' sockets, from 
+// the loop.  counted says the buffer was counted against their send 
+// queues when it was posted.  The sockets can't be cleaned up while 
+// the loop is here, so they are safe to use once looked up.
+
+int TTShard::Deliver(const long int * channels, int count, TTRefBuffer * buffer, bool counted)
+{
+   int sent = 0;
+   for ( int i = 0; i < count; i++ ) {
+      TTAsyncSocket * ttas = Find(channels[i]);
+      if ( !ttas ) continue;
+      if ( counted ) ttas->Backlog(-buffer->Length());
+      if ( !ttas->SendShared(buffer) ) continue;
+      if ( !counted ) ttas->Over();
+      sent++;
+   }
+   return sent;
+}
+
+//
+// Expect
+//
+// Count bytes about to be posted for a channel against its send 
+// queue, so a sender off the loop sees the queue it is adding to.  
+// Being counted in the table's epoch keeps the socket from being 
+// deleted meanwhile.  Returns TT_SEND_FAILED if the channel is 
+// unknown.
+
+int TTShard::Expect(long int channel, long int bytes)
+{
+   int state = TT_SEND_FAILED;
+   int token = sockets->Enter();
+   TTAsyncSocket * ttas = Find(channel);
+   if ( ttas ) {
+      ttas->Backlog(bytes);
+      state = ttas->Over() ? TT_SEND_FULL : TT_SEND_OK;
+   }
+   sockets->Leave(token);
+   return state;
+}
+
+//
+// Set the send queue watermarks of a channel, queued for the loop 
+// like Send().  Returns false if the channel is unknown.
+
+bool TTShard::Watermarks(long int channel, long int high, long int low)
+{
+   TTAsyncSocket * ttas = Find(channel);
+   if ( !ttas ) return false;
+   
+   if ( reactor->InLoop() ) ttas->Watermarks(high, low);
+   else {
+      TTShardRequest * request = new TTShardRequest(TT_SHARD_WATERMARKS, channel);
+      request->offset = high;
+      request->length = low;
+      Post(request);
+   }
+   return true;
+}
+
+//
+// Disconnect a channel socket.  Like Send() this is queued for the 
+// loop when called from elsewhere.  Returns false if the channel 
+// is unknown.
+
+bool TTShard::Disconnect(long int channel)
+{
+   TTAsyncSocket * ttas = Find(channel);
+   if ( !ttas ) return false;
+   
+   if ( reactor->InLoop() ) ttas->Disconnect();
+   else Post(new TTShardRequest(TT_SHARD_DISCONNECT, channel));
+   return true;
+}
+
+//
+// Limit the rates a channel sends and receives at, queued for the 
+// loop like Send().  Returns false if the channel is unknown.
+
+bool TTShard::Shape(long int channel, long int sendRate, long int recvRate)
+{
+   TTAsyncSocket * ttas = Find(channel);
+   if ( !ttas ) return false;
+   
+   if ( reactor->InLoop() ) ttas->Shape(sendRate, recvRate);
+   else {
+      TTShardRequest * request = new TTShardRequest(TT_SHARD_SHAPE, channel);
+      request->offset = sendRate;
+      request->length = recvRate;
+      Post(request);
+   }
+   return true;
+}
+
+//
+// Share
+//
+// Limits every socket the shard opens from now on is under as well 
+// as its own, see TTAsyncSocket::Share().
+
+void TTShard::Share(TTTokenBucket * sendLimit, TTTokenBucket * recvLimit)
+{
+   shared_send = sendLimit;
+   shared_recv = recvLimit;
+}
+
+//
+// Set a channel's read limit, or start it reading again, queued for 
+// the loop like Send().  Returns false if the channel is unknown.
+
+bool TTShard::ReadLimit(long int channel, long int bytes)
+{
+   TTAsyncSocket * ttas = Find(channel);
+   if ( !ttas ) return false;
+   
+   if ( reactor->InLoop() ) ttas->ReadLimit(bytes);
+   else {
+      TTShardRequest * request = new TTShardRequest(TT_SHARD_READ_LIMIT, channel);
+      request->length = bytes;
+      Post(request);
+   }
+   return true;
+}
+
+bool TTShard::ResumeRead(long int channel)
+{
+   TTAsyncSocket * ttas = Find(channel);
+   if ( !ttas ) return false;
+   
+   if ( reactor->InLoop() ) ttas->ResumeRead();
+   else Post(new TTShardRequest(TT_SHARD_RESUME, channel));
+   return true;
+}
+
+//
+// FrameAll
+//
+// Framing every socket the shard opens from now on starts with, see 
+// TTAsyncSocket::Frame().
+
+void TTShard::FrameAll(int format, long int max)
+{
+   frame_format = format;
+   frame_max = max;
+}
+
+//
+// Set a channel's framing, queued for the loop like Send().  
+// Returns false if the channel is unknown.
+
+bool TTShard::Frame(long int channel, int format, long int max)
+{
+   TTAsyncSocket * ttas = Find(channel);
+   if ( !ttas ) return false;
+   
+   if ( reactor->InLoop() ) ttas->Frame(format, max);
+   else {
+      TTShardRequest * request = new TTShardRequest(TT_SHARD_FRAME, channel);
+      request->offset = format;
+      request->length = max;
+      Post(request);
+   }
+   return true;
+}
+
+//
+// Tune a channel's socket, queued for the loop like Send().  
+// Returns false if the channel is unknown.
+
+bool TTShard::SetOptions(long int channel, const TTSocketOptions * options)
+{
+   TTAsyncSocket * ttas = Find(channel);
+   if ( !ttas ) return false;
+   
+   if ( reactor->InLoop() ) ttas->SetOptions(options);
+   else {
+      TTShardRequest * request = new TTShardRequest(TT_SHARD_OPTIONS, channel);
+      request->options = new TTSocketOptions(*options);
+      Post(request);
+   }
+   return true;
+}
+
+//
+// Post
+//
+// Queue a request for the loop, waking it if the queue was empty.
+
+void TTShard::Post(TTShardRequest * request)
+{
+   if ( handoff->Push(request) ) {
+      uint64_t one = 1;
+      TT_CountSyscall();
+      if ( write(wake_fd, &one, sizeof(one)) < 0 ) {
+         TT_Debug("TTShard::Post() wake failed");
+      }
+   }
+}
+
+//
+// Disconnect every socket the shard owns.
+
+void TTShard::Shutdown()
+{
+   bool inLoop = reactor->InLoop();
+   mutex->Lock();
+
+   TTAsyncSocket * ts;
+   long int key;
+   for ( long int slot = 0; slot < sockets->Slots(); slot++ ) {
+      ts = (TTAsyncSocket*)sockets->At(slot, &key);
+      if ( ts && inLoop ) ts->Disconnect();
+      else if ( ts ) Post(new TTShardRequest(TT_SHARD_DISCONNECT, key * stride + index));
+   }
+
+   mutex->Unlock();
+}
+
+//
+// HandleEvent
+//
+// The handoff queue has been written to, clear the wakeup and
+// carry out the queued requests.
+
+void TTShard::HandleEvent(int events)
+{
+   uint64_t count;
+   TT_CountSyscall();
+   if ( read(wake_fd, &count, sizeof(count)) < 0 ) count = 0;
+   Drain(true);
+}
+
+//
+// HandleTimer
+//
+// Some sockets couldn't be reaped or deleted yet, try again.
+
+void TTShard::HandleTimer(long int timer)
+{
+   if ( timer != reclaim_timer ) return;
+   reclaim_timer = 0;
+   DoCleanup();
+}
+
+//
+// Drain
+//
+// Empty the handoff queue, carrying out each request when deliver 
+// is set and discarding it otherwise.
+
+void TTShard::Drain(bool deliver)
+{
+   TTHandoffNode * node = handoff->Take();
+   TTHandoffNode * temp;
+
+   while ( node ) {
+      if ( deliver ) Carry((TTShardRequest*)node->item);
+      delete (TTShardRequest*)node->item;
+      temp = node->next;
+      delete node;
+      node = temp;
+   }
+}
+
+//
+// Carry
+//
+// Carry out one queued request on the loop.
+
+void TTShard::Carry(TTShardRequest * request)
+{
+   if ( request->type == TT_SHARD_CLEANUP ) {
+      DoCleanup();
+      return;
+   }
+   
+   if ( request->type == TT_SHARD_BROADCAST ) {
+      Deliver(request->channels, request->count, request->shared, true);
+      return;
+   }
+   
+   // the channel may have gone since the request was queued.
+   TTAsyncSocket * ttas = Find(request->channel);
+   if ( request->type == TT_SHARD_ZEROCOPY ) {
+      // counted when it was posted, the socket counts it again.
+      if ( ttas ) ttas->Backlog(-request->dataLen);
+      if ( !ttas || !ttas->SendZeroCopy(request->user, request->dataLen) ) {
+         // the buffer still has to go back to its owner.
+         notify->Notify(request->channel, TT_NOTIFY_SEND_DONE, request->user);
+      }
+      return;
+   }
+   if ( !ttas ) return;
+   
+   if ( request->type == TT_SHARD_SEND ) {
+      ttas->Backlog(-request->dataLen);
+      ttas->Send(request->data, request->dataLen);
+   }
+   else if ( request->type == TT_SHARD_FILE ) {
+      if ( request->length > 0 ) ttas->Backlog(-request->length);
+      ttas->SendFile(request->fd, request->offset, request->length);
+   }
+   else if ( request->type == TT_SHARD_DISCONNECT ) ttas->Disconnect();
+   else if ( request->type == TT_SHARD_SHAPE ) ttas->Shape(request->offset, request->length);
+   else if ( request->type == TT_SHARD_WATERMARKS ) ttas->Watermarks(request->offset, request->length);
+   else if ( request->type == TT_SHARD_READ_LIMIT ) ttas->ReadLimit(request->length);
+   else if ( request->type == TT_SHARD_RESUME ) ttas->ResumeRead();
+   else if ( request->type == TT_SHARD_OPTIONS ) ttas->SetOptions(request->options);
+   else if ( request->type == TT_SHARD_FRAME ) ttas->Frame((int)request->offset, request->length);
+}
+
+//
+// Cleanup sockets on the reap queue that are done, up to 
+// TT_REAP_BATCH of them, asking the loop to come back for the rest.  
+// One whose end notification hasn't finished yet goes back on the 
+// queue and the loop looks again after TT_RECLAIM_WAIT, rather than 
+// spinning while the owner's handler runs.  Nothing else may ask 
+// while the queue isn't empty.  Only from the loop.  A socket taken 
+// out of the table is retired rather than deleted, a sender off the 
+// loop may have found it just before, and deleted once the table 
+// says no sender can still have it.  While a sender holds some back 
+// the loop looks again after TT_RECLAIM_WAIT as well.
+
+void TTShard::DoCleanup()
+{
+   TTHandoffNode * node = reaping->Take();
+   TTHandoffNode * temp;
+   TTAsyncSocket * ts;
+   long int channel;
+   int reaped = 0;
+   bool more = false;
+   bool waiting = false;
+
+   mutex->Lock();
+   while ( node ) {
+      temp = node->next;
+      channel = (long int)node->item;
+      ts = Find(channel);
+      if ( reaped >= TT_REAP_BATCH ) {
+         reaping->Push(node->item);
+         more = true;
+      }
+      else if ( ts && ts->Status() != TTAS_STATUS_CLOSED ) {
+         reaping->Push(node->item);
+         waiting = true;
+      }
+      else {
+         if ( ts ) {
+            sockets->Remove(channel / stride);
+            sockets->Retire(ts);
+         }
+         __sync_fetch_and_sub(&dead, 1);
+         reaped++;
+      }
+      delete node;
+      node = temp;
+   }
+   while ( (ts = (TTAsyncSocket*)sockets->Reclaim()) ) delete ts;
+   if ( (waiting || sockets->Retiring()) && reclaim_timer == 0 ) reclaim_timer = reactor->Schedule(this, TT_RECLAIM_WAIT);
+   mutex->Unlock();
+
+   if ( more ) Post(new TTShardRequest(TT_SHARD_CLEANUP, 0));
+}
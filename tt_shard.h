@@ -0,0 +1,99 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTShard - one event loop of a TTNetwork together with the channels
+// it owns.  Each shard has its own TTReactor, its own channel table
+// and its own mutex, so shards never contend with each other.  The
+// table is a TTSlotMap, so looking a channel up takes no lock at all.
+//
+// A channel is only ever touched by its shard's loop.  Sends and
+// disconnects made from any other thread are queued on the shard's
+// TTHandoff and the loop is woken to carry them out.
+//
+// Closed sockets are only deleted from the loop as well, so the loop
+// can call into its sockets without holding the shard's mutex, which
+// only guards the channel table.
+//
+// Part of the TTools package.
+
+#ifndef __tt_shard_h
+#define __tt_shard_h
+
+#include "ttools/tt_reactor.h"
+
+class TTAsyncSocket;
+class TTHandoff;
+class TTMutex;
+class TTNotify;
+class TTRefBuffer;
+class TTShardRequest;
+class TTSlotMap;
+class TTSocketOptions;
+class TTTokenBucket;
+struct iovec;
+
+class TTShard : public TTReactorHandler {
+
+public:
+
+   TTShard(TTNotify * ttn, int idx, int count, int engine);
+   ~TTShard();
+
+   long int Reserve();
+   TTAsyncSocket * Open(long int channel);
+   int Send(long int channel, unsigned char * data, int dataLen);
+   int SendV(long int channel, const struct iovec * iov, int count);
+   int SendFile(long int channel, int fd, long int offset, long int length);
+   int SendZeroCopy(long int channel, unsigned char * data, int dataLen);
+   int Broadcast(const long int * channels, int count, TTRefBuffer * buffer);
+   bool Watermarks(long int channel, long int high, long int low);
+   bool ReadLimit(long int channel, long int bytes);
+   bool ResumeRead(long int channel);
+   bool SetOptions(long int channel, const TTSocketOptions * options);
+   bool Frame(long int channel, int format, long int max);
+   void FrameAll(int format, long int max);
+   bool Disconnect(long int channel);
+   bool Shape(long int channel, long int sendRate, long int recvRate);
+   void Share(TTTokenBucket * sendLimit, TTTokenBucket * recvLimit);
+   void Shutdown();
+   void Ended(long int channel);
+   bool Pooled(long int channel);
+   bool Alive(long int channel);
+
+   int Index() { return index; }
+   int Load() { return load; }
+   TTReactor * Reactor() { return reactor; }
+
+   virtual void HandleEvent(int events);
+   virtual void HandleTimer(long int timer);
+
+private:
+
+   TTAsyncSocket * Find(long int channel);
+   int Expect(long int channel, long int bytes);
+   int Deliver(const long int * channels, int count, TTRefBuffer * buffer, bool counted);
+   void Post(TTShardRequest * request);
+   void Drain(bool deliver);
+   void Carry(TTShardRequest * request);
+   void DoCleanup();
+
+   int index;
+   int stride;
+   volatile int load;
+   volatile int dead;
+   int wake_fd;
+   TTNotify * notify;
+   TTSlotMap * sockets;
+   TTMutex * mutex;
+   TTHandoff * handoff;
+   TTHandoff * reaping;
+   long int reclaim_timer;
+   TTTokenBucket * shared_send;
+   TTTokenBucket * shared_recv;
+   int frame_format;
+   long int frame_max;
+   TTReactor * reactor;
+};
+
+#endif // __tt_shard_h
@@ -0,0 +1,348 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTSharedLink - a pair of single producer, single consumer byte
+// rings in shared memory, one each way, for a channel between two
+// processes on the same machine.  Data crosses with a copy in and a
+// copy out and no system call.
+//
+// The rings live in one memfd.  The side that dials creates it with
+// Create() and passes the descriptor over the channel's Unix socket,
+// the side that accepts maps it with Map().  The socket stays open
+// as the doorbell: a side that finds its receive ring empty, or its
+// send ring full, marks itself idle and waits for the socket to turn
+// readable, and the other side writes a byte to the socket only when
+// it finds that mark.  A busy link costs no system calls at all.
+// The socket closing still ends the channel.  The memfd is sealed
+// at its size, and its pages are only filled in as the rings reach
+// them.
+//
+// Each ring is a header page followed by a power of two sized data
+// area.  head and tail count the bytes ever written and read, only
+// the producer moves head and only the consumer moves tail, so the
+// ring needs no lock.  The idle marks follow the usual pattern for a
+// sleeping side: mark, fence, look again.  The other side moves its
+// counter, fences, then checks the mark, so either the sleeper sees
+// the new data or the other side sees the mark and rings.
+//
+// One thread may write and one may read at a time, the owner
+// serializes them.
+//
+// Part of the TTools package.
+
+#include <string.h>
+#include <errno.h>
+
+#ifdef WIN32
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+#include "ttools/tt_shared_link.h"
+#include "ttools/tt_functions.h"
+
+const long int TT_SHARED_PAGE = 4096;
+const unsigned long TT_RING_MAGIC = 0x5454524e47303031UL;  // "TTRNG001"
+const int TT_RING_SEALS = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+
+//
+// The header of one ring, each field the other side polls on its
+// own cache line.
+
+struct TTRingHeader {
+   unsigned long magic;
+   long int size;
+   char pad0[48];
+   volatile unsigned long head;    // bytes ever written, the producer's
+   char pad1[56];
+   volatile unsigned long tail;    // bytes ever read, the consumer's
+   char pad2[56];
+   volatile int reader_idle;       // the consumer found the ring empty
+   char pad3[60];
+   volatile int writer_idle;       // the producer found it full
+};
+
+TTSharedLink::TTSharedLink(int fd, int bell, unsigned char * base, long int size, bool creator)
+{
+   memfd = fd;
+   bell_fd = bell;
+   map = base;
+   ring_size = size;
+   map_size = 2 * (TT_SHARED_PAGE + size);
+
+   // the creator sends on the first ring and receives on the second.
+   unsigned char * first = base;
+   unsigned char * second = base + TT_SHARED_PAGE + size;
+   tx = (TTRingHeader*)( creator ? first : second );
+   rx = (TTRingHeader*)( creator ? second : first );
+   tx_data = (unsigned char*)tx + TT_SHARED_PAGE;
+   rx_data = (unsigned char*)rx + TT_SHARED_PAGE;
+}
+
+TTSharedLink::~TTSharedLink()
+{
+   Release();
+   munmap(map, map_size);
+}
+
+//
+// Create
+//
+// Make a new pair of rings of at least size bytes each, rounded up
+// to a power of two.  bell is the socket to ring the peer on.
+// Returns NULL on failure.
+
+TTSharedLink * TTSharedLink::Create(int bell, long int size)
+{
+   long int ring = TT_SHARED_PAGE;
+   while ( ring < size ) ring <<= 1;
+   long int total = 2 * (TT_SHARED_PAGE + ring);
+
+   int fd = memfd_create("ttools-link", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+   if ( fd < 0 ) {
+      TT_Debug("TTSharedLink::Create() no memfd");
+      return NULL;
+   }
+   if ( ftruncate(fd, total) < 0 ) {
+      TT_Debug("TTSharedLink::Create() could not size the memfd");
+      close(fd);
+      return NULL;
+   }
+   // sealed at its size, neither side can truncate the rings out from
+   // under the other's mapping.
+   if ( fcntl(fd, F_ADD_SEALS, TT_RING_SEALS) < 0 ) {
+      TT_Debug("TTSharedLink::Create() could not seal the memfd");
+      close(fd);
+      return NULL;
+   }
+   void * base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if ( base == MAP_FAILED ) {
+      TT_Debug("TTSharedLink::Create() could not map the memfd");
+      close(fd);
+      return NULL;
+   }
+
+   // a new memfd reads as zeros, only the fixed fields need setting.
+   // Both readers start idle, the first write rings.
+   for ( int i = 0; i < 2; i++ ) {
+      TTRingHeader * header = (TTRingHeader*)((unsigned char*)base + i * (TT_SHARED_PAGE + ring));
+      header->magic = TT_RING_MAGIC;
+      header->size = ring;
+      header->reader_idle = 1;
+   }
+   return new TTSharedLink(fd, bell, (unsigned char*)base, ring, true);
+}
+
+//
+// Map
+//
+// Map the rings the peer created and passed as fd.  The descriptor
+// isn't kept, the caller closes it.  Returns NULL if it doesn't hold
+// a link, or isn't sealed at its size.
+
+TTSharedLink * TTSharedLink::Map(int fd, int bell)
+{
+   int seals = fcntl(fd, F_GET_SEALS);
+   if ( seals < 0 || (seals & TT_RING_SEALS) != TT_RING_SEALS ) {
+      TT_Debug("TTSharedLink::Map() memfd not sealed");
+      return NULL;
+   }
+   struct stat st;
+   if ( fstat(fd, &st) < 0 ) return NULL;
+   long int total = st.st_size;
+   long int ring = total / 2 - TT_SHARED_PAGE;
+   if ( ring < TT_SHARED_PAGE || (ring & (ring - 1)) != 0 || 2 * (TT_SHARED_PAGE + ring) != total ) {
+      TT_Debug("TTSharedLink::Map() not a link");
+      return NULL;
+   }
+   void * base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if ( base == MAP_FAILED ) {
+      TT_Debug("TTSharedLink::Map() could not map the memfd");
+      return NULL;
+   }
+   for ( int i = 0; i < 2; i++ ) {
+      TTRingHeader * header = (TTRingHeader*)((unsigned char*)base + i * (TT_SHARED_PAGE + ring));
+      if ( header->magic != TT_RING_MAGIC || header->size != ring ) {
+         TT_Debug("TTSharedLink::Map() bad ring header");
+         munmap(base, total);
+         return NULL;
+      }
+   }
+   return new TTSharedLink(-1, bell, (unsigned char*)base, ring, false);
+}
+
+//
+// Release
+//
+// Close the memfd once it has been passed to the peer, the mapping
+// keeps the memory.
+
+void TTSharedLink::Release()
+{
+   if ( memfd >= 0 ) close(memfd);
+   memfd = -1;
+}
+
+//
+// Room
+//
+// Free space in the send ring.  When there is none the reader is
+// asked to ring once it has made some.
+
+long int TTSharedLink::Room()
+{
+   unsigned long head = tx->head;
+   long int room = ring_size - (long int)(head - __atomic_load_n(&tx->tail, __ATOMIC_ACQUIRE));
+   if ( room <= 0 ) {
+      __atomic_store_n(&tx->writer_idle, 1, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      room = ring_size - (long int)(head - __atomic_load_n(&tx->tail, __ATOMIC_ACQUIRE));
+      if ( room > 0 ) __atomic_store_n(&tx->writer_idle, 0, __ATOMIC_RELAXED);
+   }
+   // the tail is the peer's to write, don't trust it past the ring.
+   if ( room < 0 ) room = 0;
+   if ( room > ring_size ) room = ring_size;
+   return room;
+}
+
+//
+// Copy
+//
+// Copy len bytes into the send ring at position at, wrapping round
+// the end.  len is at most the ring's size.
+
+void TTSharedLink::Copy(unsigned long at, const unsigned char * src, long int len)
+{
+   long int offset = (long int)(at & (ring_size - 1));
+   long int first = ring_size - offset;
+   if ( first > len ) first = len;
+   memcpy(tx_data + offset, src, first);
+   if ( len > first ) memcpy(tx_data, src + first, len - first);
+}
+
+//
+// Publish
+//
+// Make len more bytes visible to the reader, ringing it if it is
+// idle.
+
+void TTSharedLink::Publish(long int len)
+{
+   __atomic_store_n(&tx->head, tx->head + len, __ATOMIC_RELEASE);
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   if ( __atomic_load_n(&tx->reader_idle, __ATOMIC_RELAXED) && __atomic_exchange_n(&tx->reader_idle, 0, __ATOMIC_SEQ_CST) ) Ring();
+}
+
+//
+// Ring
+//
+// Wake the peer.  A full socket means it has rings it hasn't read
+// yet, which will do.
+
+void TTSharedLink::Ring()
+{
+   unsigned char one = 1;
+   TT_CountSyscall();
+   if ( send(bell_fd, &one, 1, MSG_DONTWAIT | MSG_NOSIGNAL) < 0 && errno != EAGAIN ) {
+      TT_Debug("TTSharedLink::Ring() could not ring the peer");
+   }
+}
+
+//
+// Write - copy as much of buf as there is room for into the send
+// ring.
+//
+// Returns the number of bytes written, zero if the ring is full.
+
+int TTSharedLink::Write(const unsigned char * buf, int len)
+{
+   long int room = Room();
+   if ( room == 0 ) return 0;
+   if ( len > room ) len = (int)room;
+   Copy(tx->head, buf, len);
+   Publish(len);
+   return len;
+}
+
+//
+// WriteV - like Write(), for a list of buffers.
+
+int TTSharedLink::WriteV(const struct iovec * iov, int count)
+{
+   long int room = Room();
+   if ( room == 0 ) return 0;
+   long int total = 0;
+   for ( int i = 0; i < count && total < room; i++ ) {
+      long int len = iov[i].iov_len;
+      if ( len > room - total ) len = room - total;
+      Copy(tx->head + total, (const unsigned char*)iov[i].iov_base, len);
+      total += len;
+   }
+   Publish(total);
+   return (int)total;
+}
+
+//
+// WriteFile - read up to len bytes of the file fd from *offset
+// straight into the send ring, moving *offset on.
+//
+// Returns the number of bytes written, zero if the ring is full, or
+// -1 if the file couldn't be read.
+
+int TTSharedLink::WriteFile(int fd, off_t * offset, long int len)
+{
+   long int room = Room();
+   if ( room == 0 ) return 0;
+   long int at = (long int)(tx->head & (ring_size - 1));
+   if ( len > room ) len = room;
+   if ( len > ring_size - at ) len = ring_size - at;
+   ssize_t retVal = pread(fd, tx_data + at, len, *offset);
+   if ( retVal <= 0 ) return -1;
+   *offset += retVal;
+   Publish(retVal);
+   return (int)retVal;
+}
+
+//
+// Read - copy up to max bytes out of the receive ring.
+//
+// Returns one of three responses:
+//
+//    >0 : the number of bytes read
+//     0 : the ring is empty, the writer will ring when it isn't
+//    <0 : the ring is corrupt
+
+int TTSharedLink::Read(unsigned char * buf, int max)
+{
+   unsigned long tail = rx->tail;
+   long int avail = (long int)(__atomic_load_n(&rx->head, __ATOMIC_ACQUIRE) - tail);
+   if ( avail == 0 ) {
+      __atomic_store_n(&rx->reader_idle, 1, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      avail = (long int)(__atomic_load_n(&rx->head, __ATOMIC_ACQUIRE) - tail);
+      if ( avail == 0 ) return 0;
+      __atomic_store_n(&rx->reader_idle, 0, __ATOMIC_RELAXED);
+   }
+   if ( avail < 0 || avail > ring_size ) {
+      TT_Debug("TTSharedLink::Read() ring is corrupt");
+      return -1;
+   }
+
+   long int len = ( avail < max ) ? avail : max;
+   long int offset = (long int)(tail & (ring_size - 1));
+   long int first = ring_size - offset;
+   if ( first > len ) first = len;
+   memcpy(buf, rx_data + offset, first);
+   if ( len > first ) memcpy(buf + first, rx_data, len - first);
+
+   __atomic_store_n(&rx->tail, tail + len, __ATOMIC_RELEASE);
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   if ( __atomic_load_n(&rx->writer_idle, __ATOMIC_RELAXED) && __atomic_exchange_n(&rx->writer_idle, 0, __ATOMIC_SEQ_CST) ) Ring();
+   return (int)len;
+}
@@ -0,0 +1,84 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTSharedLink - a pair of single producer, single consumer byte
+// rings in shared memory, one each way, for a channel between two
+// processes on the same machine.  Data crosses with a copy in and a
+// copy out and no system call.
+//
+// The rings live in one memfd.  The side that dials creates it with
+// Create() and passes the descriptor over the channel's Unix socket,
+// the side that accepts maps it with Map().  The socket stays open
+// as the doorbell: a side that finds its receive ring empty, or its
+// send ring full, marks itself idle and waits for the socket to turn
+// readable, and the other side writes a byte to the socket only when
+// it finds that mark.  A busy link costs no system calls at all.
+// The socket closing still ends the channel.  The memfd is sealed
+// at its size, and its pages are only filled in as the rings reach
+// them.
+//
+// Each ring is a header page followed by a power of two sized data
+// area.  head and tail count the bytes ever written and read, only
+// the producer moves head and only the consumer moves tail, so the
+// ring needs no lock.  The idle marks follow the usual pattern for a
+// sleeping side: mark, fence, look again.  The other side moves its
+// counter, fences, then checks the mark, so either the sleeper sees
+// the new data or the other side sees the mark and rings.
+//
+// One thread may write and one may read at a time, the owner
+// serializes them.
+//
+// Part of the TTools package.
+
+#ifndef __tt_shared_link_h
+#define __tt_shared_link_h
+
+#ifdef WIN32
+#else
+#include <sys/types.h>
+#endif
+
+struct iovec;
+struct TTRingHeader;
+
+const long int TT_SHARED_RING = 4194304;  // bytes each way
+#define TT_SHARED_HELLO "TTSHM001"        // sent with the memfd
+const int TT_SHARED_HELLO_LEN = 8;
+
+class TTSharedLink {
+
+public:
+
+   static TTSharedLink * Create(int bell, long int size = TT_SHARED_RING);
+   static TTSharedLink * Map(int fd, int bell);
+   ~TTSharedLink();
+
+   int Handle() { return memfd; }
+   void Release();
+   int Write(const unsigned char * buf, int len);
+   int WriteV(const struct iovec * iov, int count);
+   int WriteFile(int fd, off_t * offset, long int len);
+   int Read(unsigned char * buf, int max);
+
+private:
+
+   TTSharedLink(int fd, int bell, unsigned char * base, long int size, bool creator);
+
+   long int Room();
+   void Publish(long int len);
+   void Copy(unsigned long at, const unsigned char * src, long int len);
+   void Ring();
+
+   int memfd;
+   int bell_fd;
+   unsigned char * map;
+   long int map_size;
+   long int ring_size;
+   TTRingHeader * tx;
+   TTRingHeader * rx;
+   unsigned char * tx_data;
+   unsigned char * rx_data;
+};
+
+#endif // __tt_shared_link_h
@@ -0,0 +1,299 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTSlotMap - a map that hands out generation checked keys, with
+// lock free lookups and epoch based reclamation of removed values.
+//
+// Part of the TTools package.
+
+#include <cstddef>
+
+#include "ttools/tt_slot_map.h"
+
+const long int TT_SLOT_CHUNK = 1L << TT_SLOT_CHUNK_BITS;
+const long int TT_SLOT_CHUNKS = 1L << (TT_SLOT_BITS - TT_SLOT_CHUNK_BITS);
+const unsigned long TT_SLOT_GENERATIONS = (1UL << TT_SLOT_GENERATION_BITS) - 1;
+
+//
+// One slot.  generation moves on every time the slot is handed out 
+// or emptied, next chains the free slots.
+
+struct TTSlot {
+   volatile unsigned long generation;
+   void * volatile value;
+   long int next;
+};
+
+//
+// A removed value waiting for its readers to finish.
+
+struct TTRetired {
+   void * value;
+   unsigned long epoch;
+   TTRetired * next;
+};
+
+//
+// Reader counts for the two live epochs, a cache line to a stripe so 
+// readers on different threads don't share one.
+
+struct TTEpochStripe {
+   volatile long int readers[2];
+   char pad[64 - 2 * sizeof(long int)];
+};
+
+static int tt_stripe_source = 0;
+static __thread int tt_stripe = -1;
+
+TTSlotMap::TTSlotMap()
+{
+   chunks = new TTSlot*[TT_SLOT_CHUNKS];
+   for ( long int i = 0; i < TT_SLOT_CHUNKS; i++ ) chunks[i] = NULL;
+   used = 0;
+   free_head = -1;
+   free_tail = -1;
+   epoch = 0;
+   stripes = new TTEpochStripe[TT_EPOCH_STRIPES];
+   for ( int i = 0; i < TT_EPOCH_STRIPES; i++ ) {
+      stripes[i].readers[0] = 0;
+      stripes[i].readers[1] = 0;
+   }
+   retired = NULL;
+   retired_tail = NULL;
+}
+
+//
+// Frees the map and the retired list but not the values, no one may 
+// be using the map any more.
+
+TTSlotMap::~TTSlotMap()
+{
+   TTRetired * temp;
+   while ( retired ) {
+      temp = retired->next;
+      delete retired;
+      retired = temp;
+   }
+   for ( long int i = 0; i < TT_SLOT_CHUNKS; i++ ) delete [] chunks[i];
+   delete [] chunks;
+   delete [] stripes;
+}
+
+//
+// Key
+//
+// The key for a slot at a generation.  Generations run from 1 to 
+// TT_SLOT_GENERATIONS and round again, so a key is positive and 
+// leaves room for its owner to fold more into it, as TTNetwork does 
+// with the shard.
+
+long int TTSlotMap::Key(long int slot, unsigned long generation)
+{
+   return (long int)((generation << TT_SLOT_BITS) | (unsigned long)slot);
+}
+
+unsigned long TTSlotMap::Generation(long int key)
+{
+   return (unsigned long)key >> TT_SLOT_BITS;
+}
+
+//
+// Slot
+//
+// Returns the slot at an index, or NULL if its chunk hasn't been 
+// allocated.
+
+TTSlot * TTSlotMap::Slot(long int slot)
+{
+   if ( slot < 0 || slot >= TT_SLOT_NONE ) return NULL;
+   TTSlot * chunk = __atomic_load_n(&chunks[slot >> TT_SLOT_CHUNK_BITS], __ATOMIC_ACQUIRE);
+   if ( !chunk ) return NULL;
+   return &chunk[slot & (TT_SLOT_CHUNK - 1)];
+}
+
+//
+// Reserve
+//
+// Hand out the key of an empty slot, a free one if there is one.  
+// Nothing is found under the key until Put().  Returns 0 if the map 
+// is full.
+
+long int TTSlotMap::Reserve()
+{
+   long int slot = free_head;
+   if ( slot >= 0 ) {
+      free_head = Slot(slot)->next;
+      if ( free_head < 0 ) free_tail = -1;
+   }
+   else {
+      if ( used >= TT_SLOT_NONE ) return 0;
+      slot = used;
+      if ( !chunks[slot >> TT_SLOT_CHUNK_BITS] ) {
+         TTSlot * chunk = new TTSlot[TT_SLOT_CHUNK];
+         for ( long int i = 0; i < TT_SLOT_CHUNK; i++ ) {
+            chunk[i].generation = 0;
+            chunk[i].value = NULL;
+            chunk[i].next = -1;
+         }
+         __atomic_store_n(&chunks[slot >> TT_SLOT_CHUNK_BITS], chunk, __ATOMIC_RELEASE);
+      }
+      used++;
+   }
+   TTSlot * entry = Slot(slot);
+   unsigned long generation = entry->generation % TT_SLOT_GENERATIONS + 1;
+   __atomic_store_n(&entry->generation, generation, __ATOMIC_RELEASE);
+   return Key(slot, generation);
+}
+
+//
+// Put
+//
+// Store the value for a reserved key.
+
+void TTSlotMap::Put(long int key, void * value)
+{
+   TTSlot * entry = Slot(key & TT_SLOT_NONE);
+   if ( !entry || entry->generation != Generation(key) ) return;
+   __atomic_store_n(&entry->value, value, __ATOMIC_RELEASE);
+}
+
+//
+// Get
+//
+// Returns the value stored under key, or NULL if there is none, the 
+// key has gone stale or was never handed out.  The generation is 
+// read again after the value, if the slot changed in between the 
+// value may belong to another key.
+
+void * TTSlotMap::Get(long int key)
+{
+   if ( key <= 0 ) return NULL;
+   TTSlot * entry = Slot(key & TT_SLOT_NONE);
+   if ( !entry ) return NULL;
+   unsigned long generation = Generation(key);
+   if ( __atomic_load_n(&entry->generation, __ATOMIC_ACQUIRE) != generation ) return NULL;
+   void * value = __atomic_load_n(&entry->value, __ATOMIC_ACQUIRE);
+   if ( __atomic_load_n(&entry->generation, __ATOMIC_ACQUIRE) != generation ) return NULL;
+   return value;
+}
+
+//
+// Remove
+//
+// Empty a key's slot and free it for reuse, the key going stale.  
+// Returns the value that was stored, NULL if the key was stale.
+
+void * TTSlotMap::Remove(long int key)
+{
+   TTSlot * entry = Slot(key & TT_SLOT_NONE);
+   if ( !entry || entry->generation != Generation(key) ) return NULL;
+   void * value = entry->value;
+   __atomic_store_n(&entry->generation, entry->generation % TT_SLOT_GENERATIONS + 1, __ATOMIC_SEQ_CST);
+   __atomic_store_n(&entry->value, (void*)NULL, __ATOMIC_RELEASE);
+   long int slot = key & TT_SLOT_NONE;
+   entry->next = -1;
+   if ( free_tail >= 0 ) Slot(free_tail)->next = slot;
+   else free_head = slot;
+   free_tail = slot;
+   return value;
+}
+
+//
+// At
+//
+// Returns the value in a slot, setting key to its key, or NULL if 
+// the slot is empty.  For walking the map, slots run from 0 to 
+// Slots() - 1.  Serialized with the changes, like them.
+
+void * TTSlotMap::At(long int slot, long int * key)
+{
+   TTSlot * entry = Slot(slot);
+   if ( !entry || !entry->value ) return NULL;
+   *key = Key(slot, entry->generation);
+   return entry->value;
+}
+
+//
+// Enter
+//
+// Start using values looked up in the map, until Leave() with the 
+// token returned.  If the epoch moves on between reading it and 
+// counting ourselves in, count ourselves in the new one instead.
+
+int TTSlotMap::Enter()
+{
+   if ( tt_stripe < 0 ) tt_stripe = __sync_fetch_and_add(&tt_stripe_source, 1) % TT_EPOCH_STRIPES;
+   TTEpochStripe * stripe = &stripes[tt_stripe];
+   while ( true ) {
+      unsigned long current = __atomic_load_n(&epoch, __ATOMIC_ACQUIRE);
+      int parity = (int)(current & 1);
+      __sync_fetch_and_add(&stripe->readers[parity], 1);
+      if ( __atomic_load_n(&epoch, __ATOMIC_SEQ_CST) == current ) return (tt_stripe << 1) | parity;
+      __sync_fetch_and_sub(&stripe->readers[parity], 1);
+   }
+}
+
+void TTSlotMap::Leave(int token)
+{
+   __sync_fetch_and_sub(&stripes[token >> 1].readers[token & 1], 1);
+}
+
+//
+// Retire
+//
+// Keep a removed value until no reader can still be using it.  
+// Serialized with the changes.
+
+void TTSlotMap::Retire(void * value)
+{
+   TTRetired * node = new TTRetired();
+   node->value = value;
+   node->epoch = epoch;
+   node->next = NULL;
+   if ( retired_tail ) retired_tail->next = node;
+   else retired = node;
+   retired_tail = node;
+}
+
+//
+// Advance
+//
+// Move the epoch on if no reader is left from the one before the 
+// current one, which counts in the same stripe slots as the next.  
+// Returns false if some are.
+
+bool TTSlotMap::Advance()
+{
+   unsigned long current = epoch;
+   int parity = (int)((current + 1) & 1);
+   __sync_synchronize();
+   for ( int i = 0; i < TT_EPOCH_STRIPES; i++ ) {
+      if ( __atomic_load_n(&stripes[i].readers[parity], __ATOMIC_SEQ_CST) != 0 ) return false;
+   }
+   __atomic_store_n(&epoch, current + 1, __ATOMIC_SEQ_CST);
+   return true;
+}
+
+//
+// Reclaim
+//
+// Returns a retired value no reader can be using any more, for the 
+// caller to free, or NULL if there is none yet.  Values retire in 
+// epoch order, so only the oldest need be looked at.  Serialized 
+// with the changes.
+
+void * TTSlotMap::Reclaim()
+{
+   if ( !retired ) return NULL;
+   for ( int i = 0; i < 2 && epoch < retired->epoch + 2; i++ ) {
+      if ( !Advance() ) break;
+   }
+   if ( epoch < retired->epoch + 2 ) return NULL;
+   TTRetired * node = retired;
+   retired = node->next;
+   if ( !retired ) retired_tail = NULL;
+   void * value = node->value;
+   delete node;
+   return value;
+}
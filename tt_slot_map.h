@@ -0,0 +1,81 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTSlotMap - maps keys to values like TTHashtable, except that the 
+// map hands out the keys.  A key is a slot index with the slot's 
+// generation above it, so a lookup is one array access and never 
+// takes a lock, and a key whose slot has been removed, and maybe 
+// handed out again, finds nothing.  No memory management is done for 
+// the values.  Freed slots are handed out again oldest first, so a 
+// generation takes as long as possible to come round again.
+//
+// Reserve(), Put() and Remove() change the map and must be 
+// serialized by the caller.  Get() may be called from any thread at 
+// any time.  The slots are allocated a chunk at a time and never 
+// move, so a lookup racing a change sees the slot either before or 
+// after it, and checks the generation again after reading the value.
+//
+// A value that is removed may still be in use by a thread that 
+// looked it up just before.  Threads that use what they look up 
+// between Enter() and Leave() can count on it staying alive, as long 
+// as the owner passes removed values to Retire() rather than freeing 
+// them, and frees only what Reclaim() hands back.  The readers are 
+// counted per epoch in a few stripes, a retired value is reclaimed 
+// once the epoch has moved on twice, each move waiting until no 
+// reader is left from the one before.
+//
+// Part of the TTools package.
+
+#ifndef __tt_slot_map_h
+#define __tt_slot_map_h
+
+const int TT_SLOT_BITS = 24;
+const long int TT_SLOT_NONE = (1L << TT_SLOT_BITS) - 1;  // never handed out
+const int TT_SLOT_GENERATION_BITS = 29;  // keys stay under 2^53
+const int TT_SLOT_CHUNK_BITS = 12;
+const int TT_EPOCH_STRIPES = 16;
+
+struct TTSlot;
+struct TTRetired;
+struct TTEpochStripe;
+
+class TTSlotMap {
+
+public:
+
+   TTSlotMap();
+   ~TTSlotMap();
+
+   static long int Key(long int slot, unsigned long generation);
+
+   long int Reserve();
+   void Put(long int key, void * value);
+   void * Get(long int key);
+   void * Remove(long int key);
+   long int Slots() { return used; }
+   void * At(long int slot, long int * key);
+
+   int Enter();
+   void Leave(int token);
+   void Retire(void * value);
+   void * Reclaim();
+   bool Retiring() { return retired != NULL; }
+
+private:
+
+   TTSlot * Slot(long int slot);
+   static unsigned long Generation(long int key);
+   bool Advance();
+
+   TTSlot ** chunks;
+   long int used;
+   long int free_head;
+   long int free_tail;
+   volatile unsigned long epoch;
+   TTEpochStripe * stripes;
+   TTRetired * retired;
+   TTRetired * retired_tail;
+};
+
+#endif // __tt_slot_map_h
@@ -14,9 +14,19 @@
 #else
 #include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/un.h>     // sockaddr_un for unix: addresses
+#include <stddef.h>     // offsetof
 #include <arpa/inet.h>  // inet_addr and other net db functions
-#include <netdb.h>      // gethostbyname()
+#include <netinet/in.h>
+#include <netinet/tcp.h> // TCP_NODELAY and the keepalive options
+#include <netdb.h>      // getaddrinfo()
 #include <unistd.h>     // for close()
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <limits.h>     // IOV_MAX
+#include <poll.h>
+#include <linux/errqueue.h>
 #include <errno.h>
 #endif
 
@@ -30,11 +40,13 @@
 TTSocket::TTSocket(int pSock)
 {
    sock = pSock;
+   shared = false;
 }
 
 TTSocket::TTSocket()
 {
    sock = -1;
+   shared = false;
 }
 
 TTSocket::~TTSocket()
@@ -58,7 +70,13 @@ bool TTSocket::Listen(char * interface, int port)
       return false;
    }
    
-   int listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+   struct sockaddr_un localAddr;
+   int localLen = LocalAddress(interface, &localAddr);
+   if ( LocalPath(interface) && localLen < 0 ) {
+      return false;
+   }
+   
+   int listenSocket = socket(localLen > 0 ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
    if ( listenSocket < 0 ) {
       return false;
    }
@@ -72,7 +90,11 @@ bool TTSocket::Listen(char * interface, int port)
    else sockAddr.sin_addr.s_addr = inet_addr(interface);
    sockAddr.sin_port = htons((u_short)port);
    
-   if(bind(listenSocket,(struct sockaddr *)&sockAddr, sizeof(sockAddr))) {
+   int bound;
+   if ( localLen > 0 ) bound = bind(listenSocket, (struct sockaddr *)&localAddr, localLen);
+   else bound = bind(listenSocket,(struct sockaddr *)&sockAddr, sizeof(sockAddr));
+   if( bound ) {
+      close(listenSocket);
       return false;
    }
 
@@ -99,9 +121,9 @@ bool TTSocket::Listen(char * interface, int port)
 // Connect - connect to remote host
 //
 // Connects the socket to a remote host, or returns false
-// if a connection can not be made.  When returning 
-// false, calling Error() will return a descriptive 
-// error message as to why the connection failed.
+// if a connection can not be made within timeout seconds.  
+// When returning false, calling Error() will return a 
+// descriptive error message as to why the connection failed.
 
 bool TTSocket::Connect(char * host, int port, int timeout)
 {
@@ -110,9 +132,16 @@ bool TTSocket::Connect(char * host, int port, int timeout)
    }
    
    unsigned long cip = 0;
+   struct sockaddr_un uadd;
+   int ulen = LocalAddress(host, &uadd);
    if ( !host ) {
       return false;
    }
+   else if ( LocalPath(host) ) {
+      if ( ulen < 0 || (sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ) {
+         return false;
+      }
+   }
    else if ( port <= 0 ) {
       return false;
    }
@@ -128,7 +157,7 @@ bool TTSocket::Connect(char * host, int port, int timeout)
    ladd.sin_port = 0;
    ladd.sin_addr.s_addr = htonl(INADDR_ANY);
    
-   if ( (bind(sock,(struct sockaddr*)&ladd,sizeof(ladd))) < 0 ) {
+   if ( ulen < 0 && (bind(sock,(struct sockaddr*)&ladd,sizeof(ladd))) < 0 ) {
       return false;
    }
    
@@ -137,13 +166,76 @@ bool TTSocket::Connect(char * host, int port, int timeout)
    radd.sin_port = htons(port);
    radd.sin_addr.s_addr = htonl(cip);
    
-   if ( connect(sock,(struct sockaddr *)&radd, sizeof(radd)) < 0 ) {
+   // connect without blocking so the timeout can be kept, then 
+   // put the socket back the way it was.
+   int flags = fcntl(sock, F_GETFL, 0);
+   fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+   int retVal;
+   if ( ulen > 0 ) retVal = ConnectStart((struct sockaddr *)&uadd, ulen);
+   else retVal = ConnectStart((struct sockaddr *)&radd, sizeof(radd));
+   if ( retVal == 0 ) {
+      struct pollfd pfd;
+      pfd.fd = sock;
+      pfd.events = POLLOUT;
+      pfd.revents = 0;
+      TT_CountSyscall();
+      if ( poll(&pfd, 1, timeout * 1000) == 1 && ConnectResult() == 0 ) retVal = 1;
+   }
+   if ( retVal <= 0 ) {
+      Disconnect();
       return false;
    }
-   
+   fcntl(sock, F_SETFL, flags);
    return true;   
 }
 
+//
+// Open - create a non-blocking socket for ConnectStart(), for when 
+// the descriptor is needed before the connect is made, a Unix domain 
+// one if local is set.  Returns the descriptor or -1.
+
+int TTSocket::Open(bool local)
+{
+   if ( sock < 0 ) sock = socket(local ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+   return sock;
+}
+
+//
+// ConnectStart - start connecting to addr without blocking, opening 
+// the socket first if need be.
+//
+// Returns one of three responses:
+//
+//     1 : connected already
+//     0 : connect in progress, the socket turns writable when it 
+//         finishes, then see ConnectResult()
+//    <0 : the connect failed
+//
+// Like Read() the descriptor is left open on error.
+
+int TTSocket::ConnectStart(const struct sockaddr * addr, int len)
+{
+   if ( Open(addr->sa_family == AF_UNIX) < 0 ) return -1;
+   TT_CountSyscall();
+   if ( connect(sock, addr, len) == 0 ) return 1;
+   if ( errno == EINPROGRESS || errno == EINTR ) return 0;
+   return -1;
+}
+
+//
+// ConnectResult - the outcome of a connect started by 
+// ConnectStart(), zero if it worked or the error number.
+
+int TTSocket::ConnectResult()
+{
+   if ( sock < 0 ) return EBADF;
+   int err = 0;
+   socklen_t len = sizeof(err);
+   TT_CountSyscall();
+   if ( getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len) < 0 ) return errno;
+   return err;
+}
+
 //
 // Send - send data on the socket connection.
 //
@@ -163,13 +255,16 @@ int TTSocket::Send(const unsigned char * buff, int len)
    int bytesToSend = len;
    if ( bytesToSend > TT_MAX_WRITE ) bytesToSend = TT_MAX_WRITE;
    
+   TT_CountSyscall();
    int retVal = send(sock,(const char*)buff,bytesToSend,0);
    if ( retVal < 0 ) {
       if ( errno == ENOBUFS ) {
          return 0;
       }
       else {
-         Disconnect();
+         // shut down rather than close, the socket may be registered 
+         // with an event loop that still needs to see it go away.
+         Shutdown();
          return -1;
       }
    }
@@ -199,6 +294,7 @@ int TTSocket::Recv(unsigned char * buff, int len, int timeout)
    tv.tv_sec = timeout;
    tv.tv_usec = 0;
    
+   TT_CountSyscall();
    int retVal = select(sock+1,&rset,NULL,NULL,&tv);
    
    if ( retVal == 0 ) {
@@ -209,6 +305,7 @@ int TTSocket::Recv(unsigned char * buff, int len, int timeout)
       return -1;
    }
    else {
+      TT_CountSyscall();
       retVal = recv(sock,buff,len,0);
       if ( retVal > 0 ) {
          TT_Debug("TTSocket::Recv() got some data");
@@ -225,6 +322,436 @@ int TTSocket::Recv(unsigned char * buff, int len, int timeout)
    }
 }
 
+//
+// Read - recieve whatever data is waiting without blocking.
+//
+// Returns one of three responses:
+//
+//    >0 : the number of bytes recieved, stored in buff
+//    <0 : connection closed or error
+//     0 : no data waiting, the read would block
+//
+// Unlike Recv() the descriptor is left open on error, the owner 
+// has to take it out of its event loop before calling Disconnect().
+
+int TTSocket::Read(unsigned char * buff, int len)
+{
+   if ( sock < 0 ) {
+      return -1;
+   }
+
+   TT_CountSyscall();
+   int retVal = recv(sock,buff,len,MSG_DONTWAIT);
+   if ( retVal > 0 ) {
+      return retVal;
+   }
+   else if ( retVal < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ) {
+      return 0;
+   }
+   else {
+      return -1;
+   }
+}
+
+//
+// Write - send as much of the buffer as the socket will take 
+// without blocking.
+//
+// Returns one of three responses:
+//
+//    >0 : the number of bytes sent, possibly fewer than len
+//    <0 : connection closed or error
+//     0 : no room in the socket buffer, the write would block
+//
+// Like Read() the descriptor is left open on error.
+
+int TTSocket::Write(const unsigned char * buff, int len)
+{
+   if ( sock < 0 ) {
+      return -1;
+   }
+
+   TT_CountSyscall();
+   int retVal = send(sock,(const char*)buff,len,MSG_DONTWAIT | MSG_NOSIGNAL);
+   if ( retVal >= 0 ) {
+      return retVal;
+   }
+   else if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ENOBUFS ) {
+      return 0;
+   }
+   else {
+      return -1;
+   }
+}
+
+//
+// WriteV - send as much of a list of buffers as the socket will 
+// take without blocking, in one system call.  At most IOV_MAX 
+// buffers are looked at.  Returns the same as Write().
+
+int TTSocket::WriteV(const struct iovec * iov, int count)
+{
+   if ( sock < 0 ) {
+      return -1;
+   }
+   if ( count > IOV_MAX ) count = IOV_MAX;
+
+   struct msghdr msg;
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov = (struct iovec *)iov;
+   msg.msg_iovlen = count;
+
+   TT_CountSyscall();
+   int retVal = sendmsg(sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+   if ( retVal >= 0 ) {
+      return retVal;
+   }
+   else if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ENOBUFS ) {
+      return 0;
+   }
+   else {
+      return -1;
+   }
+}
+
+//
+// SendFile - send part of a file without copying it through user 
+// space.  The socket should be non-blocking.
+//
+// Returns one of three responses:
+//
+//    >0 : the number of bytes sent, offset is moved past them
+//    <0 : error, or the file ended early
+//     0 : no room in the socket buffer, the send would block
+
+int TTSocket::SendFile(int fd, off_t * offset, long int len)
+{
+   if ( sock < 0 ) {
+      return -1;
+   }
+
+   TT_CountSyscall();
+   ssize_t retVal = sendfile(sock, fd, offset, len);
+   if ( retVal > 0 ) {
+      return (int)retVal;
+   }
+   else if ( retVal < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ) {
+      return 0;
+   }
+   else {
+      return -1;
+   }
+}
+
+//
+// EnableZeroCopy - allow MSG_ZEROCOPY sends on the socket.  Returns 
+// false if the kernel doesn't support it.
+
+bool TTSocket::EnableZeroCopy()
+{
+   if ( sock < 0 ) return false;
+#ifdef SO_ZEROCOPY
+   int one = 1;
+   TT_CountSyscall();
+   return ( setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0 );
+#else
+   return false;
+#endif
+}
+
+//
+// SetPacingRate - ask the kernel to spread the socket's sends out 
+// at no more than rate bytes a second, zero for no limit.  Returns 
+// false if the kernel doesn't support it.
+
+bool TTSocket::SetPacingRate(long int rate)
+{
+   if ( sock < 0 ) return false;
+#ifdef SO_MAX_PACING_RATE
+   unsigned long value = ( rate > 0 ) ? (unsigned long)rate : ~0UL;
+   TT_CountSyscall();
+   return ( setsockopt(sock, SOL_SOCKET, SO_MAX_PACING_RATE, &value, sizeof(value)) == 0 );
+#else
+   return false;
+#endif
+}
+
+//
+// Apply - set the options on a socket descriptor.  Those left at 
+// their defaults aren't touched.  Buffer sizes have to be set 
+// before the connection is made to take full effect.  Returns false 
+// if the kernel refused any of them, the rest are still set.
+
+bool TTSocket::Apply(int fd, const TTSocketOptions * options)
+{
+   if ( fd < 0 ) return false;
+   if ( !options ) return true;
+   bool ok = true;
+   int value;
+   if ( options->no_delay >= 0 ) {
+      value = options->no_delay ? 1 : 0;
+      TT_CountSyscall();
+      if ( setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value)) < 0 ) ok = false;
+   }
+   if ( options->send_buffer > 0 ) {
+      TT_CountSyscall();
+      if ( setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &options->send_buffer, sizeof(int)) < 0 ) ok = false;
+   }
+   if ( options->recv_buffer > 0 ) {
+      TT_CountSyscall();
+      if ( setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &options->recv_buffer, sizeof(int)) < 0 ) ok = false;
+   }
+   if ( options->keepalive_idle > 0 ) {
+      value = 1;
+      TT_CountSyscall();
+      if ( setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &value, sizeof(value)) < 0 ) ok = false;
+      TT_CountSyscall();
+      if ( setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &options->keepalive_idle, sizeof(int)) < 0 ) ok = false;
+   }
+   if ( options->keepalive_interval > 0 ) {
+      TT_CountSyscall();
+      if ( setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &options->keepalive_interval, sizeof(int)) < 0 ) ok = false;
+   }
+   if ( options->keepalive_count > 0 ) {
+      TT_CountSyscall();
+      if ( setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &options->keepalive_count, sizeof(int)) < 0 ) ok = false;
+   }
+#ifdef SO_BUSY_POLL
+   if ( options->busy_poll > 0 ) {
+      TT_CountSyscall();
+      if ( setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &options->busy_poll, sizeof(int)) < 0 ) ok = false;
+   }
+#endif
+   if ( !ok ) TT_Debug("TTSocket::Apply() an option was refused");
+   return ok;
+}
+
+//
+// LocalPath - the path of a unix: or shm: address, or NULL if 
+// address names a TCP host.
+
+const char * TTSocket::LocalPath(const char * address)
+{
+   if ( !address ) return NULL;
+   int len = strlen(TT_LOCAL_PREFIX);
+   if ( strncmp(address, TT_LOCAL_PREFIX, len) == 0 ) return address + len;
+   len = strlen(TT_SHARED_PREFIX);
+   if ( strncmp(address, TT_SHARED_PREFIX, len) == 0 ) return address + len;
+   return NULL;
+}
+
+//
+// SharedAddress - true for a shm: address.
+
+bool TTSocket::SharedAddress(const char * address)
+{
+   return address && strncmp(address, TT_SHARED_PREFIX, strlen(TT_SHARED_PREFIX)) == 0;
+}
+
+//
+// SendDescriptor - like Write(), passing the descriptor fd along 
+// with the bytes.  Unix domain sockets only.
+
+int TTSocket::SendDescriptor(const unsigned char * buffer, int len, int fd)
+{
+   if ( sock < 0 ) {
+      return -1;
+   }
+   struct iovec iov;
+   iov.iov_base = (void*)buffer;
+   iov.iov_len = len;
+   char control[CMSG_SPACE(sizeof(int))];
+   memset(control, 0, sizeof(control));
+   struct msghdr msg;
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = control;
+   msg.msg_controllen = sizeof(control);
+   struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type = SCM_RIGHTS;
+   cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+   memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+   
+   TT_CountSyscall();
+   int retVal = sendmsg(sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+   if ( retVal >= 0 ) return retVal;
+   if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) return 0;
+   return -1;
+}
+
+//
+// ReadDescriptor - like Read(), and if a descriptor was passed with 
+// the bytes it is returned in fd, otherwise fd is set to -1.
+
+int TTSocket::ReadDescriptor(unsigned char * buffer, int max, int * fd)
+{
+   *fd = -1;
+   if ( sock < 0 ) {
+      return -1;
+   }
+   struct iovec iov;
+   iov.iov_base = buffer;
+   iov.iov_len = max;
+   char control[CMSG_SPACE(sizeof(int))];
+   struct msghdr msg;
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = control;
+   msg.msg_controllen = sizeof(control);
+   
+   TT_CountSyscall();
+   int retVal = recvmsg(sock, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+   if ( retVal < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ) return 0;
+   if ( retVal <= 0 ) return -1;
+   struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+   if ( cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS ) {
+      memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+   }
+   return retVal;
+}
+
+//
+// LocalAddress - fill in addr for a unix: address.  A path starting 
+// with @ is in the abstract namespace.  Returns the length to give 
+// bind() or connect(), or -1 if address isn't a usable unix: one.
+
+int TTSocket::LocalAddress(const char * address, struct sockaddr_un * addr)
+{
+   const char * path = LocalPath(address);
+   if ( !path || !*path ) return -1;
+   int len = strlen(path);
+   if ( len >= (int)sizeof(addr->sun_path) ) return -1;
+   memset(addr, 0, sizeof(*addr));
+   addr->sun_family = AF_UNIX;
+   memcpy(addr->sun_path, path, len);
+   if ( path[0] == '@' ) {
+      addr->sun_path[0] = 0;
+      return offsetof(struct sockaddr_un, sun_path) + len;
+   }
+   return offsetof(struct sockaddr_un, sun_path) + len + 1;
+}
+
+//
+// WriteZeroCopy - like Write() but the kernel sends straight from 
+// the buffer, which must not change until ReadZeroCopyDone() says 
+// the send is complete.  Each call that returns >0 is one send, 
+// numbered from zero upwards.
+//
+// Returns one of three responses:
+//
+//    >0 : the number of bytes sent, possibly fewer than len
+//    <0 : connection closed or error
+//     0 : no room in the socket buffer, the write would block
+
+int TTSocket::WriteZeroCopy(const unsigned char * buff, int len)
+{
+   if ( sock < 0 ) {
+      return -1;
+   }
+
+   TT_CountSyscall();
+   int retVal = send(sock,(const char*)buff,len,MSG_ZEROCOPY | MSG_DONTWAIT | MSG_NOSIGNAL);
+   if ( retVal >= 0 ) {
+      return retVal;
+   }
+   else if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ENOBUFS ) {
+      // ENOBUFS: too many sends still pinned, wait for completions.
+      return 0;
+   }
+   else {
+      return -1;
+   }
+}
+
+//
+// ReadZeroCopyDone - take one zero copy completion off the socket's 
+// error queue.  Sends lo to hi inclusive are complete.
+//
+// Returns true if a completion was read, false if there are none.
+
+bool TTSocket::ReadZeroCopyDone(unsigned int * lo, unsigned int * hi)
+{
+   if ( sock < 0 ) return false;
+
+   char control[128];
+   struct msghdr msg;
+   struct cmsghdr * cm;
+   struct sock_extended_err * serr;
+
+   while ( true ) {
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      TT_CountSyscall();
+      if ( recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0 ) return false;
+      for ( cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm) ) {
+         serr = (struct sock_extended_err*)CMSG_DATA(cm);
+         if ( serr->ee_errno == 0 && serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY ) {
+            *lo = serr->ee_info;
+            *hi = serr->ee_data;
+            return true;
+         }
+      }
+      // something other than a completion, skip it.
+   }
+}
+
+//
+// SetNonBlocking - make every call on the socket non-blocking, 
+// for sockets driven by a readiness event loop.
+
+void TTSocket::SetNonBlocking()
+{
+   if ( sock < 0 ) return;
+   int flags = fcntl(sock, F_GETFL, 0);
+   if ( flags >= 0 ) fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+}
+
+//
+// Shutdown - stop traffic in both directions without releasing 
+// the descriptor.  Whoever is waiting on the socket will see it 
+// close and can then call Disconnect().
+
+void TTSocket::Shutdown()
+{
+   if ( sock >= 0 ) shutdown(sock, SHUT_RDWR);
+}
+
+//
+// Abort - release the descriptor and reset the connection, the 
+// kernel drops whatever it still had to send.
+
+void TTSocket::Abort()
+{
+   if ( sock < 0 ) return;
+   struct linger lng;
+   lng.l_onoff = 1;
+   lng.l_linger = 0;
+   setsockopt(sock, SOL_SOCKET, SO_LINGER, &lng, sizeof(lng));
+   Disconnect();
+}
+
+//
+// Alive - check a connection that should be quiet, without waiting.  
+// It is alive if it has no error pending, the peer hasn't closed it 
+// and nothing is waiting to be read.
+
+bool TTSocket::Alive()
+{
+   if ( sock < 0 ) return false;
+
+   int error = 0;
+   socklen_t len = sizeof(error);
+   TT_CountSyscall(2);
+   if ( getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0 ) return false;
+   unsigned char byte;
+   int got = recv(sock, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+   return ( got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) );
+}
+
 void TTSocket::Disconnect()
 {
    if ( sock < 0 ) return;
@@ -241,20 +768,25 @@ void TTSocket::Disconnect()
 // quad or fqdn format) and returns the
 // ip address in host byte order.
 //
-// returns the address or 0 if an error occurs.
+// returns the address or 0 if an error occurs.  This blocks 
+// while the name is looked up, TTResolver doesn't.
 
 unsigned long TTSocket::GetHostIP(char * addr)
 {
    if ( inet_addr(addr) == INADDR_NONE ) {
-      // not a valid dotted quad addr.
-      struct hostent * heAddr = gethostbyname(addr);
-      if ( !heAddr ) {
+      // not a valid dotted quad addr.  getaddrinfo() is safe to 
+      // call from several threads at once, gethostbyname() isn't.
+      struct addrinfo hints;
+      struct addrinfo * found = NULL;
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_INET;
+      hints.ai_socktype = SOCK_STREAM;
+      if ( getaddrinfo(addr, NULL, &hints, &found) != 0 || !found ) {
          return 0;
       }
-      else {
-         struct in_addr * iaddr = (in_addr*)heAddr->h_addr;
-         return ntohl(iaddr->s_addr);
-      }
+      unsigned long ip = ntohl(((struct sockaddr_in*)found->ai_addr)->sin_addr.s_addr);
+      freeaddrinfo(found);
+      return ip;
    }
    else {
       return ntohl(inet_addr(addr));
@@ -4,13 +4,59 @@
 //
 // Socket wrapper, wrap a consistent interface around native 
 // sockets.
+//
+// An address of the form unix:/path names a Unix domain stream 
+// socket instead of a TCP host, for peers on the same machine.  The 
+// port is ignored for these.  unix:@name uses the abstract namespace, 
+// which leaves no file behind.  shm:/path is a Unix domain socket 
+// too, over which the two ends set up a TTSharedLink to carry the 
+// data, a socket accepted on such a path is marked Shared().
+//
+// TTSocketOptions collects the options worth tuning per socket.  A 
+// field left at its default leaves the kernel's setting alone.
 
 #ifndef __tt_socket_h
 #define __tt_socket_h
 
+#ifdef WIN32
+#else
+#include <sys/types.h>
+#include <sys/uio.h>
+#endif
+
 const int TT_MAX_READ = 1024;
 const int TT_MAX_WRITE = 1024;
 
+#define TT_LOCAL_PREFIX "unix:"
+#define TT_SHARED_PREFIX "shm:"
+
+struct sockaddr;
+struct sockaddr_un;
+
+class TTSocketOptions
+{
+public:
+
+   TTSocketOptions()
+   {
+      no_delay = -1;
+      send_buffer = 0;
+      recv_buffer = 0;
+      keepalive_idle = 0;
+      keepalive_interval = 0;
+      keepalive_count = 0;
+      busy_poll = 0;
+   }
+
+   int no_delay;             // TCP_NODELAY, 1 sends small writes at once, 0 lets Nagle batch them, -1 as is
+   int send_buffer;          // SO_SNDBUF bytes
+   int recv_buffer;          // SO_RCVBUF bytes
+   int keepalive_idle;       // seconds idle before keepalive probes start, turns keepalive on
+   int keepalive_interval;   // seconds between probes
+   int keepalive_count;      // unanswered probes before the connection is dropped
+   int busy_poll;            // SO_BUSY_POLL microseconds to spin on the device queue for data
+};
+
 class TTSocket
 {
 public:
@@ -21,14 +67,41 @@ public:
    
    bool Listen(char * interface, int port);
    bool Connect(char * host, int port, int timeout);
+   int Open(bool local = false);
+   int ConnectStart(const struct sockaddr * addr, int len);
+   int ConnectResult();
    void Disconnect();
    int Send(const unsigned char * buffer, int len);
    int Recv(unsigned char * buffer, int max, int timeout);
+   int Read(unsigned char * buffer, int max);
+   int Write(const unsigned char * buffer, int len);
+   int WriteV(const struct iovec * iov, int count);
+   int SendFile(int fd, off_t * offset, long int len);
+   bool EnableZeroCopy();
+   bool SetPacingRate(long int rate);
+   bool SetOptions(const TTSocketOptions * options) { return Apply(sock, options); }
+   int WriteZeroCopy(const unsigned char * buff, int len);
+   bool ReadZeroCopyDone(unsigned int * lo, unsigned int * hi);
+   void SetNonBlocking();
+   void Shutdown();
+   void Abort();
+   bool Alive();
+   int SendDescriptor(const unsigned char * buffer, int len, int fd);
+   int ReadDescriptor(unsigned char * buffer, int max, int * fd);
+   int Handle(){return sock;}
+   void SetShared(bool on) { shared = on; }
+   bool Shared() { return shared; }
+
+   static unsigned long GetHostIP(char * host);
+   static bool Apply(int fd, const TTSocketOptions * options);
+   static const char * LocalPath(const char * address);
+   static bool SharedAddress(const char * address);
+   static int LocalAddress(const char * address, struct sockaddr_un * addr);
 
 private:
 
-   unsigned long GetHostIP(char * host);
    int sock;
+   bool shared;
 };
 
 #endif // __tt_socket_h
@@ -0,0 +1,192 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTTimers - one-shot timers for the handlers of a TTReactor.  The
+// pending timers are kept in a binary heap ordered by deadline and
+// a single timerfd, registered with the reactor like any other
+// descriptor, is armed for the earliest one.  HandleTimer() is
+// called on the reactor's thread when a timer fires.
+//
+// Schedule() and Cancel() may be called from any thread.  A
+// cancelled timer stays in the heap until its deadline comes round
+// and is then dropped, so cancelling is cheap.  A handler must
+// cancel its timers before it is deleted.
+//
+// Part of the TTools package.
+
+#include <cstddef>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef WIN32
+#else
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#endif
+
+#include "ttools/tt_timers.h"
+#include "ttools/tt_hashtable.h"
+#include "ttools/tt_mutex.h"
+#include "ttools/tt_functions.h"
+
+const int TT_TIMERS_CHUNK = 64;
+
+TTTimers::TTTimers()
+{
+   sequence = 0;
+   armed = 0;
+   count = 0;
+   allocated = TT_TIMERS_CHUNK;
+   deadlines = (long long*)malloc(allocated * sizeof(long long));
+   timers = (long int*)malloc(allocated * sizeof(long int));
+   live = new TTHashtable(521);
+   mutex = new TTMutex();
+   timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+   if ( timer_fd < 0 ) TT_Error("TTTimers::TTTimers() could not create the timer");
+}
+
+TTTimers::~TTTimers()
+{
+   if ( timer_fd >= 0 ) close(timer_fd);
+   free(deadlines);
+   free(timers);
+   delete live;
+   delete mutex;
+}
+
+//
+// Schedule
+//
+// Call handler->HandleTimer() in ms milliseconds.  Returns the 
+// timer's id, never zero, for HandleTimer() and Cancel().
+
+long int TTTimers::Schedule(TTReactorHandler * handler, int ms)
+{
+   if ( ms < 0 ) ms = 0;
+   long long deadline = TT_Now() + (long long)ms * 1000000LL;
+
+   mutex->Lock();
+   long int timer = ++sequence;
+   live->Put(timer, (void*)handler);
+   Push(deadline, timer);
+   if ( armed == 0 || deadline < armed ) Arm();
+   mutex->Unlock();
+   return timer;
+}
+
+//
+// Cancel
+//
+// Stop a timer from firing.  Cancelling a timer that has already 
+// fired does nothing.
+
+void TTTimers::Cancel(long int timer)
+{
+   if ( timer == 0 ) return;
+   mutex->Lock();
+   live->Remove(timer);
+   mutex->Unlock();
+}
+
+//
+// HandleEvent
+//
+// The timerfd has expired.  Fire every timer that is due, one at a 
+// time and without the mutex, so a handler may schedule, cancel or 
+// delete other handlers' timers from its callback.
+
+void TTTimers::HandleEvent(int events)
+{
+   uint64_t expirations;
+   TT_CountSyscall();
+   if ( read(timer_fd, &expirations, sizeof(expirations)) < 0 ) expirations = 0;
+
+   TTReactorHandler * handler;
+   long int timer;
+   long long now = TT_Now();
+
+   while ( true ) {
+      mutex->Lock();
+      if ( count == 0 || deadlines[0] > now ) {
+         armed = 0;
+         if ( count > 0 ) Arm();
+         mutex->Unlock();
+         return;
+      }
+      timer = timers[0];
+      Pop();
+      handler = (TTReactorHandler*)live->Remove(timer);
+      mutex->Unlock();
+      if ( handler ) handler->HandleTimer(timer);
+   }
+}
+
+//
+// Push, Pop
+//
+// Heap operations.  The mutex must be held.
+
+void TTTimers::Push(long long deadline, long int timer)
+{
+   if ( count == allocated ) {
+      allocated += TT_TIMERS_CHUNK;
+      deadlines = (long long*)realloc(deadlines, allocated * sizeof(long long));
+      timers = (long int*)realloc(timers, allocated * sizeof(long int));
+   }
+
+   int i = count++;
+   int parent;
+   while ( i > 0 ) {
+      parent = (i - 1) / 2;
+      if ( deadlines[parent] <= deadline ) break;
+      deadlines[i] = deadlines[parent];
+      timers[i] = timers[parent];
+      i = parent;
+   }
+   deadlines[i] = deadline;
+   timers[i] = timer;
+}
+
+void TTTimers::Pop()
+{
+   if ( count == 0 ) return;
+   count--;
+   long long deadline = deadlines[count];
+   long int timer = timers[count];
+
+   int i = 0;
+   int child;
+   while ( (child = 2 * i + 1) < count ) {
+      if ( child + 1 < count && deadlines[child + 1] < deadlines[child] ) child++;
+      if ( deadline <= deadlines[child] ) break;
+      deadlines[i] = deadlines[child];
+      timers[i] = timers[child];
+      i = child;
+   }
+   deadlines[i] = deadline;
+   timers[i] = timer;
+}
+
+//
+// Arm
+//
+// Set the timerfd for the earliest deadline.  The mutex must be 
+// held.
+
+void TTTimers::Arm()
+{
+   if ( count == 0 || timer_fd < 0 ) return;
+   armed = deadlines[0];
+
+   struct itimerspec its;
+   memset(&its, 0, sizeof(its));
+   its.it_value.tv_sec = armed / 1000000000LL;
+   its.it_value.tv_nsec = armed % 1000000000LL;
+   // zero would disarm it, a deadline can't be that early anyway.
+   if ( its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0 ) its.it_value.tv_nsec = 1;
+   TT_CountSyscall();
+   timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
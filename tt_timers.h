@@ -0,0 +1,57 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTTimers - one-shot timers for the handlers of a TTReactor.  The
+// pending timers are kept in a binary heap ordered by deadline and
+// a single timerfd, registered with the reactor like any other
+// descriptor, is armed for the earliest one.  HandleTimer() is
+// called on the reactor's thread when a timer fires.
+//
+// Schedule() and Cancel() may be called from any thread.  A
+// cancelled timer stays in the heap until its deadline comes round
+// and is then dropped, so cancelling is cheap.  A handler must
+// cancel its timers before it is deleted.
+//
+// Part of the TTools package.
+
+#ifndef __tt_timers_h
+#define __tt_timers_h
+
+#include "ttools/tt_reactor.h"
+
+class TTHashtable;
+class TTMutex;
+
+class TTTimers : public TTReactorHandler {
+
+public:
+
+   TTTimers();
+   ~TTTimers();
+
+   int Handle() { return timer_fd; }
+
+   long int Schedule(TTReactorHandler * handler, int ms);
+   void Cancel(long int timer);
+
+   virtual void HandleEvent(int events);
+
+private:
+
+   void Push(long long deadline, long int timer);
+   void Pop();
+   void Arm();
+
+   int timer_fd;
+   long int sequence;
+   long long armed;
+   long long * deadlines;
+   long int * timers;
+   int count;
+   int allocated;
+   TTHashtable * live;
+   TTMutex * mutex;
+};
+
+#endif // __tt_timers_h
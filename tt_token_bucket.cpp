@@ -0,0 +1,127 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTTokenBucket - byte rate limit.  Take() grants as many of the
+// bytes asked for as the limit allows right now, Wait() says how
+// long until the rest would be granted.  Up to burst bytes may go
+// at once after a quiet spell, TT_SHAPE_BURST_MS worth of the rate
+// unless given.
+//
+// The bucket is kept as the time its tokens run out to (a virtual
+// scheduling time), one 64 bit word updated with compare and swap,
+// so it may be shared by any number of threads without a lock.  A
+// rate of zero is no limit at all.
+//
+// Part of the TTools package.
+
+#include <cstddef>
+
+#include "ttools/tt_token_bucket.h"
+#include "ttools/tt_functions.h"
+
+TTTokenBucket::TTTokenBucket(long int rt, long int brst)
+{
+   rate = 0;
+   burst = 0;
+   burst_ns = 0;
+   tat = 0;
+   Set(rt, brst);
+}
+
+//
+// Set
+//
+// Change the rate, in bytes per second, and the burst.  Zero for 
+// the rate lifts the limit.
+
+void TTTokenBucket::Set(long int rt, long int brst)
+{
+   if ( rt < 0 ) rt = 0;
+   if ( brst <= 0 ) brst = rt / (1000 / TT_SHAPE_BURST_MS);
+   if ( brst < TT_SHAPE_BURST_MIN ) brst = TT_SHAPE_BURST_MIN;
+   burst = brst;
+   burst_ns = ( rt > 0 ) ? (long long)brst * 1000000000LL / rt : 0;
+   tat = TT_Now();
+   rate = rt;
+}
+
+//
+// Take
+//
+// Returns how many of want bytes may be sent now, from nothing to 
+// all of them, and counts them against the limit.
+
+long int TTTokenBucket::Take(long int want)
+{
+   long int rt = rate;
+   if ( rt <= 0 || want <= 0 ) return want;
+
+   long long now = TT_Now();
+   long long t, base, room, grant;
+   while ( true ) {
+      t = tat;
+      base = ( t > now ) ? t : now;
+      room = now + burst_ns - base;
+      if ( room <= 0 ) return 0;
+      grant = (room / 1000) * rt / 1000000;
+      if ( grant > want ) grant = want;
+      if ( grant <= 0 ) return 0;
+      if ( __sync_bool_compare_and_swap(&tat, t, base + grant * 1000000000LL / rt) ) return grant;
+   }
+}
+
+//
+// Give
+//
+// Hand back bytes taken but not sent.
+
+void TTTokenBucket::Give(long int unused)
+{
+   long int rt = rate;
+   if ( rt <= 0 || unused <= 0 ) return;
+   __sync_fetch_and_sub(&tat, unused * 1000000000LL / rt);
+}
+
+//
+// Charge
+//
+// Count bytes that have gone already, whether the limit allowed 
+// them or not.  Returns false if they ran past it, the debt is 
+// paid off before Take() grants anything again.
+
+bool TTTokenBucket::Charge(long int used)
+{
+   long int rt = rate;
+   if ( rt <= 0 || used <= 0 ) return true;
+
+   long long now = TT_Now();
+   long long t, base, next;
+   do {
+      t = tat;
+      base = ( t > now ) ? t : now;
+      next = base + used * 1000000000LL / rt;
+   } while ( !__sync_bool_compare_and_swap(&tat, t, next) );
+   return ( next <= now + burst_ns );
+}
+
+//
+// Wait
+//
+// Milliseconds until want bytes, or a burst if that is less, may 
+// be taken.  At least one.
+
+int TTTokenBucket::Wait(long int want)
+{
+   long int rt = rate;
+   if ( rt <= 0 ) return 1;
+   if ( want > burst ) want = burst;
+
+   long long now = TT_Now();
+   long long t = tat;
+   long long base = ( t > now ) ? t : now;
+   long long ready = base + want * 1000000000LL / rt - burst_ns;
+   long long ms = ( ready - now ) / 1000000 + 1;
+   if ( ms < 1 ) ms = 1;
+   return (int)ms;
+}
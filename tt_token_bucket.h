@@ -0,0 +1,47 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTTokenBucket - byte rate limit.  Take() grants as many of the
+// bytes asked for as the limit allows right now, Wait() says how
+// long until the rest would be granted.  Up to burst bytes may go
+// at once after a quiet spell, TT_SHAPE_BURST_MS worth of the rate
+// unless given.
+//
+// The bucket is kept as the time its tokens run out to (a virtual
+// scheduling time), one 64 bit word updated with compare and swap,
+// so it may be shared by any number of threads without a lock.  A
+// rate of zero is no limit at all.
+//
+// Part of the TTools package.
+
+#ifndef __tt_token_bucket_h
+#define __tt_token_bucket_h
+
+const int TT_SHAPE_BURST_MS = 20;
+const long int TT_SHAPE_BURST_MIN = 4096;
+
+class TTTokenBucket {
+
+public:
+
+   TTTokenBucket(long int rt = 0, long int brst = 0);
+
+   void Set(long int rt, long int brst = 0);
+   bool Limited() { return rate > 0; }
+   long int Rate() { return rate; }
+   long int Take(long int want);
+   void Give(long int unused);
+   bool Charge(long int used);
+   int Wait(long int want);
+
+private:
+
+
+   volatile long int rate;       // bytes per second
+   volatile long int burst;      // bytes
+   volatile long long burst_ns;
+   volatile long long tat;
+};
+
+#endif // __tt_token_bucket_h
@@ -0,0 +1,675 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTUringReactor - completion engine for TTReactor built directly on
+// the io_uring system calls.  Listening sockets use multishot accept,
+// connected sockets use multishot receive into a group of provided
+// buffers, and sends queued from the reactor thread are submitted
+// together with the next wait, so a busy loop makes one system call
+// per pass rather than one per socket operation.
+//
+// Every registered descriptor gets a TTUringWatch which counts the
+// operations the kernel still holds for it.  Remove() cancels them,
+// and the handler is only told it has been removed once the last
+// one has completed.
+//
+// Only the reactor thread enters the ring.  The kernel ties a
+// request to the thread that submitted it and cancels it when that
+// thread exits, so other threads queue their requests and wake the
+// loop through an eventfd instead.
+//
+// Part of the TTools package.
+
+#include <cstddef>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef WIN32
+#else
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#endif
+
+#include "ttools/tt_uring_reactor.h"
+#include "ttools/tt_hashtable.h"
+#include "ttools/tt_linked_list.h"
+#include "ttools/tt_functions.h"
+#include "ttools/tt_mutex.h"
+
+//
+// Operation codes, kept in the low bits of each request's
+// user_data next to the watch pointer.  A user_data of zero is a
+// request nobody waits on (buffers and cancels), the wake poll
+// has a user_data of its own.
+
+const unsigned long TT_URING_OP_POLL = 1;
+const unsigned long TT_URING_OP_RECV = 2;
+const unsigned long TT_URING_OP_ACCEPT = 3;
+const unsigned long TT_URING_OP_SEND = 4;
+const unsigned long TT_URING_OP_SEND_ZC = 5;
+const unsigned long TT_URING_OP_CONNECT = 6;
+const unsigned long TT_URING_OP_READ = 7;
+const unsigned long TT_URING_OP_MASK = 7;
+const unsigned long TT_URING_WAKE = 1;
+
+TTUringWatch::TTUringWatch(int f, TTReactorHandler * h)
+{
+   fd = f;
+   handler = h;
+   pending = 0;
+   removed = false;
+   paused = false;
+}
+
+TTUringReactor::TTUringReactor()
+{
+   ready = false;
+   send_zc = false;
+   ring_fd = -1;
+   wake_fd = -1;
+   ring = NULL;
+   ring_size = 0;
+   sqes = NULL;
+   sq_local_tail = 0;
+   buf_base = NULL;
+   watches = new TTHashtable(521);
+   mutex = new TTMutex();
+   ready = Setup();
+}
+
+TTUringReactor::~TTUringReactor()
+{
+   Stop();
+
+   // anything still registered is dropped along with the ring.
+   TTLinkedList * ttl = watches->Enumerate();
+   TTLinkedList * item;
+   while ( (item = ttl->Pop()) ) {
+      delete (TTUringWatch*)item->item;
+      delete item;
+   }
+   delete ttl;
+
+   if ( sqes ) munmap(sqes, sq_entries * sizeof(struct io_uring_sqe));
+   if ( ring ) munmap(ring, ring_size);
+   if ( ring_fd >= 0 ) close(ring_fd);
+   if ( wake_fd >= 0 ) close(wake_fd);
+   free(buf_base);
+   delete watches;
+   delete mutex;
+}
+
+//
+// Setup
+//
+// Create the ring, map it, and register the receive buffer ring.
+// Any failure here means the kernel can't run this engine and the
+// caller should fall back to epoll.
+
+bool TTUringReactor::Setup()
+{
+   wake_fd = eventfd(0, EFD_NONBLOCK);
+   if ( wake_fd < 0 ) return false;
+
+   struct io_uring_params params;
+   memset(&params, 0, sizeof(params));
+   ring_fd = syscall(__NR_io_uring_setup, TT_URING_ENTRIES, &params);
+   if ( ring_fd < 0 ) {
+      TT_Debug("TTUringReactor::Setup() io_uring_setup failed");
+      return false;
+   }
+   if ( !(params.features & IORING_FEAT_SINGLE_MMAP) ) {
+      TT_Debug("TTUringReactor::Setup() kernel too old");
+      return false;
+   }
+
+   // the submission and completion rings share one mapping.
+
+   unsigned long sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+   unsigned long cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+   ring_size = ( sqSize > cqSize ) ? sqSize : cqSize;
+   ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+               ring_fd, IORING_OFF_SQ_RING);
+   if ( ring == MAP_FAILED ) {
+      ring = NULL;
+      return false;
+   }
+
+   sq_entries = params.sq_entries;
+   sqes = (struct io_uring_sqe*)mmap(NULL, sq_entries * sizeof(struct io_uring_sqe),
+               PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+   if ( sqes == MAP_FAILED ) {
+      sqes = NULL;
+      return false;
+   }
+
+   unsigned char * base = (unsigned char*)ring;
+   sq_head = (unsigned*)(base + params.sq_off.head);
+   sq_tail = (unsigned*)(base + params.sq_off.tail);
+   sq_mask = *(unsigned*)(base + params.sq_off.ring_mask);
+   unsigned * sqArray = (unsigned*)(base + params.sq_off.array);
+   for ( unsigned i = 0; i < sq_entries; i++ ) sqArray[i] = i;
+   sq_local_tail = *sq_tail;
+
+   cq_head = (unsigned*)(base + params.cq_off.head);
+   cq_tail = (unsigned*)(base + params.cq_off.tail);
+   cq_mask = *(unsigned*)(base + params.cq_off.ring_mask);
+   cqes = (struct io_uring_cqe*)(base + params.cq_off.cqes);
+
+   // provided buffers for multishot receive.  The kernel picks a
+   // buffer for each completion and we hand it back in Recycle()
+   // once the handler has copied the data out.  The whole group is
+   // provided here, synchronously, which also tells us whether the
+   // kernel supports buffer selection at all.
+
+   buf_base = (unsigned char*)malloc(TT_URING_BUFFERS * TT_URING_BUFFER_SIZE);
+   if ( !buf_base ) return false;
+
+   struct io_uring_sqe * sqe = GetSqe(NULL, 0);
+   sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+   sqe->fd = TT_URING_BUFFERS;
+   sqe->addr = (unsigned long)buf_base;
+   sqe->len = TT_URING_BUFFER_SIZE;
+   sqe->off = 0;
+   sqe->buf_group = 0;
+   Publish();
+   if ( syscall(__NR_io_uring_enter, ring_fd, 1, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 ) {
+      return false;
+   }
+   unsigned head = *cq_head;
+   if ( head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) || cqes[head & cq_mask].res < 0 ) {
+      TT_Debug("TTUringReactor::Setup() provided buffers unsupported");
+      return false;
+   }
+   __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+
+   // zero copy sends are optional, ask whether the kernel has them.
+
+   int probeSize = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+   struct io_uring_probe * probe = (struct io_uring_probe*)malloc(probeSize);
+   if ( probe ) {
+      memset(probe, 0, probeSize);
+      if ( syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, 256) >= 0 &&
+           probe->last_op >= IORING_OP_SEND_ZC ) {
+         send_zc = ( probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED ) != 0;
+      }
+      free(probe);
+   }
+
+   return true;
+}
+
+bool TTUringReactor::Ready()
+{
+   return ready;
+}
+
+//
+// Return a receive buffer to the kernel.  The request goes out 
+// with the loop's next submission, no extra system call.
+
+void TTUringReactor::Recycle(int bid)
+{
+   mutex->Lock();
+   struct io_uring_sqe * sqe = GetSqe(NULL, 0);
+   sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+   sqe->fd = 1;
+   sqe->addr = (unsigned long)(buf_base + (bid * TT_URING_BUFFER_SIZE));
+   sqe->len = TT_URING_BUFFER_SIZE;
+   sqe->off = bid;
+   sqe->buf_group = 0;
+   Publish();
+   mutex->Unlock();
+}
+
+//
+// GetSqe
+//
+// Grab the next submission entry and count it against the watch.
+// Must be called with the mutex held.  The entry becomes visible
+// to the kernel once it is filled in and Publish() is called.
+
+struct io_uring_sqe * TTUringReactor::GetSqe(TTUringWatch * w, int op)
+{
+   while ( sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries ) {
+      // ring is full.  The loop can push what it has to the kernel, 
+      // anyone else has to wait for the loop to do it.
+      if ( InLoop() ) {
+         TT_CountSyscall();
+         syscall(__NR_io_uring_enter, ring_fd, sq_entries, 0, 0, NULL, 0);
+      }
+      else {
+         mutex->Unlock();
+         Wake();
+         TT_Slice();
+         mutex->Lock();
+      }
+   }
+
+   struct io_uring_sqe * sqe = &sqes[sq_local_tail & sq_mask];
+   memset(sqe, 0, sizeof(*sqe));
+   if ( w ) {
+      w->pending++;
+      sqe->user_data = (unsigned long)w | op;
+   }
+   sq_local_tail++;
+   return sqe;
+}
+
+//
+// Publish
+//
+// Hand the entries filled in since the last call to the kernel.
+// Must be called with the mutex held.
+
+void TTUringReactor::Publish()
+{
+   __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+}
+
+//
+// Submit
+//
+// Make sure queued entries reach the kernel.  From the reactor
+// thread there is nothing to do, the loop submits everything with
+// its next wait.  Anyone else wakes the loop to do it for them.
+
+void TTUringReactor::Submit()
+{
+   if ( !InLoop() ) Wake();
+}
+
+void TTUringReactor::Wake()
+{
+   uint64_t one = 1;
+   TT_CountSyscall();
+   if ( write(wake_fd, &one, sizeof(one)) < 0 ) {
+      TT_Debug("TTUringReactor::Wake() wake failed");
+   }
+}
+
+//
+// ArmWake
+//
+// Poll the wake descriptor from inside the ring, so a write to it
+// ends the loop's wait.  Must be called from the reactor thread.
+
+void TTUringReactor::ArmWake()
+{
+   uint64_t count;
+   if ( read(wake_fd, &count, sizeof(count)) < 0 ) count = 0;
+
+   mutex->Lock();
+   struct io_uring_sqe * sqe = GetSqe(NULL, 0);
+   sqe->opcode = IORING_OP_POLL_ADD;
+   sqe->fd = wake_fd;
+   sqe->len = IORING_POLL_ADD_MULTI;
+   sqe->poll32_events = POLLIN;
+   sqe->user_data = TT_URING_WAKE;
+   Publish();
+   mutex->Unlock();
+}
+
+//
+// Watch
+//
+// Find or create the watch for a descriptor.  Must be called with
+// the mutex held.
+
+TTUringWatch * TTUringReactor::Watch(int fd, TTReactorHandler * handler)
+{
+   TTUringWatch * w = (TTUringWatch*)watches->Get((long int)fd);
+   if ( !w ) {
+      w = new TTUringWatch(fd, handler);
+      watches->Put((long int)fd, (void*)w);
+   }
+   return w;
+}
+
+//
+// Add a descriptor for readiness events, using a multishot poll.
+
+bool TTUringReactor::Add(int fd, TTReactorHandler * handler)
+{
+   mutex->Lock();
+   TTUringWatch * w = Watch(fd, handler);
+   struct io_uring_sqe * sqe = GetSqe(w, TT_URING_OP_POLL);
+   sqe->opcode = IORING_OP_POLL_ADD;
+   sqe->fd = fd;
+   sqe->len = IORING_POLL_ADD_MULTI;
+   sqe->poll32_events = POLLIN | POLLOUT | POLLRDHUP | EPOLLET;
+   Publish();
+   mutex->Unlock();
+   Submit();
+   return true;
+}
+
+//
+// Start a multishot receive on a connected socket.  Data arrives
+// through HandleRecv().
+
+bool TTUringReactor::Recv(int fd, TTReactorHandler * handler)
+{
+   mutex->Lock();
+   TTUringWatch * w = Watch(fd, handler);
+   w->paused = false;
+   struct io_uring_sqe * sqe = GetSqe(w, TT_URING_OP_RECV);
+   sqe->opcode = IORING_OP_RECV;
+   sqe->fd = fd;
+   sqe->ioprio = IORING_RECV_MULTISHOT;
+   sqe->flags = IOSQE_BUFFER_SELECT;
+   sqe->buf_group = 0;
+   Publish();
+   mutex->Unlock();
+   Submit();
+   return true;
+}
+
+//
+// Stop a socket's multishot receive until Recv() is called again.  
+// Data the kernel had already received may still arrive, anything 
+// after that is left in the socket.
+
+void TTUringReactor::StopRecv(int fd, TTReactorHandler * handler)
+{
+   mutex->Lock();
+   TTUringWatch * w = (TTUringWatch*)watches->Get((long int)fd);
+   if ( !w || w->handler != handler || w->removed || w->paused ) {
+      mutex->Unlock();
+      return;
+   }
+   w->paused = true;
+   struct io_uring_sqe * sqe = GetSqe(NULL, 0);
+   sqe->opcode = IORING_OP_ASYNC_CANCEL;
+   sqe->addr = (unsigned long)w | TT_URING_OP_RECV;
+   Publish();
+   mutex->Unlock();
+   Submit();
+}
+
+//
+// Start a multishot accept on a listening socket.  New sockets
+// arrive through HandleAccept().
+
+bool TTUringReactor::Accept(int fd, TTReactorHandler * handler)
+{
+   mutex->Lock();
+   TTUringWatch * w = Watch(fd, handler);
+   struct io_uring_sqe * sqe = GetSqe(w, TT_URING_OP_ACCEPT);
+   sqe->opcode = IORING_OP_ACCEPT;
+   sqe->fd = fd;
+   sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+   sqe->accept_flags = SOCK_CLOEXEC;
+   Publish();
+   mutex->Unlock();
+   Submit();
+   return true;
+}
+
+//
+// Queue a send.  The buffer must stay untouched until the handler
+// gets HandleSendDone(), which reports the number of bytes sent
+// (possibly fewer than asked for) or a negative error.
+
+bool TTUringReactor::Send(int fd, const unsigned char * buf, int len, TTReactorHandler * handler)
+{
+   mutex->Lock();
+   TTUringWatch * w = (TTUringWatch*)watches->Get((long int)fd);
+   if ( !w || w->removed ) {
+      mutex->Unlock();
+      return false;
+   }
+   struct io_uring_sqe * sqe = GetSqe(w, TT_URING_OP_SEND);
+   sqe->opcode = IORING_OP_SEND;
+   sqe->fd = fd;
+   sqe->addr = (unsigned long)buf;
+   sqe->len = len;
+   sqe->msg_flags = MSG_NOSIGNAL;
+   Publish();
+   mutex->Unlock();
+   Submit();
+   return true;
+}
+
+//
+// Queue a zero copy send.  The kernel sends straight from buf, so 
+// the buffer must stay untouched until HandleZeroCopyDone(), which 
+// follows HandleSendDone() once the kernel has let go of it.  
+// Returns false if the kernel can't do zero copy sends.
+
+bool TTUringReactor::SendZeroCopy(int fd, const unsigned char * buf, int len, TTReactorHandler * handler)
+{
+   if ( !send_zc ) return false;
+   mutex->Lock();
+   TTUringWatch * w = (TTUringWatch*)watches->Get((long int)fd);
+   if ( !w || w->removed ) {
+      mutex->Unlock();
+      return false;
+   }
+   struct io_uring_sqe * sqe = GetSqe(w, TT_URING_OP_SEND_ZC);
+   sqe->opcode = IORING_OP_SEND_ZC;
+   sqe->fd = fd;
+   sqe->addr = (unsigned long)buf;
+   sqe->len = len;
+   sqe->msg_flags = MSG_NOSIGNAL;
+   Publish();
+   mutex->Unlock();
+   Submit();
+   return true;
+}
+
+//
+// Start a connect on a non-blocking socket, the result arrives 
+// through HandleConnect().  addr must stay valid until then.
+
+bool TTUringReactor::Connect(int fd, const struct sockaddr * addr, int len, TTReactorHandler * handler)
+{
+   mutex->Lock();
+   TTUringWatch * w = Watch(fd, handler);
+   struct io_uring_sqe * sqe = GetSqe(w, TT_URING_OP_CONNECT);
+   sqe->opcode = IORING_OP_CONNECT;
+   sqe->fd = fd;
+   sqe->addr = (unsigned long)addr;
+   sqe->off = len;
+   Publish();
+   mutex->Unlock();
+   Submit();
+   return true;
+}
+
+//
+// Read len bytes of the open file from offset into buf for the 
+// socket fd, so the loop never waits on the disk.  The result 
+// arrives through HandleFileRead(), buf must stay valid until then.
+
+bool TTUringReactor::ReadFile(int fd, int file, unsigned char * buf, int len, long int offset, TTReactorHandler * handler)
+{
+   mutex->Lock();
+   TTUringWatch * w = (TTUringWatch*)watches->Get((long int)fd);
+   if ( !w || w->removed ) {
+      mutex->Unlock();
+      return false;
+   }
+   struct io_uring_sqe * sqe = GetSqe(w, TT_URING_OP_READ);
+   sqe->opcode = IORING_OP_READ;
+   sqe->fd = file;
+   sqe->addr = (unsigned long)buf;
+   sqe->len = len;
+   sqe->off = offset;
+   Publish();
+   mutex->Unlock();
+   Submit();
+   return true;
+}
+
+//
+// Remove a descriptor.  Everything the kernel holds for it is
+// cancelled, HandleRemoved() follows once the last operation has
+// completed.  May be called from any thread.
+
+void TTUringReactor::Remove(int fd, TTReactorHandler * handler)
+{
+   mutex->Lock();
+   TTUringWatch * w = (TTUringWatch*)watches->Get((long int)fd);
+   if ( !w || w->handler != handler || w->removed ) {
+      mutex->Unlock();
+      if ( !w ) handler->HandleRemoved();
+      return;
+   }
+   w->removed = true;
+   watches->Remove((long int)fd);
+   if ( w->pending == 0 ) {
+      mutex->Unlock();
+      delete w;
+      handler->HandleRemoved();
+      return;
+   }
+   struct io_uring_sqe * sqe = GetSqe(NULL, 0);
+   sqe->opcode = IORING_OP_ASYNC_CANCEL;
+   sqe->fd = fd;
+   sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+   Publish();
+   mutex->Unlock();
+   Submit();
+}
+
+//
+// Complete
+//
+// Handle one completion.  Multishot requests that the kernel
+// dropped (no IORING_CQE_F_MORE) are re-armed unless the watch is
+// being removed, or its receive has been stopped.
+
+void TTUringReactor::Complete(struct io_uring_cqe * cqe)
+{
+   if ( cqe->user_data == 0 ) return;
+   if ( cqe->user_data == TT_URING_WAKE ) {
+      // drain the counter so the next write wakes us again.
+      uint64_t count;
+      if ( read(wake_fd, &count, sizeof(count)) < 0 ) count = 0;
+      if ( !(cqe->flags & IORING_CQE_F_MORE) ) ArmWake();
+      return;
+   }
+
+   TTUringWatch * w = (TTUringWatch*)(cqe->user_data & ~TT_URING_OP_MASK);
+   unsigned long op = cqe->user_data & TT_URING_OP_MASK;
+   bool more = ( cqe->flags & IORING_CQE_F_MORE ) != 0;
+   int res = cqe->res;
+
+   mutex->Lock();
+   bool removed = w->removed;
+   bool paused = w->paused;
+   mutex->Unlock();
+
+   if ( op == TT_URING_OP_POLL ) {
+      if ( !removed && res > 0 ) {
+         int mask = 0;
+         if ( res & (POLLIN | POLLRDHUP) ) mask |= TT_EVENT_READ;
+         if ( res & POLLOUT ) mask |= TT_EVENT_WRITE;
+         if ( res & (POLLERR | POLLHUP) ) mask |= TT_EVENT_ERROR;
+         w->handler->HandleEvent(mask);
+      }
+      if ( !more && !removed && res != -ECANCELED ) Add(w->fd, w->handler);
+   }
+   else if ( op == TT_URING_OP_RECV ) {
+      if ( cqe->flags & IORING_CQE_F_BUFFER ) {
+         int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+         if ( !removed ) w->handler->HandleRecv(buf_base + (bid * TT_URING_BUFFER_SIZE), res);
+         Recycle(bid);
+         if ( !more && !removed && !paused ) Recv(w->fd, w->handler);
+      }
+      else if ( res == -ENOBUFS ) {
+         // every buffer was in use, the handlers have given them
+         // back by now so just start again.
+         if ( !removed && !paused ) Recv(w->fd, w->handler);
+      }
+      else if ( !removed && res != -ECANCELED ) {
+         // end of stream or a receive error.
+         w->handler->HandleRecv(NULL, ( res == 0 ) ? 0 : res);
+      }
+   }
+   else if ( op == TT_URING_OP_ACCEPT ) {
+      if ( res >= 0 ) {
+         if ( !removed ) w->handler->HandleAccept(res);
+         else close(res);
+      }
+      else if ( res != -ECANCELED ) {
+         TT_Debug("TTUringReactor::Complete() accept failed");
+      }
+      if ( !more && !removed && res != -ECANCELED ) Accept(w->fd, w->handler);
+   }
+   else if ( op == TT_URING_OP_SEND ) {
+      if ( !removed ) w->handler->HandleSendDone(res);
+   }
+   else if ( op == TT_URING_OP_CONNECT ) {
+      if ( !removed ) w->handler->HandleConnect(res);
+   }
+   else if ( op == TT_URING_OP_READ ) {
+      if ( !removed ) w->handler->HandleFileRead(res);
+   }
+   else if ( op == TT_URING_OP_SEND_ZC ) {
+      // the send result comes first, then a notification once the 
+      // buffer is free.  If the first has no F_MORE there is no 
+      // notification to wait for.
+      if ( cqe->flags & IORING_CQE_F_NOTIF ) {
+         if ( !removed ) w->handler->HandleZeroCopyDone();
+      }
+      else if ( !removed ) {
+         w->handler->HandleSendDone(res);
+         if ( !more ) w->handler->HandleZeroCopyDone();
+      }
+   }
+
+   mutex->Lock();
+   if ( !more ) w->pending--;
+   bool done = ( w->removed && w->pending == 0 );
+   mutex->Unlock();
+
+   if ( done ) {
+      TTReactorHandler * handler = w->handler;
+      delete w;
+      handler->HandleRemoved();
+   }
+}
+
+//
+// Run
+//
+// Do the thread loop here.  Each pass submits whatever the
+// handlers queued during the last pass and waits for at least one
+// completion in the same system call.
+
+void TTUringReactor::Run()
+{
+   int retVal;
+   unsigned toSubmit;
+   unsigned head;
+
+   ArmWake();
+   while ( !stop ) {
+      mutex->Lock();
+      toSubmit = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+      mutex->Unlock();
+
+      TT_CountSyscall();
+      retVal = syscall(__NR_io_uring_enter, ring_fd, toSubmit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+      if ( retVal < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY ) {
+         TT_Error("TTUringReactor::Run() io_uring_enter failed");
+         break;
+      }
+
+      head = *cq_head;
+      while ( head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) ) {
+         Complete(&cqes[head & cq_mask]);
+         head++;
+         __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+      }
+   }
+}
@@ -0,0 +1,114 @@
+//
+// File     : $Id$
+// Author   : Trent McNair
+//
+// TTUringReactor - completion engine for TTReactor built directly on
+// the io_uring system calls.  Listening sockets use multishot accept,
+// connected sockets use multishot receive into a group of provided
+// buffers, and sends queued from the reactor thread are submitted
+// together with the next wait, so a busy loop makes one system call
+// per pass rather than one per socket operation.
+//
+// Every registered descriptor gets a TTUringWatch which counts the
+// operations the kernel still holds for it.  Remove() cancels them,
+// and the handler is only told it has been removed once the last
+// one has completed.
+//
+// Only the reactor thread enters the ring, other threads queue
+// their requests and wake it through an eventfd.
+//
+// Part of the TTools package.
+
+#ifndef __tt_uring_reactor_h
+#define __tt_uring_reactor_h
+
+#ifdef WIN32
+#else
+#include <linux/io_uring.h>
+#endif
+
+#include "ttools/tt_reactor.h"
+
+class TTHashtable;
+class TTMutex;
+
+const int TT_URING_ENTRIES = 256;
+const int TT_URING_BUFFERS = 128;       // must be a power of two
+const int TT_URING_BUFFER_SIZE = 16384;
+
+class TTUringWatch {
+
+public:
+
+   TTUringWatch(int f, TTReactorHandler * h);
+
+   TTReactorHandler * handler;
+   int fd;
+   int pending;
+   bool removed;
+   bool paused;
+};
+
+class TTUringReactor : public TTReactor {
+
+public:
+
+   TTUringReactor();
+   ~TTUringReactor();
+
+   virtual int Engine() { return TT_ENGINE_URING; }
+   virtual bool Completion() { return true; }
+
+   virtual bool Add(int fd, TTReactorHandler * handler);
+   virtual void Remove(int fd, TTReactorHandler * handler);
+
+   virtual bool Recv(int fd, TTReactorHandler * handler);
+   virtual void StopRecv(int fd, TTReactorHandler * handler);
+   virtual bool Accept(int fd, TTReactorHandler * handler);
+   virtual bool Send(int fd, const unsigned char * buf, int len, TTReactorHandler * handler);
+   virtual bool SendZeroCopy(int fd, const unsigned char * buf, int len, TTReactorHandler * handler);
+   virtual bool Connect(int fd, const struct sockaddr * addr, int len, TTReactorHandler * handler);
+   virtual bool ReadFile(int fd, int file, unsigned char * buf, int len, long int offset, TTReactorHandler * handler);
+
+protected:
+
+   virtual bool Ready();
+   virtual void Wake();
+   virtual void Run();
+
+private:
+
+   bool Setup();
+   TTUringWatch * Watch(int fd, TTReactorHandler * handler);
+   struct io_uring_sqe * GetSqe(TTUringWatch * w, int op);
+   void Publish();
+   void Submit();
+   void ArmWake();
+   void Complete(struct io_uring_cqe * cqe);
+   void Recycle(int bid);
+
+   bool ready;
+   bool send_zc;
+   int ring_fd;
+   int wake_fd;
+
+   void * ring;
+   unsigned long ring_size;
+   unsigned * sq_head;
+   unsigned * sq_tail;
+   unsigned sq_mask;
+   unsigned sq_entries;
+   unsigned sq_local_tail;
+   struct io_uring_sqe * sqes;
+   unsigned * cq_head;
+   unsigned * cq_tail;
+   unsigned cq_mask;
+   struct io_uring_cqe * cqes;
+
+   unsigned char * buf_base;
+
+   TTHashtable * watches;
+   TTMutex * mutex;
+};
+
+#endif // __tt_uring_reactor_h